@@ -19,19 +19,59 @@
 
 		 #endif
 
+		 To shorten the time it takes to join, the header can also define
+		 a static ip, which skips DHCP, and the BSSID of the access point.
+		 Without a BSSID it is learnt from the first join, but only kept in
+		 RAM, so it speeds up rejoins until the next reset. Define it here
+		 to also skip the scan on the first join after a reset.
+
+		 #define ESP8266_STATIC_IP	"192.168.1.50"
+		 #define ESP8266_GATEWAY	"192.168.1.1"
+		 #define ESP8266_NETMASK	"255.255.255.0"
+		 #define ESP8266_BSSID		"ca:d7:19:d8:a6:44"
+
 @file ESP8266.h
 @author  Jonatan Lundqvist Silins, jonls@kth.se
 @date 06-04-2021
 @version 1.0
 *******************************************************************************/
 
+#ifndef INC_ESP8266_H_
+#define INC_ESP8266_H_
+
 #include <usart.h>
+#include <gpio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <login.h>
+#include <http.h>
 
 #define RX_BUFFER_SIZE 			4096
+#define ESP8266_RESPONSE_TIMEOUT	5000	// ms to wait for the server to answer a request
+#define ESP8266_COMMAND_TIMEOUT		2000	// ms to wait for OK or ERROR after a command
+#define ESP8266_CONNECT_TIMEOUT		5000	// ms for AT+CIPSTART and AT+CIPDOMAIN, which wait for the network
+#define ESP8266_JOIN_TIMEOUT		20000	// ms for AT+CWJAP and AT+RST, joining an AP is the slowest
+#define ESP8266_CIPSEND_MAX			2048	// max bytes the ESP8266 accepts in one AT+CIPSEND
+#define ESP8266_ESCAPE_GUARD		1000	// ms of silence required before and after +++
+#define ESP8266_TX_TIMEOUT(len)		(100 + (len) / 10)	// ms to transmit len bytes, 115200 baud is ~11 bytes/ms
+#define ESP8266_DEFAULT_BAUD_RATE	115200	// rate of the ESP8266 after a reset, and of MX_UART4_Init
+#define ESP8266_MAX_BAUD_RATE		921600	// highest rate tried by esp8266_negotiate_baud_rate
+#define ESP8266_BAUD_VERIFY_TIMEOUT	100		// ms to wait for OK when checking the link after a rate change
+#define ESP8266_READY_TIMEOUT		3000	// ms from a reset until the module sends ready
+#define ESP8266_WAKE_GPIO			0		// gpio of the ESP8266 that ESP_WAKE_Pin is wired to
+#define ESP8266_BSSID_SIZE			18		// "aa:bb:cc:dd:ee:ff" and terminator
+#define ESP8266_HOST_SIZE			128		// longest host name that is cached by esp8266_dns_lookup
+#define ESP8266_IP_SIZE				16		// "255.255.255.255" and terminator
+#define ESP8266_DNS_TTL				3600000	// ms a looked up address is used, the ESP8266 does not tell the real TTL
+#define ESP8266_REQUEST_SEGMENTS	32		// max segments in one ESP8266_REQUEST
+#define ESP8266_REQUEST_FIELDS		48		// bytes for numbers formatted into one ESP8266_REQUEST
+
+/* Set to 1 if PA15 (UART4_RTS) is wired to GPIO13 (CTS) of the ESP8266.
+ * The ESP8266 then only sends while the L476 can receive, which keeps the rx interrupt
+ * from losing bytes at high rates. UART4_CTS is not used, PB7 is taken by I2C1. */
+#define ESP8266_FLOW_CONTROL		0
 
 /* ESP8266 response codes as strings.
    These are all the implemented statuses that can
@@ -47,8 +87,10 @@ static const char ESP8266_AT_GOT_IP[] 			 = "WIFI GOT IP";
 static const char ESP8266_AT_WIFI_CONNECTED[] 	 = "WIFI CONNECTED";
 static const char ESP8266_AT_WIFI_DISCONNECTED[] = "WIFI DISCONNECTED";
 static const char ESP8266_AT_CONNECT[] 		 	 = "CONNECT";
+static const char ESP8266_AT_ALREADY_CONNECTED[] = "ALREADY CONNECTED";
 static const char ESP8266_AT_CLOSED[] 			 = "CLOSED";
 static const char ESP8266_AT_SEND_OK[] 			 = "SEND OK";
+static const char ESP8266_AT_PROMPT[] 			 = ">";
 static const char ESP8266_AT_NO_AP[] 			 = "No AP\r\n";
 static const char ESP8266_AT_UNKNOWN[]			 = "UNKNOWN";
 static const char ESP8266_AT_CWMODE_1[]			 = "CWMODE_CUR:1";
@@ -64,6 +106,35 @@ static const char ESP8266_AT_NO_TARGET[]	     = "cannot find AP";
 static const char ESP8266_AT_CONNECTION_FAIL[]	 = "connection failed";
 static const char ESP8266_AT_CIPMUX_0[]	 		 = "CIPMUX:0";
 static const char ESP8266_AT_CIPMUX_1[]	 		 = "CIPMUX:1";
+static const char ESP8266_AT_STATUS_3[]	 		 = "STATUS:3";
+static const char ESP8266_AT_IPD[]	 			 = "+IPD,";
+static const char ESP8266_AT_CWJAP_INFO[]	 	 = "+CWJAP:\"";
+static const char ESP8266_AT_CIPDOMAIN_INFO[]	 = "+CIPDOMAIN:";
+
+/* Sleep modes, the values of light and modem sleep are the ones used by AT+SLEEP */
+typedef enum {
+	ESP8266_SLEEP_NONE = 0,		// fully awake
+	ESP8266_SLEEP_LIGHT,		// ~1 mA, wifi kept associated, woken by pulling ESP_WAKE_Pin low
+	ESP8266_SLEEP_MODEM,		// ~15 mA, radio off between DTIM beacons, uart always usable
+	ESP8266_SLEEP_DEEP			// ~20 uA, everything off, woken by a reset on ESP_RST_Pin
+} ESP8266_SLEEP_MODE;
+
+/* A request made of segments that are sent one after another, without copying them into one buffer.
+ * Segments point to the data, so the data has to be kept until the request is sent. Numbers are
+ * formatted into the small field buffer of the request. */
+typedef struct {
+	const char* data;
+	uint16_t	len;
+} ESP8266_SEGMENT;
+
+typedef struct {
+	ESP8266_SEGMENT segments[ESP8266_REQUEST_SEGMENTS];
+	uint8_t			count;
+	uint16_t		len;			// total length of all segments
+	bool			overflow;		// set if a segment or field did not fit, the request is then not sent
+	char			fields[ESP8266_REQUEST_FIELDS];
+	uint8_t			fields_used;
+} ESP8266_REQUEST;
 
 /* HTTP request strings*/
 static const char HTTP_GET[]	 		 		 = "GET ";
@@ -71,7 +142,11 @@ static const char HTTP_POST[]	 		 		 = "POST ";
 static const char HTTP_VERSION[]	 		     = "HTTP/1.1";
 static const char HTTP_HOST[]	 		         = "Host: ";
 static const char HTTP_CONNECTION_CLOSE[]	     = "Connection: close";
+static const char HTTP_CONNECTION_KEEP_ALIVE[]	 = "Connection: keep-alive";
+static const char HTTP_CONTENT_TYPE[]	 		 = "Content-Type: ";
+static const char HTTP_CONTENT_LENGTH[]	 		 = "Content-Length: ";
 static const char CRLF[] 						 = "\r\n";
+static const char HTTP_HEADER_END[] 			 = "\r\n\r\n";
 
 /* djb2 hash keys
  * Each key maps to corresponding AT command, see below for these
@@ -88,7 +163,17 @@ typedef enum {
 	ESP8266_AT_CIPMUX_KEY				= 423755967,
 	ESP8266_AT_CIPMUX_TEST_KEY			= 3657056785,
 	ESP8266_AT_START_KEY				= 3889879756,
-	ESP8266_AT_SEND_KEY					= 898252904
+	ESP8266_AT_SEND_KEY					= 898252904,
+	ESP8266_AT_CIPSTATUS_KEY			= 1243732604,
+	ESP8266_AT_CIPMODE_PASSTHROUGH_KEY	= 1167457803,
+	ESP8266_AT_CIPMODE_NORMAL_KEY		= 1167456714,
+	ESP8266_AT_SEND_PASSTHROUGH_KEY		= 3872540482,
+	ESP8266_AT_UART_CUR_KEY				= 1402862279,
+	ESP8266_AT_SLEEP_KEY				= 3229205211,
+	ESP8266_AT_WAKEUPGPIO_KEY			= 3524075806,
+	ESP8266_AT_GSLP_KEY					= 604485272,
+	ESP8266_AT_CIPSTA_CUR_KEY			= 1256135375,
+	ESP8266_AT_CIPDOMAIN_KEY			= 1437761814
 } KEYS;
 
 /* AT Commands for the ESP8266, see
@@ -138,14 +223,18 @@ static const char ESP8266_AT_CWMODE_TEST[]			= "AT+CWMODE_CUR?\r\n";
  */
 static const char ESP8266_AT_CWMODE_STATION_MODE[]	= "AT+CWMODE=1\r\n";
 
-/*Query the AP for current connection */
+/*Query the AP for current connection
+ *
+ * Returns: +CWJAP:<ssid>,<bssid>,<channel>,<rssi> or No AP
+ */
 static const char ESP8266_AT_CWJAP_TEST[]			= "AT+CWJAP?\r\n";
 
 /*Sets a connection to an Access point
  *
- * Command format: AT+CWJAP_CUR=<ssid>,<pwd>
+ * Command format: AT+CWJAP_CUR=<ssid>,<pwd>[,<bssid>]
  * <ssid>: the SSID of the target AP.
  * <pwd>: password, MAX: 64-byte ASCII.
+ * <bssid>: MAC address of the target AP, only that AP is joined.
  * Note: the command needs Station Mode to be enabled.
  *
  * The command returns an error if:
@@ -157,6 +246,14 @@ static const char ESP8266_AT_CWJAP_TEST[]			= "AT+CWJAP?\r\n";
  */
 static const char ESP8266_AT_CWJAP_SET[]			= "AT+CWJAP="; // add "ssid","pwd" + CRLF
 
+/* Sets a static ip for station mode, which turns off DHCP.
+ *
+ * Command format: AT+CIPSTA_CUR=<ip>,<gateway>,<netmask>
+ *
+ * Returns: OK
+ */
+static const char ESP8266_AT_CIPSTA_CUR[]			= "AT+CIPSTA_CUR="; // add "ip","gateway","netmask" + CRLF
+
 /* Disconnect connected AP */
 static const char ESP8266_AT_CWQAP[]				= "AT+CWQAP\r\n";
 
@@ -189,6 +286,24 @@ static const char ESP8266_AT_CIPMUX_TEST[]			= "AT+CIPMUX?\r\n";
  */
 static const char ESP8266_AT_START[]				= "AT+CIPSTART=";
 
+/* DNS lookup
+ *
+ * Command format: AT+CIPDOMAIN=<domain name>
+ *
+ * Returns: +CIPDOMAIN:<ip> and OK, or DNS Fail and ERROR
+ */
+static const char ESP8266_AT_CIPDOMAIN[]			= "AT+CIPDOMAIN="; // add "host" + CRLF
+
+/* Query the connection status
+ *
+ * Returns: STATUS:<stat>
+ * 2: got IP, no connection
+ * 3: connected
+ * 4: disconnected
+ * 5: not connected to an AP
+ */
+static const char ESP8266_AT_CIPSTATUS[]			= "AT+CIPSTATUS\r\n";
+
 /* Disconnect a connection */
 static const char ESP8266_AT_STOP[]					= "AT+CIPCLOSE=0";
 
@@ -204,6 +319,68 @@ static const char ESP8266_AT_STOP[]					= "AT+CIPCLOSE=0";
  */
 static const char ESP8266_AT_SEND[]					= "AT+CIPSEND=";
 
+/* Transfer modes
+ *
+ * 0: normal mode, data is sent with AT+CIPSEND=<len>
+ * 1: UART-WiFi passthrough mode, only with a single TCP or UDP connection (cipmux=0).
+ * 	  After AT+CIPSEND (without length) and the > prompt everything sent to the ESP8266 goes
+ * 	  straight to the socket, and everything received from the socket comes back without +IPD.
+ * 	  If the connection breaks the ESP8266 keeps trying to reconnect until +++ is sent.
+ * 	  The ESP8266 only sends what it got once the uart has been quiet for 20 ms (or 2048 bytes
+ * 	  have come in), so a request and its answer take about 20 ms longer than with AT+CIPSEND.
+ */
+static const char ESP8266_AT_CIPMODE_NORMAL[]		= "AT+CIPMODE=0\r\n";
+static const char ESP8266_AT_CIPMODE_PASSTHROUGH[]	= "AT+CIPMODE=1\r\n";
+
+/* Start sending data in passthrough mode, needs AT+CIPMODE=1 */
+static const char ESP8266_AT_SEND_PASSTHROUGH[]		= "AT+CIPSEND\r\n";
+
+/* Leave passthrough mode.
+ * Needs to be sent as a single packet, with ESP8266_ESCAPE_GUARD ms of silence
+ * before and after, and without CRLF.
+ */
+static const char ESP8266_AT_ESCAPE[]				= "+++";
+
+/* Sets the uart configuration, not saved to flash.
+ *
+ * Command format: AT+UART_CUR=<baudrate>,<databits>,<stopbits>,<parity>,<flow control>
+ * <flow control>: 0 none, 1 RTS, 2 CTS, 3 RTS and CTS
+ *
+ * Returns: OK, sent at the old rate. The module uses the new rate right after.
+ */
+static const char ESP8266_AT_UART_CUR[]				= "AT+UART_CUR="; // add the settings + CRLF
+
+/* Sets the sleep mode, only in station mode.
+ *
+ * 0: disabled
+ * 1: light sleep, the module sleeps by itself when idle and wakes up for DTIM beacons.
+ * 	  The uart does not work while asleep, use AT+WAKEUPGPIO to wake it up.
+ * 2: modem sleep, the radio is turned off between DTIM beacons.
+ *
+ * Returns: OK
+ */
+static const char ESP8266_AT_SLEEP[]				= "AT+SLEEP="; // add the mode + CRLF
+
+/* Configures a gpio to wake the module from light sleep.
+ *
+ * Command format: AT+WAKEUPGPIO=<enable>,<trigger gpio>,<trigger level>
+ * <trigger level>: 0 low, 1 high
+ * Note: after being woken up by the gpio the module stays awake until AT+SLEEP=1 is sent again.
+ *
+ * Returns: OK
+ */
+static const char ESP8266_AT_WAKEUPGPIO[]			= "AT+WAKEUPGPIO="; // add the settings + CRLF
+
+/* Enters deep sleep for the given time in ms.
+ *
+ * Command format: AT+GSLP=<time>
+ * Note: the module only wakes up by itself if GPIO16 is connected to RST. When it does wake up
+ * it restarts, all connections and settings that are not in flash are lost.
+ *
+ * Returns: OK
+ */
+static const char ESP8266_AT_GSLP[]					= "AT+GSLP="; // add the time + CRLF
+
 
 
 /*============================================================================
@@ -220,6 +397,16 @@ static const char ESP8266_AT_SEND[]					= "AT+CIPSEND=";
 void
 esp8266_get_wifi_command(char* buffer);
 
+/**
+ * @brief assemble the command for connection to a specific AP. Uses the SSID and PWD variables
+ * 		  stored in the login.h header.
+ * @param char* buffer, where the command is stored into
+ * @param const char* bssid, MAC address of the AP, EXAMPLE: "ca:d7:19:d8:a6:44"
+ * @return void
+ */
+void
+esp8266_get_wifi_bssid_command(char* buffer, const char* bssid);
+
 /**
  * @brief assemble the command for connection to a website
  * @param char* buffer, where the command is stored into
@@ -229,8 +416,18 @@ esp8266_get_wifi_command(char* buffer);
  * @return void
  */
 void
-esp8266_get_connection_command(char* buffer, char* connection_type,
-							   char* remote_ip, char* remote_port);
+esp8266_get_connection_command(char* buffer, const char* connection_type,
+							   const char* remote_ip, const char* remote_port);
+
+/**
+ * @brief assemble the command for changing the uart settings of the ESP8266, 8 data bits, 1 stop bit, no parity.
+ * @param char* buffer, where the command is stored into
+ * @param uint32_t baud_rate, new baud rate
+ * @param bool flow_control, true to make the ESP8266 wait for CTS before sending
+ * @return void
+ */
+void
+esp8266_get_uart_command(char* buffer, uint32_t baud_rate, bool flow_control);
 
 /**
  * @brief assemble the CIPSEND command with length of request.
@@ -241,12 +438,14 @@ esp8266_get_connection_command(char* buffer, char* connection_type,
  * 		  esp8266_at_send(a_buffer_for_the_command);
  * 		  esp8266_send_data(buffer_with_http_request);
  *
+ * 		  The length can be at most ESP8266_CIPSEND_MAX, use esp8266_send_large_data for longer requests.
+ *
  * @param char* buffer, where the command is stored
- * @param uint8_t len, length of the command
+ * @param uint16_t len, length of the command
  * @return void
  */
 void
-esp8266_get_at_send_command(char* buffer, uint8_t len);
+esp8266_get_at_send_command(char* buffer, uint16_t len);
 
 
 /**
@@ -255,11 +454,88 @@ esp8266_get_at_send_command(char* buffer, uint8_t len);
  * @param const char*, type of the HTTP request,   EXAMPLE: POST or GET
  * @param char* uri, URI for the request, 		   EXAMPLE: google.com/index
  * @param char* host, host adress for the request, EXAMPLE: google.com
- * @return uint8_t, length of the request
+ * @return uint16_t, length of the request
  */
-uint8_t
+uint16_t
 esp8266_http_get_request(char* buffer, const char* http_type, char* uri, char* host);
 
+/**
+ * @brief empty a request before adding segments to it
+ * @param ESP8266_REQUEST* request
+ * @return void
+ */
+void
+esp8266_request_init(ESP8266_REQUEST* request);
+
+/**
+ * @brief add a segment to a request, the data is not copied
+ * @param ESP8266_REQUEST* request
+ * @param const char* data, has to be kept until the request is sent
+ * @param uint16_t len, length of the data
+ * @return bool, false if the request is full
+ */
+bool
+esp8266_request_add(ESP8266_REQUEST* request, const char* data, uint16_t len);
+
+/**
+ * @brief add a string segment to a request, the string is not copied
+ * @param ESP8266_REQUEST* request
+ * @param const char* string, has to be kept until the request is sent
+ * @return bool, false if the request is full
+ */
+bool
+esp8266_request_add_string(ESP8266_REQUEST* request, const char* string);
+
+/**
+ * @brief add an unsigned number to a request, formatted in decimal
+ * @param ESP8266_REQUEST* request
+ * @param uint32_t value
+ * @return bool, false if the request is full
+ */
+bool
+esp8266_request_add_uint(ESP8266_REQUEST* request, uint32_t value);
+
+/**
+ * @brief add a fixed point number to a request, EXAMPLE: value 2153 with 2 decimals is added as 21.53
+ * @param ESP8266_REQUEST* request
+ * @param int32_t value, the number times 10^decimals
+ * @param uint8_t decimals, number of decimals, at most 9
+ * @return bool, false if the request is full
+ */
+bool
+esp8266_request_add_fixed(ESP8266_REQUEST* request, int32_t value, uint8_t decimals);
+
+/**
+ * @brief add everything after the URI of a HTTP request: the version, the headers and the blank line.
+ * 		  The method and the URI should be added before this, and the body after it.
+ * @param ESP8266_REQUEST* request
+ * @param const char* host, host adress for the request, EXAMPLE: google.com
+ * @param bool keep_alive, true to ask the server to keep the connection open
+ * @param const char* content_type, type of the body, NULL if there is no body
+ * @param uint16_t content_length, length of the body
+ * @return bool, false if the request is full
+ */
+bool
+esp8266_request_http_headers(ESP8266_REQUEST* request, const char* host, bool keep_alive,
+							 const char* content_type, uint16_t content_length);
+
+/**
+ * @brief send a request on an open connection, like esp8266_send_large_data. The length is known up
+ * 		  front, so the segments are streamed to the ESP8266 after each AT+CIPSEND prompt.
+ * @param const ESP8266_REQUEST* request
+ * @return const char*, ESP8266 response string, either "SEND OK", "CLOSED" or "ERROR"
+ */
+const char*
+esp8266_send_request(const ESP8266_REQUEST* request);
+
+/**
+ * @brief send a request in passthrough mode, like esp8266_passthrough_send.
+ * @param const ESP8266_REQUEST* request
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_passthrough_send_request(const ESP8266_REQUEST* request);
+
 /**
  * @brief start RX interrupt for UART4
  * @param void
@@ -277,7 +553,9 @@ void
 HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
 
 /**
- * @brief send command to ESP8266
+ * @brief send command to ESP8266. If the ESP8266 does not answer within ESP8266_COMMAND_TIMEOUT ms
+ * 		  the command is treated as failed, ESP8266_CONNECT_TIMEOUT for AT+CIPSTART and AT+CIPDOMAIN and
+ * 		  ESP8266_JOIN_TIMEOUT for AT+CWJAP and AT+RST.
  * @param char* command to send
  * @return const char*, ESP8266 response string
  *
@@ -290,27 +568,285 @@ esp8266_send_command(const char*);
 /**
  * @brief send data to ESP8266, this is used after calling cipsend
  * where the length of the data that will be sent has been specified.
+ * Waits for the server to close the connection.
  * @param char* data to send
- * @return const char*, ESP8266 response string
+ * @return const char*, ESP8266 response string, "CLOSED" or "ERROR" if the connection
+ * 		   was not closed within ESP8266_RESPONSE_TIMEOUT ms
  */
 const char*
 esp8266_send_data(const char*);
 
+/**
+ * @brief send data on a connection that is kept alive, this is used after calling cipsend.
+ * 		  Waits for SEND OK and the response from the server, but not for the connection to close.
+ * @param char* data to send
+ * @return const char*, ESP8266 response string.
+ * Possible return strings:
+ * 							"SEND OK", the server answered and the connection is still open
+ * 							"CLOSED", the server answered (or not) and closed the connection
+ * 							"ERROR", the data was not sent or the server did not answer in time
+ */
+const char*
+esp8266_send_data_keep_alive(const char*);
+
+/**
+ * @brief wait for the server to answer a request that was sent on a connection that is kept alive.
+ * 		  If a response is being parsed, see esp8266_response_start, it waits for the whole response
+ * 		  instead of the first +IPD message.
+ * @param void
+ * @return const char*, ESP8266 response string.
+ * Possible return strings:
+ * 							"SEND OK", the server answered and the connection is still open
+ * 							"CLOSED", the server answered (or not) and closed the connection
+ * 							"ERROR", the server did not answer in time
+ */
+const char*
+esp8266_wait_response(void);
+
+/**
+ * @brief start parsing the server response. The data of every +IPD message, or every byte in
+ * 		  passthrough mode, is fed to the parser from the uart interrupt until esp8266_response_stop,
+ * 		  so the response does not have to fit in the rx buffer. Call before the request is sent.
+ * @param HTTP_RESPONSE* response, where the response is parsed, has to stay valid until esp8266_response_stop
+ * @return None
+ */
+void
+esp8266_response_start(HTTP_RESPONSE* response);
+
+/**
+ * @brief stop parsing the server response. A response that ended with the connection
+ * 		  being closed is finished here.
+ * @param void
+ * @return None
+ */
+void
+esp8266_response_stop(void);
+
+/**
+ * @brief send data of any length on an open connection. The data is split into chunks of at most
+ * 		  ESP8266_CIPSEND_MAX bytes, each chunk is sent with its own AT+CIPSEND after the > prompt, and
+ * 		  the next chunk is only sent once the ESP8266 has answered SEND OK. Does not wait for the server response,
+ * 		  use esp8266_wait_response for that.
+ * @param const char* data, data to send
+ * @param uint16_t len, length of the data
+ * @return const char*, ESP8266 response string, either "SEND OK", "CLOSED" or "ERROR"
+ */
+const char*
+esp8266_send_large_data(const char* data, uint16_t len);
+
+/**
+ * @brief switch the current connection to passthrough mode (AT+CIPMODE=1 followed by AT+CIPSEND).
+ * 		  A connection needs to be started with AT+CIPSTART before this.
+ * @param void
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_passthrough_start(void);
+
+/**
+ * @brief send data in passthrough mode, the data goes straight to the socket without any
+ * 		  AT+CIPSEND, > or SEND OK. Anything the server sends back ends up as is in the rx buffer,
+ * 		  which is cleared before sending.
+ * @param const char* data, data to send
+ * @param uint16_t len, length of the data
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR" if passthrough mode is not started
+ */
+const char*
+esp8266_passthrough_send(const char* data, uint16_t len);
+
+/**
+ * @brief leave passthrough mode with +++ and go back to normal mode (AT+CIPMODE=0).
+ * 		  The connection is left open. Blocks for 2 * ESP8266_ESCAPE_GUARD ms.
+ * @param void
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_passthrough_stop(void);
+
+/**
+ * @brief check if passthrough mode is started
+ * @param void
+ * @return bool, true if the ESP8266 is in passthrough mode
+ */
+bool
+esp8266_passthrough_active(void);
+
+/**
+ * @brief read the data of the next +IPD message, binary data is allowed. The rx buffer
+ * 		  is cleared after reading.
+ * @param uint8_t* buffer, where the received data is stored
+ * @param uint16_t size, size of the buffer, longer messages are cut off
+ * @param uint32_t timeout, max time to wait for a message in ms
+ * @return uint16_t, number of bytes stored in the buffer, 0 on timeout or if the connection was closed
+ */
+uint16_t
+esp8266_receive(uint8_t* buffer, uint16_t size, uint32_t timeout);
+
+/**
+ * @brief query the status of the current connection with AT+CIPSTATUS
+ * @param void
+ * @return const char*, ESP8266 response string, either "CONNECT", "CLOSED" or "ERROR"
+ */
+const char*
+esp8266_connection_status(void);
+
+/**
+ * @brief check if the ESP8266 has reported that the connection was closed, for example
+ * 		  by the server, since the last connection was started. Does not send any command.
+ * @param void
+ * @return bool, true if the connection has been closed
+ */
+bool
+esp8266_link_closed(void);
+
+/**
+ * @brief check if the last command sent with esp8266_send_command timed out, which tells a module
+ * 		  that does not answer apart from one that answers ERROR.
+ * @param void
+ * @return bool, true if there was no OK or ERROR within the timeout
+ */
+bool
+esp8266_command_timed_out(void);
+
+/**
+ * @brief look up the ip address of a host with AT+CIPDOMAIN
+ * @param const char* host, host name to look up, EXAMPLE: google.com
+ * @param char* ip, where the address is stored, at least ESP8266_IP_SIZE bytes
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_resolve(const char* host, char* ip);
+
+/**
+ * @brief get the address to connect to for a host. The address is looked up once and then
+ * 		  used for ESP8266_DNS_TTL ms, or until esp8266_dns_invalidate is called.
+ * 		  Only the last host looked up is remembered.
+ * @param const char* host, host name, an ip address is returned as is
+ * @return const char*, the ip address, or the host name if it could not be looked up,
+ * 		   so that AT+CIPSTART can still try to look it up by itself
+ */
+const char*
+esp8266_dns_lookup(const char* host);
+
+/**
+ * @brief forget the cached address, call this when connecting to it fails
+ * @param void
+ * @return void
+ */
+void
+esp8266_dns_invalidate(void);
+
+/**
+ * @brief wait for a string to show up in the rx buffer
+ * @param const char* token, string to wait for
+ * @param uint32_t timeout, max time to wait in ms
+ * @return bool, true if the string was received, false on timeout
+ */
+bool
+esp8266_wait_for(const char* token, uint32_t timeout);
+
+/**
+ * @brief change the baud rate of the ESP8266 and UART4 with AT+UART_CUR, then verify the link with AT.
+ * 		  If the ESP8266 does not answer at the new rate, it is told to go back to the old rate and
+ * 		  UART4 is switched back as well.
+ * @param uint32_t baud_rate, new baud rate
+ * @param bool flow_control, true to use RTS on PA15, see ESP8266_FLOW_CONTROL
+ * @return const char*, ESP8266 response string.
+ * Possible return strings:
+ * 							"OK", the new rate is in use
+ * 							"ERROR", the rate was not changed, the old rate is still in use
+ * 							"FAIL", the ESP8266 does not answer at either rate
+ */
+const char*
+esp8266_set_baud_rate(uint32_t baud_rate, bool flow_control);
+
+/**
+ * @brief move the ESP8266 to the highest rate that works, starting at ESP8266_MAX_BAUD_RATE
+ * 		  and halving it down to ESP8266_DEFAULT_BAUD_RATE.
+ * @param void
+ * @return uint32_t, the baud rate in use, 0 if the ESP8266 stopped answering
+ */
+uint32_t
+esp8266_negotiate_baud_rate(void);
+
+/**
+ * @brief get the baud rate currently used for the ESP8266
+ * @param void
+ * @return uint32_t, baud rate
+ */
+uint32_t
+esp8266_baud_rate(void);
+
+/**
+ * @brief put the ESP8266 to sleep. Light sleep also configures ESP8266_WAKE_GPIO as wake up source.
+ * 		  Deep sleep drops the current connection, esp8266_link_closed returns true afterwards.
+ * 		  Fails in passthrough mode, where the command would be sent to the server, stop it first.
+ * @param ESP8266_SLEEP_MODE mode, sleep mode to enter
+ * @param uint32_t time, max ms to sleep, only used for deep sleep
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_sleep(ESP8266_SLEEP_MODE mode, uint32_t time);
+
+/**
+ * @brief start waking the ESP8266, does not wait for it. For light sleep the wake pin is pulled low,
+ * 		  for deep sleep the module is reset, and can then boot while the caller does other work.
+ * @param void
+ * @return void
+ */
+void
+esp8266_wake_start(void);
+
+/**
+ * @brief wait for the ESP8266 to wake up after esp8266_wake_start, and disable sleep.
+ * 		  After deep sleep the module is configured again like in esp8266_init, and wifi is
+ * 		  joined again if the module did not reconnect by itself. Fails in passthrough mode.
+ * @param void
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_wake_finish(void);
+
+/**
+ * @brief get the sleep mode the ESP8266 is in
+ * @param void
+ * @return ESP8266_SLEEP_MODE, ESP8266_SLEEP_NONE if the module is awake
+ */
+ESP8266_SLEEP_MODE
+esp8266_sleep_mode(void);
+
 /**
  * @brief initiate the ESP8266, performs all necessary commands to start using the
  * 		  device. It also verifies that the settings were set.
+ * 		  The module is only reset if it is not connected to wifi, so that a restart of
+ * 		  the L476 alone does not drop the wifi connection.
  * 		  Settings are: station mode (cwmode=1), single connection mode (cipmux=0)
+ * 		  and the highest working baud rate, see esp8266_negotiate_baud_rate.
  * @param void
  * @return const char*, ESP8266 response string, either "OK" or "ERROR"
  */
 const char*
 esp8266_init(void);
 
+/**
+ * @brief restart the ESP8266 and configure it again like esp8266_init. A reset pulse is sent on
+ * 		  ESP_RST_Pin, if the module does not restart from that (the pin is not wired) AT+RST is sent.
+ * 		  Meant for getting a module that has stopped working back, the wifi connection is dropped.
+ * @param void
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_reset(void);
+
 /**
  * @brief initiate a wifi connection, uses the esp8266_get_wifi_command function, so make sure
  * 		  that SSID and PWD variables are present and correct.
  * @param void
  * @return const char*, ESP8266 response string.
+ * 		  Nothing is done if the module is still connected. Otherwise the static ip is set if
+ * 		  ESP8266_STATIC_IP is defined, and the AP is joined by its BSSID if it is known.
+ * 		  If joining by BSSID fails the BSSID is forgotten and a normal join is made.
+ * 		  A learnt BSSID is kept in RAM only and is lost on reset, unless ESP8266_BSSID is defined.
  * Possible return strings:
  * 		 					"WIFI CONNECTED"
  *	 						"wrong password"
@@ -321,6 +857,14 @@ esp8266_init(void);
 const char*
 esp8266_wifi_init(void);
 
+/**
+ * @brief get the BSSID of the AP that is joined by esp8266_wifi_init
+ * @param void
+ * @return const char*, the BSSID, empty if it is not known yet
+ */
+const char*
+esp8266_wifi_bssid(void);
+
 /**
  * @brief get hash number for string. The hash number corresponds to a
  * 		  specific command. This is used to determine the possible return values for the command
@@ -357,3 +901,4 @@ get_return(const char*);
 void
 esp8266_clear(void);
 
+#endif /* INC_ESP8266_H_ */
@@ -0,0 +1,135 @@
+/**
+******************************************************************************
+@brief header for the CBOR encoding of sensor readings
+@details A small subset of CBOR (RFC 8949), enough to send sensor readings in
+		 a compact binary form instead of a query string or csv. Only unsigned
+		 and negative integers and arrays are used, so no floats are formatted
+		 and the encoder is a few shifts per value.
+
+		 Temperature and humidity are sent as fixed point integers in
+		 hundredths, 21.37 C is sent as 2137. Timestamps in a batch are sent as
+		 the difference to the previous sample, which fits in 2 or 3 bytes
+		 instead of the 5 bytes of a full tick.
+
+		 Reading:	[co2, tvoc, temperature, humidity]
+		 Batch:		[now, first timestamp, [[delta, co2, tvoc, temperature, humidity], ...]]
+
+		 The delta of the first sample in a batch is 0. Only the encoder is
+		 built into the firmware, the decoder that checks what the device
+		 sends is part of the host tests, in Host/Src/cbor_reader.c.
+
+		 Usage:
+		 CBOR_WRITER writer;
+		 cbor_writer_init(&writer, buffer, sizeof(buffer));
+		 cbor_put_reading(&writer, co2, tvoc, temperature, humidity);
+		 if(!writer.overflow)
+			send(buffer, writer.len);
+
+@file cbor.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_CBOR_H_
+#define INC_CBOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CBOR_FIXED_SCALE		100		// temperature and humidity are sent in hundredths
+#define CBOR_READING_SIZE		4		// values in a reading
+#define CBOR_SAMPLE_SIZE		5		// values in a batch sample, the delta and a reading
+#define CBOR_BATCH_SIZE			3		// items in a batch, now, first timestamp and the samples
+
+/* CBOR major types, upper 3 bits of the initial byte */
+#define CBOR_UINT				0x00
+#define CBOR_NEGINT				0x20
+#define CBOR_ARRAY				0x80
+
+/* Additional information values for arguments that follow the initial byte */
+#define CBOR_ARG_8				24
+#define CBOR_ARG_16				25
+#define CBOR_ARG_32				26
+
+/* Encoder state, the encoded data is written to buffer */
+typedef struct
+{
+	uint8_t* buffer;
+	uint16_t size;					// size of the buffer
+	uint16_t len;					// bytes written
+	bool	 overflow;				// set when something did not fit, nothing more is written after that
+} CBOR_WRITER;
+
+/**
+ * @brief start encoding into a buffer.
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint8_t* buffer, where the encoded data is stored
+ * @param uint16_t size, size of the buffer
+ * @return None
+ */
+void cbor_writer_init(CBOR_WRITER* writer, uint8_t* buffer, uint16_t size);
+
+/**
+ * @brief encode an unsigned integer, in 1, 2, 3 or 5 bytes depending on the value.
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint32_t value, the value to encode
+ * @return None
+ */
+void cbor_put_uint(CBOR_WRITER* writer, uint32_t value);
+
+/**
+ * @brief encode a signed integer, negative values use the negative integer type.
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param int32_t value, the value to encode
+ * @return None
+ */
+void cbor_put_int(CBOR_WRITER* writer, int32_t value);
+
+/**
+ * @brief encode the header of an array, the items are encoded after it.
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint16_t count, number of items in the array
+ * @return None
+ */
+void cbor_put_array(CBOR_WRITER* writer, uint16_t count);
+
+/**
+ * @brief convert a value to fixed point with CBOR_FIXED_SCALE, rounded to the nearest step.
+ * @param float value, the value to convert
+ * @return int32_t, the fixed point value
+ */
+int32_t cbor_fixed(float value);
+
+/**
+ * @brief encode one reading, [co2, tvoc, temperature, humidity].
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint16_t co2, carbon dioxide in ppm
+ * @param uint16_t tvoc, volatile organic compounds in ppb
+ * @param float temperature, in degrees celsius
+ * @param float humidity, relative humidity in percent
+ * @return None
+ */
+void cbor_put_reading(CBOR_WRITER* writer, uint16_t co2, uint16_t tvoc, float temperature, float humidity);
+
+/**
+ * @brief encode the start of a batch, the samples are added with cbor_put_sample.
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint32_t now, current tick, lets the receiver turn the timestamps into wall clock time
+ * @param uint32_t first, timestamp of the first sample
+ * @param uint16_t count, number of samples that will be added
+ * @return None
+ */
+void cbor_put_batch(CBOR_WRITER* writer, uint32_t now, uint32_t first, uint16_t count);
+
+/**
+ * @brief encode one sample of a batch, [delta, co2, tvoc, temperature, humidity].
+ * @param CBOR_WRITER* writer, the encoder state
+ * @param uint32_t delta, ms since the previous sample, 0 for the first sample
+ * @param uint16_t co2, carbon dioxide in ppm
+ * @param uint16_t tvoc, volatile organic compounds in ppb
+ * @param float temperature, in degrees celsius
+ * @param float humidity, relative humidity in percent
+ * @return None
+ */
+void cbor_put_sample(CBOR_WRITER* writer, uint32_t delta, uint16_t co2, uint16_t tvoc, float temperature, float humidity);
+
+#endif /* INC_CBOR_H_ */
@@ -0,0 +1,72 @@
+/**
+******************************************************************************
+@brief header for text fields at fixed places on the display
+@details A field is a fixed number of char cells at a fixed place, in one of
+		 the fonts of fonts.h. It keeps the text it last drew, and when it is
+		 given a new text only the cells whose char changed are drawn. A
+		 reading that goes from 612 to 613 ppm draws one char, and only its
+		 columns are sent by the next display_update.
+
+		 The fields know when reset_screen_canvas has cleared the display and
+		 then draw all their cells again. Labels that never change are fields
+		 too, they are drawn once after every clear and cost a compare after
+		 that.
+
+		 Usage:
+		 static DISPLAY_FIELD co2;
+		 display_field_init(&co2, 29, 16, FONT_LARGE, 5);
+		 ...
+		 snprintf(text, sizeof(text), "%5u", reading);
+		 display_field_set(&co2, text);
+		 display_update();
+
+@file display_field.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_DISPLAY_FIELD_H_
+#define INC_DISPLAY_FIELD_H_
+
+#include <stdint.h>
+#include "ssd1306.h"
+
+#define DISPLAY_FIELD_SIZE		18		// max chars of a field, a line of the small font
+
+/* A field and what it shows */
+typedef struct
+{
+	uint16_t x;						// top left corner of the first cell
+	uint16_t y;
+	FontId	 font;
+	uint8_t	 size;					// cells, shorter texts are padded with spaces
+	uint16_t canvas;				// display_get_canvas when the cells were drawn
+	char	 text[DISPLAY_FIELD_SIZE + 1];	// what the cells show, zero terminated
+} DISPLAY_FIELD;
+
+/**
+ * @brief set up a field, it is drawn by the first display_field_set.
+ * @param DISPLAY_FIELD* field
+ * @param uint16_t x, left of the first cell
+ * @param uint16_t y, top of the cells, fastest on a multiple of 8 where every cell is whole bytes of the display
+ * @param FontId font
+ * @param uint8_t size, cells, at most DISPLAY_FIELD_SIZE
+ * @return None
+ */
+void display_field_init(DISPLAY_FIELD* field, uint16_t x, uint16_t y, FontId font, uint8_t size);
+
+/**
+ * @brief show a text in the field, only the cells that change are drawn to the buffer of the display.
+ * @param DISPLAY_FIELD* field
+ * @param const char* text, padded with spaces or cut to the size of the field
+ * @return uint8_t, the cells that were drawn
+ */
+uint8_t display_field_set(DISPLAY_FIELD* field, const char* text);
+
+/**
+ * @brief draw every cell of the field at the next display_field_set, e.g. after something else was drawn over it.
+ * @param DISPLAY_FIELD* field
+ * @return None
+ */
+void display_field_invalidate(DISPLAY_FIELD* field);
+
+#endif /* INC_DISPLAY_FIELD_H_ */
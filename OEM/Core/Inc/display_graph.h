@@ -0,0 +1,99 @@
+/**
+******************************************************************************
+@brief header for history graphs on the display
+@details A graph keeps the last values given to it in a ring and plots them
+		 one column each, the newest on the right, as a line or as bars.
+		 The labels left of the plot show the top and the bottom of the
+		 scale, which follows the values: it is the smallest and largest
+		 value kept, rounded out to a multiple of step.
+
+		 Values are only stored by display_graph_add. display_graph_draw
+		 moves the plot left by the columns added since the last draw and
+		 draws the new ones, so the drawing per value is the same however
+		 much is kept. The whole plot is drawn again when the scale changes,
+		 after reset_screen_canvas and when more values than columns came
+		 in since the last draw.
+
+		 Usage:
+		 static DISPLAY_GRAPH co2;
+		 display_graph_init(&co2, 32, 0, 96, 32, DISPLAY_GRAPH_LINE, 100, 1);
+		 ...
+		 display_graph_add(&co2, reading);		// e.g. once a minute
+		 display_graph_draw(&co2);				// while the graph is shown
+		 display_update();
+
+@file display_graph.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_DISPLAY_GRAPH_H_
+#define INC_DISPLAY_GRAPH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssd1306.h"
+#include "display_field.h"
+
+#define DISPLAY_GRAPH_SIZE			W		// max values kept, one per column
+#define DISPLAY_GRAPH_LABEL_SIZE	4		// chars of the scale labels
+#define DISPLAY_GRAPH_LABEL_WIDTH	(DISPLAY_GRAPH_LABEL_SIZE * 7 + 3)	// columns left of the plot taken by the labels
+
+typedef enum
+{
+	DISPLAY_GRAPH_LINE,				// a line from each value to the next
+	DISPLAY_GRAPH_BARS				// a bar from the bottom up to each value
+} DISPLAY_GRAPH_STYLE;
+
+/* A graph, its values and the scale it was drawn with */
+typedef struct
+{
+	uint8_t	 x;						// plot area, the labels are left of it
+	uint8_t	 y;						// multiple of 8, the plot is moved a page at a time
+	uint8_t	 width;
+	uint8_t	 height;				// at least 2 rows of the small font for the labels
+	DISPLAY_GRAPH_STYLE style;
+	int16_t	 step;					// the scale goes from and to multiples of this
+	int16_t	 divisor;				// values per unit shown by the labels, e.g. 10 for tenths
+	int16_t	 values[DISPLAY_GRAPH_SIZE];	// ring of values, oldest at head when full
+	uint8_t	 head;					// where the next value goes
+	uint8_t	 count;					// values kept
+	uint8_t	 added;					// values added since the last draw
+	int16_t	 min;					// scale of the drawn plot
+	int16_t	 max;
+	uint16_t canvas;				// display_get_canvas when the plot was drawn
+	bool	 drawn;
+	DISPLAY_FIELD max_label;
+	DISPLAY_FIELD min_label;
+} DISPLAY_GRAPH;
+
+/**
+ * @brief set up an empty graph.
+ * @param DISPLAY_GRAPH* graph
+ * @param uint8_t x, left column of the plot, at least DISPLAY_GRAPH_LABEL_WIDTH
+ * @param uint8_t y, top row of the plot, a multiple of 8
+ * @param uint8_t width, columns of the plot and values shown, at most DISPLAY_GRAPH_SIZE
+ * @param uint8_t height, rows of the plot, a multiple of 8
+ * @param DISPLAY_GRAPH_STYLE style
+ * @param int16_t step, the scale is rounded out to multiples of it, larger steps change the scale less often
+ * @param int16_t divisor, values per unit of the labels
+ * @return None
+ */
+void display_graph_init(DISPLAY_GRAPH* graph, uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+						DISPLAY_GRAPH_STYLE style, int16_t step, int16_t divisor);
+
+/**
+ * @brief keep a value, the oldest one goes when the graph is full. Nothing is drawn.
+ * @param DISPLAY_GRAPH* graph
+ * @param int16_t value
+ * @return None
+ */
+void display_graph_add(DISPLAY_GRAPH* graph, int16_t value);
+
+/**
+ * @brief bring the graph on the buffer of the display up to date with the values kept.
+ * @param DISPLAY_GRAPH* graph
+ * @return uint8_t, the columns that were drawn
+ */
+uint8_t display_graph_draw(DISPLAY_GRAPH* graph);
+
+#endif /* INC_DISPLAY_GRAPH_H_ */
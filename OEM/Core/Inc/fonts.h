@@ -10,11 +10,31 @@ typedef struct {
     const uint8_t FontWidth;    /* Font width in pixels */
     uint8_t FontHeight;         /* Font height in pixels */
     const uint16_t *data;       /* Pointer to data font data array */
+    const uint8_t *columns;     /* The same glyphs in display order: page by page, one byte per column, top row in bit 0 */
+    char FirstChar;             /* First char of the font, the glyphs go from here to LastChar */
+    char LastChar;
+    uint8_t RowSize;            /* Pixels from one line of text to the next */
 } FontDef;
 
 //
-//  Export the 3 available fonts
+//  The fonts by size, FONT_LARGE only has ' ' to '9', enough for readings
+//
+typedef enum {
+    FONT_SMALL,
+    FONT_LARGE,
+    FONT_COUNT
+} FontId;
+
+//
+//  Pages of 8 rows a glyph takes in the columns array
+//
+#define FONT_PAGES(font) (((font).FontHeight + 7) / 8)
+
+//
+//  Export the available fonts
 //
 extern FontDef Font_7x10;
+extern FontDef Font_14x20;
+extern FontDef* const Fonts[FONT_COUNT];
 
 #endif  // _FONTS_H
@@ -38,6 +38,7 @@ extern "C" {
 void MX_GPIO_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void esp8266_gpio_init(void);
 
 /* USER CODE END Prototypes */
 
@@ -0,0 +1,118 @@
+/**
+******************************************************************************
+@brief header for the streaming HTTP response parser
+@details Parses a HTTP/1.1 response one byte at a time, so it can be fed from
+		 the uart receive interrupt as the bytes arrive, without keeping the
+		 whole response around. The status code, Content-Length and
+		 Connection headers are kept, and the first HTTP_BODY_SIZE bytes of
+		 the body. Bodies sent with Transfer-Encoding: chunked are decoded.
+
+		 The response is complete when Content-Length bytes of body have been
+		 received, after the last chunk, or when http_response_finish is called
+		 because the server closed the connection.
+
+		 The body is expected to be small, settings from the server are sent
+		 as a form, e.g. interval=60&batch=20, and read with http_form_value.
+
+		 Usage:
+		 HTTP_RESPONSE response;
+		 http_response_init(&response);
+		 for each received byte: http_response_feed(&response, byte);
+		 if(response.state == HTTP_PARSE_DONE && HTTP_SUCCESS(response.status))
+			http_form_value(response.body, "interval", &value);
+
+@file http.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_HTTP_H_
+#define INC_HTTP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_LINE_SIZE			64		// status and header lines are cut to this length, only the start of a line is needed
+#define HTTP_BODY_SIZE			128		// bytes of the body that are kept, the rest is counted but not stored
+
+#define HTTP_SUCCESS(status)		((status) >= 200 && (status) < 300)
+#define HTTP_CLIENT_ERROR(status)	((status) >= 400 && (status) < 500)
+
+/* Parser states, HTTP_PARSE_DONE and HTTP_PARSE_ERROR are final */
+typedef enum
+{
+	HTTP_PARSE_STATUS = 0,			// reading the status line
+	HTTP_PARSE_HEADERS,				// reading header lines
+	HTTP_PARSE_BODY,				// reading a body with Content-Length, or until the connection closes
+	HTTP_PARSE_CHUNK_SIZE,			// reading the size line of a chunk
+	HTTP_PARSE_CHUNK_DATA,			// reading the data of a chunk
+	HTTP_PARSE_CHUNK_END,			// reading the line end after the data of a chunk
+	HTTP_PARSE_TRAILER,				// reading the lines after the last chunk
+	HTTP_PARSE_DONE,				// the whole response has been received
+	HTTP_PARSE_ERROR				// the response is not valid HTTP
+} HTTP_PARSE_STATE;
+
+/* One response, filled in by http_response_feed */
+typedef struct
+{
+	volatile HTTP_PARSE_STATE state;	// written from the uart interrupt
+	uint16_t status;				// status code, 0 until the status line has been read
+	int32_t	 content_length;		// -1 if the response has no Content-Length
+	bool	 chunked;				// Transfer-Encoding: chunked
+	bool	 connection_close;		// Connection: close, the server closes the connection after the response
+	uint32_t remaining;				// bytes left of the body or the current chunk
+	char	 line[HTTP_LINE_SIZE];	// the line being read
+	uint8_t	 line_len;
+	char	 body[HTTP_BODY_SIZE + 1];	// start of the body, zero terminated
+	uint16_t body_len;				// bytes stored in body
+	uint32_t body_received;			// bytes of body received, including the ones not stored
+} HTTP_RESPONSE;
+
+/**
+ * @brief reset a response before a new request is sent.
+ * @param HTTP_RESPONSE* response, the response to reset
+ * @return None
+ */
+void http_response_init(HTTP_RESPONSE* response);
+
+/**
+ * @brief parse one received byte.
+ * @param HTTP_RESPONSE* response, the response being parsed
+ * @param char c, the received byte
+ * @return HTTP_PARSE_STATE, the state after the byte
+ */
+HTTP_PARSE_STATE http_response_feed(HTTP_RESPONSE* response, char c);
+
+/**
+ * @brief parse a block of received bytes.
+ * @param HTTP_RESPONSE* response, the response being parsed
+ * @param const char* data, the received bytes
+ * @param uint16_t len, number of bytes
+ * @return HTTP_PARSE_STATE, the state after the last byte
+ */
+HTTP_PARSE_STATE http_response_feed_data(HTTP_RESPONSE* response, const char* data, uint16_t len);
+
+/**
+ * @brief end the response when the connection has been closed. A body without
+ * 		  Content-Length ends here, anything else that is not complete is an error.
+ * @param HTTP_RESPONSE* response, the response being parsed
+ * @return HTTP_PARSE_STATE, HTTP_PARSE_DONE or HTTP_PARSE_ERROR
+ */
+HTTP_PARSE_STATE http_response_finish(HTTP_RESPONSE* response);
+
+/**
+ * @brief check if the response is complete, or could not be parsed.
+ * @param const HTTP_RESPONSE* response, the response being parsed
+ * @return bool, true if nothing more will be parsed
+ */
+bool http_response_done(const HTTP_RESPONSE* response);
+
+/**
+ * @brief read a number from a form encoded body, key=value pairs separated by & or line breaks.
+ * @param const char* body, zero terminated body
+ * @param const char* key, name of the value
+ * @param int32_t* value, where the value is stored
+ * @return bool, false if the key is missing or the value is not a number
+ */
+bool http_form_value(const char* body, const char* key, int32_t* value);
+
+#endif /* INC_HTTP_H_ */
@@ -36,7 +36,7 @@ extern I2C_HandleTypeDef hi2c2;
 extern I2C_HandleTypeDef hi2c3;
 
 /* USER CODE BEGIN Private defines */
-
+extern DMA_HandleTypeDef hdma_i2c2_tx;
 /* USER CODE END Private defines */
 
 void MX_I2C1_Init(void);
@@ -59,6 +59,10 @@ void Error_Handler(void);
 
 /* Private defines -----------------------------------------------------------*/
 /* USER CODE BEGIN Private defines */
+#define ESP_WAKE_Pin GPIO_PIN_4
+#define ESP_WAKE_GPIO_Port GPIOA
+#define ESP_RST_Pin GPIO_PIN_0
+#define ESP_RST_GPIO_Port GPIOB
 
 /* USER CODE END Private defines */
 
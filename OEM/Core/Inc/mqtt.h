@@ -0,0 +1,152 @@
+/**
+******************************************************************************
+@brief header for the MQTT 3.1.1 client
+@details A minimal MQTT client that publishes over the TCP connection of the
+		 ESP8266. Only what is needed to publish sensor readings is implemented:
+		 CONNECT, PUBLISH with QoS 0 or 1, PINGREQ and DISCONNECT.
+
+		 Packets are encoded into a static buffer and sent with the AT+CIPSEND
+		 functions in ESP8266.c, so a TCP connection to the broker needs to be
+		 started (AT+CIPSTART) before calling mqtt_connect. The encode functions
+		 do not use the ESP8266 and can be used on their own.
+
+		 Usage:
+		 esp8266_get_connection_command(command, "TCP", broker, "1883");
+		 esp8266_send_command(command);
+		 mqtt_connect("client-id");
+		 mqtt_publish("some/topic", payload, strlen(payload), 1);
+		 mqtt_disconnect();
+
+@file mqtt.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_MQTT_H_
+#define INC_MQTT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MQTT_BUFFER_SIZE		2048	// max size of one encoded packet
+#define MQTT_KEEP_ALIVE			60		// seconds the broker waits for a packet before dropping the client
+#define MQTT_ACK_TIMEOUT		5000	// ms to wait for CONNACK, PUBACK and PINGRESP
+
+/* MQTT control packet types, upper 4 bits of the fixed header */
+#define MQTT_CONNECT			0x10
+#define MQTT_CONNACK			0x20
+#define MQTT_PUBLISH			0x30
+#define MQTT_PUBACK				0x40
+#define MQTT_PINGREQ			0xC0
+#define MQTT_PINGRESP			0xD0
+#define MQTT_DISCONNECT			0xE0
+
+/* MQTT return codes */
+typedef enum
+{
+	MQTT_SUCCESS = 0,
+	MQTT_ERROR,				// the packet could not be sent
+	MQTT_BUFFER_OVERFLOW,	// the packet does not fit in MQTT_BUFFER_SIZE
+	MQTT_NO_ACK,			// no or wrong acknowledgement from the broker
+	MQTT_REFUSED			// the broker refused the connection
+} MQTT_STATUS;
+
+/**
+ * @brief encode a CONNECT packet with a clean session and no will, username or password.
+ * @param uint8_t* buffer, where the packet is stored
+ * @param uint16_t size, size of the buffer
+ * @param const char* client_id, id of the client, should be unique for the broker
+ * @param uint16_t keep_alive, keep alive interval in seconds
+ * @return uint16_t, length of the packet, 0 if it does not fit in the buffer
+ */
+uint16_t
+mqtt_encode_connect(uint8_t* buffer, uint16_t size, const char* client_id, uint16_t keep_alive);
+
+/**
+ * @brief encode a PUBLISH packet
+ * @param uint8_t* buffer, where the packet is stored
+ * @param uint16_t size, size of the buffer
+ * @param const char* topic, topic to publish to
+ * @param const uint8_t* payload, application message
+ * @param uint16_t payload_len, length of the message
+ * @param uint8_t qos, quality of service, 0 or 1
+ * @param uint16_t packet_id, packet identifier, only used for qos 1
+ * @return uint16_t, length of the packet, 0 if it does not fit in the buffer
+ */
+uint16_t
+mqtt_encode_publish(uint8_t* buffer, uint16_t size, const char* topic, const uint8_t* payload,
+					uint16_t payload_len, uint8_t qos, uint16_t packet_id);
+
+/**
+ * @brief encode a packet that only has a fixed header, such as PINGREQ or DISCONNECT
+ * @param uint8_t* buffer, where the packet is stored
+ * @param uint16_t size, size of the buffer
+ * @param uint8_t type, packet type, MQTT_PINGREQ or MQTT_DISCONNECT
+ * @return uint16_t, length of the packet, 0 if it does not fit in the buffer
+ */
+uint16_t
+mqtt_encode_empty(uint8_t* buffer, uint16_t size, uint8_t type);
+
+/**
+ * @brief check that a packet received from the broker is the expected acknowledgement
+ * @param const uint8_t* packet, the received packet
+ * @param uint16_t len, length of the received packet
+ * @param uint8_t type, expected packet type, MQTT_CONNACK, MQTT_PUBACK or MQTT_PINGRESP
+ * @param uint16_t packet_id, expected packet identifier, only used for MQTT_PUBACK
+ * @return MQTT_STATUS, either MQTT_SUCCESS, MQTT_REFUSED or MQTT_NO_ACK
+ */
+MQTT_STATUS
+mqtt_check_ack(const uint8_t* packet, uint16_t len, uint8_t type, uint16_t packet_id);
+
+/**
+ * @brief send CONNECT to the broker and wait for CONNACK
+ * @param const char* client_id, id of the client
+ * @return MQTT_STATUS, either MQTT_SUCCESS, MQTT_ERROR, MQTT_BUFFER_OVERFLOW, MQTT_REFUSED or MQTT_NO_ACK
+ */
+MQTT_STATUS
+mqtt_connect(const char* client_id);
+
+/**
+ * @brief publish a message, for qos 1 this waits for the PUBACK from the broker
+ * @param const char* topic, topic to publish to
+ * @param const char* payload, message to publish
+ * @param uint16_t payload_len, length of the message
+ * @param uint8_t qos, quality of service, 0 or 1
+ * @return MQTT_STATUS, either MQTT_SUCCESS, MQTT_ERROR, MQTT_BUFFER_OVERFLOW or MQTT_NO_ACK
+ */
+MQTT_STATUS
+mqtt_publish(const char* topic, const char* payload, uint16_t payload_len, uint8_t qos);
+
+/**
+ * @brief send PINGREQ and wait for PINGRESP
+ * @param void
+ * @return MQTT_STATUS, either MQTT_SUCCESS, MQTT_ERROR or MQTT_NO_ACK
+ */
+MQTT_STATUS
+mqtt_ping(void);
+
+/**
+ * @brief ping the broker if nothing has been sent for half the keep alive interval.
+ * 		  Should be called regularly while connected.
+ * @param void
+ * @return MQTT_STATUS, MQTT_SUCCESS if no ping was needed, else the result of mqtt_ping
+ */
+MQTT_STATUS
+mqtt_keep_alive(void);
+
+/**
+ * @brief send DISCONNECT, the broker closes the TCP connection after this
+ * @param void
+ * @return MQTT_STATUS, either MQTT_SUCCESS or MQTT_ERROR
+ */
+MQTT_STATUS
+mqtt_disconnect(void);
+
+/**
+ * @brief check if the client is connected to the broker
+ * @param void
+ * @return bool, true after a successful mqtt_connect, until mqtt_disconnect, a failed send or a missing acknowledgement
+ */
+bool
+mqtt_connected(void);
+
+#endif /* INC_MQTT_H_ */
@@ -14,6 +14,50 @@
 #include "ESP8266.h"
 #include "CCS811_BME280.h"
 #include "ssd1306.h"
+#include "display_field.h"
+#include "display_graph.h"
+#include "mqtt.h"
+#include "cbor.h"
+
+/* Upload transports, select the one to use with UPLOAD_TRANSPORT, or with -D when building */
+#define UPLOAD_TRANSPORT_HTTP				0	// http post, each request sent with AT+CIPSEND
+#define UPLOAD_TRANSPORT_HTTP_PASSTHROUGH	1	// http post, streamed to the socket in passthrough mode (AT+CIPMODE=1),
+												// fewer uart bytes but not faster, see ESP8266_AT_CIPMODE_PASSTHROUGH
+#define UPLOAD_TRANSPORT_MQTT				2	// mqtt publish to a broker, over one long lived connection,
+												// the broker is set in login.h with MQTT_BROKER_HOST
+#define UPLOAD_TRANSPORT_UDP				3	// binary udp datagrams to a collector, nothing is acknowledged
+#ifndef UPLOAD_TRANSPORT
+#define UPLOAD_TRANSPORT					UPLOAD_TRANSPORT_HTTP
+#endif
+#if UPLOAD_TRANSPORT < UPLOAD_TRANSPORT_HTTP || UPLOAD_TRANSPORT > UPLOAD_TRANSPORT_UDP
+#error "unknown UPLOAD_TRANSPORT"
+#endif
+
+/* Payload encodings, select the one to use with UPLOAD_ENCODING, or with -D. UPLOAD_TRANSPORT_UDP has its own format */
+#define UPLOAD_ENCODING_TEXT				0	// query string for a single reading, csv for a batch
+#define UPLOAD_ENCODING_CBOR				1	// cbor with fixed point values and delta timestamps, see cbor.h
+#ifndef UPLOAD_ENCODING
+#define UPLOAD_ENCODING						UPLOAD_ENCODING_TEXT
+#endif
+#if UPLOAD_ENCODING < UPLOAD_ENCODING_TEXT || UPLOAD_ENCODING > UPLOAD_ENCODING_CBOR
+#error "unknown UPLOAD_ENCODING"
+#endif
+
+/* CCS811 drive mode changes from the server, see apply_server_settings */
+#define CCS811_IDLE_TIME					600000	// ms in idle before a slower drive mode can be used
+#define CCS811_SLOWDOWN_INTERVAL			3600000	// ms from one idle period to the next, nothing is sampled while idle
+
+/* Upload recovery, see esp8266_upload_with_recovery */
+#define UPLOAD_RETRY_BASE					5000	// ms before the first retry, doubled for every failure
+#define UPLOAD_RETRY_MAX					600000	// longest wait between retries
+#define UPLOAD_REJOIN_AFTER					2		// failures in a row before checking the wifi association
+#define UPLOAD_RESET_AFTER					5		// failures in a row before restarting the esp8266
+
+#if UPLOAD_ENCODING == UPLOAD_ENCODING_CBOR
+#define UPLOAD_CONTENT_TYPE					"application/cbor"
+#else
+#define UPLOAD_CONTENT_TYPE					"text/csv"
+#endif
 
 /* Status codes */
 typedef enum
@@ -30,11 +74,54 @@ typedef enum
 	CCS811_START_ERROR,
 	CCS811_RUNNING_ERROR,
 	BME280_START_SUCCESS,
-	BME280_START_ERROR
+	BME280_START_ERROR,
+	ESP8266_WAKE_SUCCESS,
+	ESP8266_WAKE_ERROR,
+	ESP8266_UPLOAD_BACKOFF,
+	ESP8266_WEB_REQUEST_REJECTED
 	// Environment sensor status codes go here
 	// Distance sensor status codes go here
 } RETURN_STATUS;
 
+/* One reading from the environmental sensors, buffered until it is uploaded */
+typedef struct
+{
+	uint32_t timestamp;				// HAL_GetTick() when the sample was taken, ms since boot
+	uint16_t co2;
+	uint16_t tvoc;
+	float	 temperature;
+	float	 humidity;
+} SAMPLE;
+
+/* Upload statistics, used to compare the cost of the different ways of uploading */
+typedef struct
+{
+	uint32_t uploads;				// uploads that were sent successfully
+	uint32_t samples_sent;			// samples posted in those uploads
+	uint32_t samples_dropped;		// samples overwritten before they could be uploaded
+	uint32_t connections;			// tcp connections opened with AT+CIPSTART
+	uint32_t server_closes;			// connections that were closed by the server
+	uint32_t last_upload_time;		// ms spent on the last upload, including any reconnect
+	uint32_t total_upload_time;		// ms spent on all uploads
+	uint32_t failed_uploads;		// upload attempts that failed and were retried later
+	uint32_t wifi_rejoins;			// times wifi was joined again after failed uploads
+	uint32_t module_resets;			// times the esp8266 was restarted after failed uploads
+	uint32_t rejected_uploads;		// requests the server answered with a 4xx status, their samples are dropped
+	uint32_t settings_updates;		// answers that changed the interval, batch size or drive mode
+} UPLOAD_STATS;
+
+/* ESP8266 power statistics, a cycle runs from one time the module is put to sleep to the next */
+typedef struct
+{
+	uint32_t sleep_cycles;			// times the module was put to sleep between uploads
+	uint32_t last_wake_latency;		// ms from the start of the last wake up until the module answered
+	uint32_t max_wake_latency;		// longest wake up so far, used to decide how early to wake up
+	uint32_t last_wake_delay;		// ms the last upload had to wait for the module, 0 if it was woken up in time
+	uint32_t total_wake_delay;		// ms all uploads have had to wait for the module
+	uint32_t last_cycle_charge;		// estimated charge used by the module in the last cycle, uAh
+	uint32_t total_charge;			// estimated charge used by the module in all cycles, uAh
+} POWER_STATS;
+
 /**
  * @brief initiate the display
  * @param void
@@ -59,6 +146,31 @@ void display_getting_data_screen(void);
  */
 void show_measurements(float temp, float hum, uint16_t co2, uint16_t tVoc);
 
+/**
+ * @brief keeps a point of the CO2 and temperature history, at most one every HISTORY_INTERVAL ms
+ * @param float temp, the temperature
+ * @param uint16_t co2, the CO2 value
+ * @return void
+ */
+void store_history(float temp, uint16_t co2);
+
+/**
+ * @brief shows the CO2 and temperature history as graphs, only the columns of new points are drawn
+ * @param void
+ * @return void
+ */
+void show_history(void);
+
+/**
+ * @brief stores the history and shows the readings or the history, they take turns on the display
+ * @param float temp, the temperature
+ * @param float hum, the humidity
+ * @param uint16_t co2, the CO2 value
+ * @param uint16_t tVoc, the Tvoc value
+ * @return void
+ */
+void show_screen(float temp, float hum, uint16_t co2, uint16_t tVoc);
+
 /**
  * @brief main program
  * @param void
@@ -74,6 +186,13 @@ void office_environment_monitor(void);
  */
 void error_handler(void);
 
+/**
+ * @brief prints the message of an error to the display, what error_handler shows before it freezes
+ * @param RETURN_STATUS status, the error
+ * @return void
+ */
+void show_error(RETURN_STATUS status);
+
 /**
  * @brief initiates the esp8266. Enables interrupts for uart4 and checks the return status.
  * @param void
@@ -101,10 +220,88 @@ RETURN_STATUS esp8266_web_connection(void);
  * @param uint16_t tvoc, tVOC value
  * @param float temp, temperature value
  * @param float hum, humidity value
- * @return RETURN_STATUS, either ESP8266_WEB_REQUEST_ERROR or ESP8266_WEB_REQUEST_SUCCESS
+ * @return RETURN_STATUS, ESP8266_WEB_REQUEST_SUCCESS if the server answered with a 2xx status,
+ * 		   ESP8266_WEB_REQUEST_REJECTED for a 4xx status, otherwise ESP8266_WEB_REQUEST_ERROR
  */
 RETURN_STATUS esp8266_web_request(uint16_t co2, uint16_t tvoc, float temp, float hum);
 
+/**
+ * @brief uploads all buffered samples to the project website, in batches of at most CCS811_BME280_BATCH_SIZE samples
+ * 		  per request. The connection is kept open between uploads, a new tcp connection is only made when
+ * 		  there is none, or when the server has closed it. Samples are only removed from the buffer once the
+ * 		  server has accepted them, or rejected them with a 4xx status. Settings in the answer are applied.
+ * @param void
+ * @return RETURN_STATUS, either ESP8266_WEB_DISCONNECTED, ESP8266_WEB_REQUEST_ERROR or ESP8266_WEB_REQUEST_SUCCESS
+ */
+RETURN_STATUS esp8266_web_upload(void);
+
+/**
+ * @brief upload the buffered samples, and recover from failed uploads. After a failure the next
+ * 		  attempt is made after a jittered exponential backoff, starting at UPLOAD_RETRY_BASE ms.
+ * 		  After UPLOAD_REJOIN_AFTER failures in a row wifi is joined again if the association was lost,
+ * 		  and after UPLOAD_RESET_AFTER failures in a row the esp8266 is restarted before trying.
+ * 		  Call it until it succeeds, samples are kept in the sample buffer meanwhile.
+ * @param void
+ * @return RETURN_STATUS, ESP8266_WEB_REQUEST_SUCCESS, ESP8266_UPLOAD_BACKOFF while waiting to retry,
+ * 		   or the status of the failed attempt
+ */
+RETURN_STATUS esp8266_upload_with_recovery(void);
+
+/**
+ * @brief store a sample in the sample buffer until the next upload. If the buffer is full the oldest sample is dropped.
+ * @param uint16_t co2, CO2 value
+ * @param uint16_t tvoc, tVOC value
+ * @param float temp, temperature value
+ * @param float hum, humidity value
+ * @return void
+ */
+void store_sample(uint16_t co2, uint16_t tvoc, float temp, float hum);
+
+/**
+ * @brief get the upload statistics
+ * @param void
+ * @return const UPLOAD_STATS*, counters for the uploads made so far
+ */
+const UPLOAD_STATS* get_upload_stats(void);
+
+/**
+ * @brief put the esp8266 to sleep until the next upload, with the mode set by ESP8266_SLEEP_BETWEEN_UPLOADS.
+ * 		  Ends the current power cycle. Passthrough mode is stopped first.
+ * @param void
+ * @return void
+ */
+void esp8266_power_sleep(void);
+
+/**
+ * @brief start waking the esp8266 ahead of an upload, without waiting for it.
+ * @param void
+ * @return void
+ */
+void esp8266_power_prewake(void);
+
+/**
+ * @brief make sure the esp8266 is awake before an upload, waits for a wake up started by esp8266_power_prewake
+ * 		  or does the whole wake up if none was started.
+ * @param void
+ * @return RETURN_STATUS, either ESP8266_WAKE_SUCCESS or ESP8266_WAKE_ERROR
+ */
+RETURN_STATUS esp8266_power_wake(void);
+
+/**
+ * @brief number of samples before an upload that the esp8266 should start waking up, based on the
+ * 		  longest wake up seen so far.
+ * @param void
+ * @return uint8_t, samples ahead of the upload
+ */
+uint8_t esp8266_power_wake_lead(void);
+
+/**
+ * @brief get the esp8266 power statistics
+ * @param void
+ * @return const POWER_STATS*, counters for the sleep cycles so far
+ */
+const POWER_STATS* get_power_stats(void);
+
 /**
  * @brief initiates the ccs811 with all settings needed for environmental measurements each second.
  * @param void
@@ -112,6 +309,39 @@ RETURN_STATUS esp8266_web_request(uint16_t co2, uint16_t tvoc, float temp, float
  */
 RETURN_STATUS ccs811_start(void);
 
+/**
+ * @brief apply the settings the server sent in the body of an answer, e.g. interval=60&batch=20&drive_mode=2.
+ * 		  Missing or out of range values are ignored. A faster drive mode is used right away. A slower one is
+ * 		  started by ccs811_drive_mode_update after the CCS811 has been idle for CCS811_IDLE_TIME ms, as the
+ * 		  datasheet requires, sampling goes on in the current mode until the idle period starts.
+ * @param const char* body, zero terminated body of the answer
+ * @return bool, true if any setting was changed
+ */
+bool apply_server_settings(const char* body);
+
+/**
+ * @brief move on to a slower drive mode from the server. The CCS811 is put in idle once every sample has been
+ * 		  uploaded, at most once per CCS811_SLOWDOWN_INTERVAL, and the new mode is started CCS811_IDLE_TIME
+ * 		  later. Call it from the main loop.
+ * @param void
+ * @return void
+ */
+void ccs811_drive_mode_update(void);
+
+/**
+ * @brief drive mode the CCS811 is in.
+ * @param void
+ * @return uint8_t, 1 to 3, 0 while idle before a slower mode
+ */
+uint8_t ccs811_drive_mode(void);
+
+/**
+ * @brief time between samples in the current drive mode.
+ * @param void
+ * @return uint32_t, ms between samples
+ */
+uint32_t ccs811_sample_period(void);
+
 /**
  * @brief initiates the bme280 to measure temperature and humidity.
  * @param void
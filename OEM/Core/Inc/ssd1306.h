@@ -17,8 +17,8 @@
  *
  * @var H - Max height of the display
  * @var W - Max width of the display
- * @var MAX_CHARS - Max amount of chars on one line
- * @var MAX_ROWS - Max amount of rows in display
+ * @var MAX_CHARS - Max amount of chars on one line in the default font
+ * @var MAX_ROWS - Max amount of rows in display in the default font, other fonts take theirs from FontDef
  * @var BUFFERSIZE - Max buffersize of the display
  */
 #define H 64
@@ -27,6 +27,36 @@
 #define MAX_ROWS 5
 #define ROW_SIZE 12
 #define BUFFERSIZE 1024
+#define PAGES 8
+#define ALL_PAGES 0xFF
+
+/**
+ * @brief how display_update addresses the display RAM
+ *
+ * 1 - horizontal addressing, a column and page window is set once and the changed part of the
+ *     buffer is sent in one transfer, a whole frame is two transfers
+ * 0 - page addressing, three commands and one transfer for every changed page
+ *
+ * Can be given with -D to compare the two
+ */
+#ifndef DISPLAY_HORIZONTAL_ADDRESSING
+#define DISPLAY_HORIZONTAL_ADDRESSING 1
+#endif
+
+/**
+ * @brief how display_update sends, only with horizontal addressing
+ *
+ * 1 - the changes are copied to a front buffer and sent with DMA on hi2c2, display_update returns
+ *     at once and display_flush_in_progress tells when the flush is done
+ * 0 - display_update blocks until everything is sent
+ */
+#ifndef DISPLAY_DMA
+#define DISPLAY_DMA DISPLAY_HORIZONTAL_ADDRESSING
+#endif
+
+#if DISPLAY_DMA && !DISPLAY_HORIZONTAL_ADDRESSING
+#error "DISPLAY_DMA needs DISPLAY_HORIZONTAL_ADDRESSING"
+#endif
 
 /*
  * @brief Enumeration of colours for the display¨: black or White
@@ -41,28 +71,65 @@ typedef enum
  * @brief Display object structs for information about the display
  * @var thisX - current Xposition in the display buffer
  * @var thisY - current Yposition in the display buffer
+ * @var Dirty_Pages - one bit per page of 8 rows, set when the buffer differs from the display
+ * @var Dirty_First - first changed column of each dirty page
+ * @var Dirty_Last - last changed column of each dirty page
+ * @var Flushed_Bytes - bytes sent to the display by display_update, control bytes included
+ * @var Flush_Busy - set while a flush is being sent with DMA
+ * @var Flush_Pending - display_update was called during the flush, display_poll starts another one after it
+ * @var Font - font of display_write_string and display_string_on_line
+ * @var Canvas - counts the clears by reset_screen_canvas, what was drawn before one is gone
  */
 typedef struct {
     uint16_t thisX;
     uint16_t thisY;
     HAL_StatusTypeDef Init_Status;
     HAL_StatusTypeDef Update_Status;
+    volatile uint8_t Dirty_Pages;
+    uint8_t Dirty_First[PAGES];
+    uint8_t Dirty_Last[PAGES];
+    volatile uint32_t Flushed_Bytes;
+    volatile uint8_t Flush_Busy;
+    volatile uint8_t Flush_Pending;
+    const FontDef* Font;
+    uint16_t Canvas;
 } Display_t;
 
+/*
+ * @brief called when a flush is done, from the I2C interrupt if it was sent with DMA
+ * @param status - HAL_OK if everything was sent, the rest is sent by the next update otherwise
+ */
+typedef void (*Display_FlushCallback)(HAL_StatusTypeDef status);
+
 /*
  * Function prototype declaration
+ * Drawing and reset_screen_canvas only change the screen buffer and do not wait, display_update is
+ * the step that sends the changes. display_write_string and display_string_on_line call it themselves
  */
 uint16_t display_get_y(void);
 uint16_t display_get_x(void);
+const uint8_t* display_get_buffer(void);
 HAL_StatusTypeDef display_get_init_status(void);
 HAL_StatusTypeDef display_get_update_status(void);
+uint8_t display_get_dirty_pages(void);
+uint32_t display_get_flushed_bytes(void);
+uint16_t display_get_canvas(void);
 void display_init(void);
 HAL_StatusTypeDef command(uint8_t);
 void draw_pixel(uint8_t, uint8_t, Display_ColourDef);
 void reset_screen_canvas(void);
 void retry(void);
 void display_update(void);
+void display_invalidate(void);
+uint8_t display_flush_in_progress(void);
+void display_poll(void);
+HAL_StatusTypeDef display_wait_flush(uint32_t);
+void display_set_flush_callback(Display_FlushCallback);
 void display_write_char(char, FontDef, Display_ColourDef);
+void display_draw_column(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+void display_scroll_left(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+void display_set_font(FontId);
+const FontDef* display_get_font(void);
 void display_write_string(const char*, Display_ColourDef);
 void display_write_string_no_update(const char*, Display_ColourDef);
 void display_set_position(uint16_t, uint16_t);
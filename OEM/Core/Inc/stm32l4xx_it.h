@@ -58,6 +58,9 @@ void PendSV_Handler(void);
 void SysTick_Handler(void);
 void UART4_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void DMA1_Channel4_IRQHandler(void);
+void I2C2_EV_IRQHandler(void);
+void I2C2_ER_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -16,12 +16,34 @@ void tearDown(void);
 void test_BME280_init(void);
 void test_CCS811_init(void);
 void test_esp8266_init(void);
+void test_esp8266_baud_rate(void);
 void test_esp8266_at_cwjap_verify(void);
 void test_esp8266_wifi_connect(void);
+void test_esp8266_wifi_rejoin(void);
+void test_esp8266_dns_lookup(void);
+void test_esp8266_sleep(void);
 void test_esp8266_web_connection(void);
 void test_esp8266_web_request(void);
+void test_esp8266_web_request_keep_alive(void);
+void test_esp8266_http_post_request(void);
+void test_esp8266_request_segments(void);
+void test_esp8266_send_large_data(void);
+void test_esp8266_passthrough(void);
 void test_esp8266_at_send(char*);
 void test_esp8266_send_data(char*);
 void test_display_init(void);
+void test_display_dirty_pages(void);
+void test_display_benchmark(void);
+void test_mqtt_encode_connect(void);
+void test_mqtt_encode_publish(void);
+void test_mqtt_encode_publish_long(void);
+void test_mqtt_check_ack(void);
+void test_cbor_encode_reading(void);
+void test_cbor_encode_int(void);
+void test_cbor_benchmark(void);
+void test_http_response_content_length(void);
+void test_http_response_chunked(void);
+void test_http_response_close(void);
+void test_http_form_value(void);
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef*);
 
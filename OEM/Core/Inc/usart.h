@@ -40,6 +40,9 @@ extern UART_HandleTypeDef huart4;
 void MX_UART4_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+/* Re-initializes UART4 with a new baud rate and flow control (UART_HWCONTROL_NONE or UART_HWCONTROL_RTS),
+ * the RX interrupt has to be started again afterwards. */
+HAL_StatusTypeDef uart4_reconfigure(uint32_t baud_rate, uint32_t flow_control);
 
 /* USER CODE END Prototypes */
 
@@ -25,10 +25,58 @@
 
 /* Global variables */
 static uint8_t rx_variable;
-static uint8_t rx_buffer_index = 0;
+static volatile uint16_t rx_buffer_index = 0;
 static bool error_flag = false;
 static bool fail_flag = false;
+static bool timeout_flag = false;		// set when the last command got no answer in time
+static bool link_closed_flag = false;	// set when the ESP8266 reports CLOSED for the current connection
+static bool passthrough_flag = false;	// set while the ESP8266 is in passthrough mode
+static uint32_t baud_rate = ESP8266_DEFAULT_BAUD_RATE;	// rate UART4 and the ESP8266 are using
+static bool flow_control_flag = false;	// set while RTS flow control is used
+static ESP8266_SLEEP_MODE sleep_mode = ESP8266_SLEEP_NONE;
+static char dns_host[ESP8266_HOST_SIZE] = {0};	// last host looked up, empty if there is no cached address
+static char dns_ip[ESP8266_IP_SIZE] = {0};
+static uint32_t dns_time = 0;					// tick of the lookup
+#ifdef ESP8266_BSSID
+static char wifi_bssid[ESP8266_BSSID_SIZE] = ESP8266_BSSID;	// AP to join, skips picking one after the scan
+#else
+static char wifi_bssid[ESP8266_BSSID_SIZE] = {0};	// learnt on the first join, RAM only so lost on reset
+#endif
 static char rx_buffer[RX_BUFFER_SIZE]; //rx recieve buffer for handling all the ESP8266 data it sends back
+static HTTP_RESPONSE* volatile http_response = NULL;	// response being parsed, fed from the rx interrupt
+static uint8_t ipd_match = 0;			// characters of +IPD, matched so far
+static uint16_t ipd_len = 0;			// length of the +IPD message being read
+static uint16_t ipd_remaining = 0;		// bytes of +IPD data left, these go to the parser
+
+/* Picks the +IPD,<len>:<data> messages out of the received bytes and feeds the data to the
+ * response parser. In passthrough mode everything received is data. */
+static void
+esp8266_rx_demux(char c){
+	if(passthrough_flag || ipd_remaining > 0){
+		http_response_feed(http_response, c);
+		if(ipd_remaining > 0)
+			ipd_remaining--;
+		return;
+	}
+
+	/* Reading the length after +IPD, */
+	if(ipd_match == sizeof(ESP8266_AT_IPD) - 1){
+		if(c >= '0' && c <= '9')
+			ipd_len = ipd_len * 10 + (c - '0');
+		else {
+			if(c == ':')
+				ipd_remaining = ipd_len;
+			ipd_match = 0;
+			ipd_len	  = 0;
+		}
+		return;
+	}
+
+	if(c == ESP8266_AT_IPD[ipd_match])
+		ipd_match++;
+	else
+		ipd_match = (c == ESP8266_AT_IPD[0]) ? 1 : 0;
+}
 
 void
 init_uart_interrupt(void){
@@ -43,7 +91,10 @@ void
 HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
    if (huart->Instance == UART4) {					 // change UART4 to whatever handler you are using
-      rx_buffer[rx_buffer_index++] = rx_variable;    // Add 1 byte to rx_Buffer
+      if(rx_buffer_index < RX_BUFFER_SIZE - 1)		 // keep the last byte as string terminator
+         rx_buffer[rx_buffer_index++] = rx_variable; // Add 1 byte to rx_Buffer
+      if(http_response != NULL)
+         esp8266_rx_demux(rx_variable);
    }
    HAL_UART_Receive_IT(&huart4, &rx_variable, 1); // Clear flags and read next byte
 }
@@ -61,15 +112,32 @@ hash(const char *str) {
 }
 
 
+/* Most commands are answered at once, only the ones that wait for the network or for a join take long */
+static uint32_t
+esp8266_command_timeout(const char* command){
+	if(strstr(command, ESP8266_AT_CWJAP_SET) != NULL || strcmp(command, ESP8266_AT_RST) == 0)
+		return ESP8266_JOIN_TIMEOUT;
+	if(strstr(command, ESP8266_AT_START) != NULL || strstr(command, ESP8266_AT_CIPDOMAIN) != NULL)
+		return ESP8266_CONNECT_TIMEOUT;
+	return ESP8266_COMMAND_TIMEOUT;
+}
+
 /* DMA would probably have been a better fit for this...? */
 const char*
 esp8266_send_command(const char* command){
 
 	esp8266_clear();
 	HAL_UART_Transmit(&huart4, (uint8_t*) command, strlen(command), 100);
+	uint32_t start = HAL_GetTick();
+	uint32_t timeout = esp8266_command_timeout(command);
 
 	// wait for OK or ERROR/FAIL
 	while((strstr(rx_buffer, ESP8266_AT_OK_TERMINATOR) == NULL)){
+		if(HAL_GetTick() - start > timeout){
+			error_flag = true;
+			timeout_flag = true;
+			break;
+		}
 		if(strstr(rx_buffer, ESP8266_AT_ERROR) != NULL){
 			error_flag = true;
 			break;
@@ -98,39 +166,406 @@ esp8266_send_data(const char* data){
 	rx_buffer_index = 0;
 
 	memset(rx_buffer, 0, RX_BUFFER_SIZE);
-	HAL_UART_Transmit(&huart4, (uint8_t*) data, strlen(data), 100);
+	uint16_t len = strlen(data);
+	HAL_UART_Transmit(&huart4, (uint8_t*) data, len, ESP8266_TX_TIMEOUT(len));
 
-	while((strstr(rx_buffer, ESP8266_AT_CLOSED) == NULL));
+	if(!esp8266_wait_for(ESP8266_AT_CLOSED, ESP8266_RESPONSE_TIMEOUT))
+		return ESP8266_AT_ERROR;
 
 	return ESP8266_AT_CLOSED;
 }
 
+/* Checks if a complete +IPD message is in the rx buffer, the format is +IPD,<len>:<data> */
+static bool
+esp8266_ipd_received(void){
+
+	char* ipd = strstr(rx_buffer, ESP8266_AT_IPD);
+	if(ipd == NULL)
+		return false;
+
+	char* payload = strchr(ipd, ':');
+	if(payload == NULL)
+		return false;
+
+	uint16_t len = atoi(ipd + strlen(ESP8266_AT_IPD));
+	return (&rx_buffer[rx_buffer_index] >= (payload + 1 + len));
+}
+
 const char*
-esp8266_init(void){
+esp8266_send_data_keep_alive(const char* data){
 
-	/* Init the uart to use here*/
-	MX_UART4_Init();
-	HAL_Delay(100);
+	/* if the function is called after an error, cancel */
+	if(error_flag || fail_flag)
+		return ESP8266_AT_ERROR;
 
-	/* Enable interrupts for UART4 */
+	rx_buffer_index = 0;
+
+	memset(rx_buffer, 0, RX_BUFFER_SIZE);
+	uint16_t len = strlen(data);
+	HAL_UART_Transmit(&huart4, (uint8_t*) data, len, ESP8266_TX_TIMEOUT(len));
+
+	if(!esp8266_wait_for(ESP8266_AT_SEND_OK, ESP8266_RESPONSE_TIMEOUT))
+		return esp8266_link_closed() ? ESP8266_AT_CLOSED : ESP8266_AT_ERROR;
+
+	return esp8266_wait_response();
+}
+
+const char*
+esp8266_wait_response(void){
+
+	/* Wait for the server response, the connection is left open unless the server closes it */
+	uint32_t start = HAL_GetTick();
+	while((http_response != NULL) ? !http_response_done(http_response) : !esp8266_ipd_received()){
+		if(esp8266_link_closed())
+			return ESP8266_AT_CLOSED;
+		if(HAL_GetTick() - start > ESP8266_RESPONSE_TIMEOUT)
+			return ESP8266_AT_ERROR;
+	}
+
+	/* The server answered, but it will close the connection anyway. In passthrough mode
+	 * CLOSED is not reported, the ESP8266 connects again by itself */
+	if(passthrough_flag)
+		return ESP8266_AT_SEND_OK;
+	if((http_response != NULL) ? http_response->connection_close : (strstr(rx_buffer, HTTP_CONNECTION_CLOSE) != NULL)){
+		esp8266_wait_for(ESP8266_AT_CLOSED, ESP8266_RESPONSE_TIMEOUT);
+		link_closed_flag = true;
+		return ESP8266_AT_CLOSED;
+	}
+	return ESP8266_AT_SEND_OK;
+}
+
+void
+esp8266_response_start(HTTP_RESPONSE* response){
+	http_response = NULL;
+	http_response_init(response);
+	ipd_match	  = 0;
+	ipd_len		  = 0;
+	ipd_remaining = 0;
+	http_response = response;
+}
+
+void
+esp8266_response_stop(void){
+	HTTP_RESPONSE* response = http_response;
+	http_response = NULL;
+	if(response != NULL && !http_response_done(response) && esp8266_link_closed())
+		http_response_finish(response);
+}
+
+/* The ESP8266 takes at most 2048 bytes per AT+CIPSEND, so larger data is sent in chunks.
+ * Each chunk is announced with its own cipsend, and the next chunk is not sent before the
+ * ESP8266 has answered with > and SEND OK for the current one.
+ */
+const char*
+esp8266_send_large_data(const char* data, uint16_t len){
+
+	ESP8266_REQUEST request;
+	esp8266_request_init(&request);
+	esp8266_request_add(&request, data, len);
+	return esp8266_send_request(&request);
+}
+
+/* Transmits len bytes of the segments, starting offset bytes into the request */
+static HAL_StatusTypeDef
+esp8266_transmit_segments(const ESP8266_REQUEST* request, uint16_t offset, uint16_t len){
+
+	for(uint8_t i = 0; i < request->count && len > 0; i++){
+		const ESP8266_SEGMENT* segment = &request->segments[i];
+		if(offset >= segment->len){
+			offset -= segment->len;
+			continue;
+		}
+
+		uint16_t part = segment->len - offset;
+		if(part > len)
+			part = len;
+		if(HAL_UART_Transmit(&huart4, (uint8_t*) &segment->data[offset], part, ESP8266_TX_TIMEOUT(part)) != HAL_OK)
+			return HAL_ERROR;
+		offset = 0;
+		len -= part;
+	}
+	return HAL_OK;
+}
+
+const char*
+esp8266_send_request(const ESP8266_REQUEST* request){
+
+	char send_command[32] = {0};
+	uint16_t sent = 0;
+	uint16_t len = request->len;
+
+	if(request->overflow)
+		return ESP8266_AT_ERROR;
+
+	while(sent < len){
+		uint16_t chunk = ((len - sent) > ESP8266_CIPSEND_MAX) ? ESP8266_CIPSEND_MAX : (len - sent);
+
+		esp8266_get_at_send_command(send_command, chunk);
+		if(strcmp(esp8266_send_command(send_command), ESP8266_AT_SEND_OK) != 0)
+			return esp8266_link_closed() ? ESP8266_AT_CLOSED : ESP8266_AT_ERROR;
+
+		/* Wait for the prompt before sending the data */
+		if(!esp8266_wait_for(ESP8266_AT_PROMPT, ESP8266_RESPONSE_TIMEOUT))
+			return ESP8266_AT_ERROR;
+
+		if(esp8266_transmit_segments(request, sent, chunk) != HAL_OK)
+			return ESP8266_AT_ERROR;
+
+		if(!esp8266_wait_for(ESP8266_AT_SEND_OK, ESP8266_RESPONSE_TIMEOUT))
+			return esp8266_link_closed() ? ESP8266_AT_CLOSED : ESP8266_AT_ERROR;
+
+		sent += chunk;
+	}
+	return ESP8266_AT_SEND_OK;
+}
+
+const char*
+esp8266_passthrough_start(void){
+
+	if(strcmp(esp8266_send_command(ESP8266_AT_CIPMODE_PASSTHROUGH), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+
+	if(strcmp(esp8266_send_command(ESP8266_AT_SEND_PASSTHROUGH), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+
+	/* Everything after the prompt goes straight to the socket */
+	if(!esp8266_wait_for(ESP8266_AT_PROMPT, ESP8266_RESPONSE_TIMEOUT))
+		return ESP8266_AT_ERROR;
+
+	passthrough_flag = true;
+	return ESP8266_AT_OK;
+}
+
+const char*
+esp8266_passthrough_send(const char* data, uint16_t len){
+
+	if(!passthrough_flag)
+		return ESP8266_AT_ERROR;
+
+	esp8266_clear();
+	if(HAL_UART_Transmit(&huart4, (uint8_t*) data, len, ESP8266_TX_TIMEOUT(len)) != HAL_OK)
+		return ESP8266_AT_ERROR;
+	return ESP8266_AT_OK;
+}
+
+const char*
+esp8266_passthrough_send_request(const ESP8266_REQUEST* request){
+
+	if(!passthrough_flag || request->overflow)
+		return ESP8266_AT_ERROR;
+
+	esp8266_clear();
+	if(esp8266_transmit_segments(request, 0, request->len) != HAL_OK)
+		return ESP8266_AT_ERROR;
+	return ESP8266_AT_OK;
+}
+
+const char*
+esp8266_passthrough_stop(void){
+
+	/* +++ is only recognised as a single packet surrounded by silence */
+	HAL_Delay(ESP8266_ESCAPE_GUARD);
+	HAL_UART_Transmit(&huart4, (uint8_t*) ESP8266_AT_ESCAPE, strlen(ESP8266_AT_ESCAPE), 100);
+	HAL_Delay(ESP8266_ESCAPE_GUARD);
+	passthrough_flag = false;
+
+	return esp8266_send_command(ESP8266_AT_CIPMODE_NORMAL);
+}
+
+bool
+esp8266_passthrough_active(void){
+	return passthrough_flag;
+}
+
+uint16_t
+esp8266_receive(uint8_t* buffer, uint16_t size, uint32_t timeout){
+
+	uint32_t start = HAL_GetTick();
+	while(!esp8266_ipd_received()){
+		if(esp8266_link_closed() || (HAL_GetTick() - start > timeout))
+			return 0;
+	}
+
+	/* The +IPD header is text, the data after : may contain zeros, so it is copied by length */
+	char* ipd = strstr(rx_buffer, ESP8266_AT_IPD);
+	char* payload = strchr(ipd, ':') + 1;
+	uint16_t len = atoi(ipd + strlen(ESP8266_AT_IPD));
+	if(len > size)
+		len = size;
+	memcpy(buffer, payload, len);
+
+	esp8266_clear();
+	return len;
+}
+
+const char*
+esp8266_connection_status(void){
+	return esp8266_send_command(ESP8266_AT_CIPSTATUS);
+}
+
+bool
+esp8266_link_closed(void){
+	if(strstr(rx_buffer, ESP8266_AT_CLOSED) != NULL)
+		link_closed_flag = true;
+	return link_closed_flag;
+}
+
+bool
+esp8266_command_timed_out(void){
+	return timeout_flag;
+}
+
+const char*
+esp8266_resolve(const char* host, char* ip){
+
+	char dns_command[ESP8266_HOST_SIZE + 32] = {0};
+	sprintf(dns_command, "%s\"%s\"\r\n", ESP8266_AT_CIPDOMAIN, host);
+	if(strcmp(esp8266_send_command(dns_command), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+
+	/* +CIPDOMAIN:<ip>\r\n */
+	char* info = strstr(rx_buffer, ESP8266_AT_CIPDOMAIN_INFO);
+	if(info == NULL)
+		return ESP8266_AT_ERROR;
+	info += strlen(ESP8266_AT_CIPDOMAIN_INFO);
+	uint8_t len = strspn(info, "0123456789.");
+	if(len == 0 || len >= ESP8266_IP_SIZE)
+		return ESP8266_AT_ERROR;
+	memcpy(ip, info, len);
+	ip[len] = '\0';
+	return ESP8266_AT_OK;
+}
+
+const char*
+esp8266_dns_lookup(const char* host){
+
+	/* Already an address */
+	if(strspn(host, "0123456789.") == strlen(host))
+		return host;
+
+	if(dns_host[0] != '\0' && strcmp(dns_host, host) == 0 && (HAL_GetTick() - dns_time) < ESP8266_DNS_TTL)
+		return dns_ip;
+
+	dns_host[0] = '\0';
+	if(strlen(host) >= ESP8266_HOST_SIZE || strcmp(esp8266_resolve(host, dns_ip), ESP8266_AT_OK) != 0)
+		return host;
+
+	strcpy(dns_host, host);
+	dns_time = HAL_GetTick();
+	return dns_ip;
+}
+
+void
+esp8266_dns_invalidate(void){
+	dns_host[0] = '\0';
+}
+
+bool
+esp8266_wait_for(const char* token, uint32_t timeout){
+	uint32_t start = HAL_GetTick();
+	while(strstr(rx_buffer, token) == NULL){
+		if(HAL_GetTick() - start > timeout)
+			return false;
+	}
+	return true;
+}
+
+/* Sends AT and waits a short while for OK, a few times since the first bytes after a rate change may be garbled */
+static bool
+esp8266_verify_link(void){
+	for(uint8_t i = 0; i < 3; i++){
+		esp8266_clear();
+		HAL_UART_Transmit(&huart4, (uint8_t*) ESP8266_AT, strlen(ESP8266_AT), 100);
+		if(esp8266_wait_for(ESP8266_AT_OK_TERMINATOR, ESP8266_BAUD_VERIFY_TIMEOUT))
+			return true;
+	}
+	return false;
+}
+
+/* Changes only the L476 side of the link */
+static bool
+esp8266_uart_switch(uint32_t rate, bool flow_control){
+	if(uart4_reconfigure(rate, flow_control ? UART_HWCONTROL_RTS : UART_HWCONTROL_NONE) != HAL_OK)
+		return false;
 	init_uart_interrupt();
-	HAL_Delay(100);
+	baud_rate = rate;
+	flow_control_flag = flow_control;
+	return true;
+}
 
-	/* Get OK from esp8266 */
-	if(strcmp(esp8266_send_command(ESP8266_AT), ESP8266_AT_OK) != 0)
+const char*
+esp8266_set_baud_rate(uint32_t rate, bool flow_control){
+
+	char uart_command[64] = {0};
+	uint32_t old_rate = baud_rate;
+	bool old_flow_control = flow_control_flag;
+
+	/* The module answers at the old rate, on ERROR nothing has changed */
+	esp8266_get_uart_command(uart_command, rate, flow_control);
+	if(strcmp(esp8266_send_command(uart_command), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
-	/* Esp8266 sends lots of data when first started */
-	HAL_Delay(500);
-	/* Reset the esp8266 */
-	if(strcmp(esp8266_send_command(ESP8266_AT_RST), ESP8266_AT_OK) != 0){
+	if(esp8266_uart_switch(rate, flow_control) && esp8266_verify_link())
+		return ESP8266_AT_OK;
+
+	/* No answer at the new rate, the module may still hear us there even if we can not hear it,
+	 * so ask it to go back before switching back ourselves */
+	esp8266_get_uart_command(uart_command, old_rate, old_flow_control);
+	for(uint8_t i = 0; i < 3; i++){
+		HAL_UART_Transmit(&huart4, (uint8_t*) uart_command, strlen(uart_command), 100);
+		HAL_Delay(ESP8266_BAUD_VERIFY_TIMEOUT);
+	}
+
+	if(esp8266_uart_switch(old_rate, old_flow_control) && esp8266_verify_link())
 		return ESP8266_AT_ERROR;
+	return ESP8266_AT_FAIL;
+}
+
+uint32_t
+esp8266_negotiate_baud_rate(void){
+
+	for(uint32_t rate = ESP8266_MAX_BAUD_RATE; rate > baud_rate; rate /= 2){
+		const char* result = esp8266_set_baud_rate(rate, ESP8266_FLOW_CONTROL);
+		if(strcmp(result, ESP8266_AT_OK) == 0)
+			break;
+		if(strcmp(result, ESP8266_AT_FAIL) == 0)
+			return 0;
+	}
+	return baud_rate;
+}
+
+/* Looks for the esp8266 at the default rate, and then at the rates esp8266_negotiate_baud_rate may have left it at */
+static bool
+esp8266_find_link(void){
+	if(esp8266_verify_link())
+		return true;
+
+	for(uint32_t rate = ESP8266_MAX_BAUD_RATE; rate > ESP8266_DEFAULT_BAUD_RATE; rate /= 2){
+		if(esp8266_uart_switch(rate, ESP8266_FLOW_CONTROL) && esp8266_verify_link())
+			return true;
 	}
 
+	esp8266_uart_switch(ESP8266_DEFAULT_BAUD_RATE, false);
+	return false;
+}
+
+uint32_t
+esp8266_baud_rate(void){
+	return baud_rate;
+}
+
+/* Everything needed after the esp8266 has restarted, by AT+RST or when waking from deep sleep */
+static const char*
+esp8266_configure(void){
+
 	/* Get OK from esp8266 */
 	if(strcmp(esp8266_send_command(ESP8266_AT), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
+	/* Move to a faster uart, a restart puts the esp8266 back at the default rate */
+	if(esp8266_negotiate_baud_rate() == 0)
+		return ESP8266_AT_ERROR;
+
 	/* Disconnect the esp8266 if it auto connects... */
 	/* seems to break the module when ran quickly, not sure why so just
 	 * leave it out. If the module does autoconnect, send ESP8266_AT_CWAUTOCONN.
@@ -160,6 +595,188 @@ esp8266_init(void){
 	return ESP8266_AT_OK;
 }
 
+const char*
+esp8266_sleep(ESP8266_SLEEP_MODE mode, uint32_t time){
+
+	char sleep_command[64] = {0};
+
+	/* The command would be sent to the server */
+	if(passthrough_flag)
+		return ESP8266_AT_ERROR;
+
+	if(mode == ESP8266_SLEEP_DEEP){
+		sprintf(sleep_command, "%s%lu\r\n", ESP8266_AT_GSLP, (unsigned long) time);
+		if(strcmp(esp8266_send_command(sleep_command), ESP8266_AT_OK) != 0)
+			return ESP8266_AT_ERROR;
+		/* The module restarts when it wakes up, nothing survives */
+		link_closed_flag = true;
+		passthrough_flag = false;
+		sleep_mode = mode;
+		return ESP8266_AT_OK;
+	}
+
+	if(mode == ESP8266_SLEEP_LIGHT){
+		sprintf(sleep_command, "%s1,%u,0\r\n", ESP8266_AT_WAKEUPGPIO, ESP8266_WAKE_GPIO);
+		if(strcmp(esp8266_send_command(sleep_command), ESP8266_AT_OK) != 0)
+			return ESP8266_AT_ERROR;
+	}
+
+	sprintf(sleep_command, "%s%u\r\n", ESP8266_AT_SLEEP, mode);
+	if(strcmp(esp8266_send_command(sleep_command), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+	sleep_mode = mode;
+	return ESP8266_AT_OK;
+}
+
+void
+esp8266_wake_start(void){
+
+	switch(sleep_mode){
+		case ESP8266_SLEEP_LIGHT:
+			/* Held low until the module answers, released in esp8266_wake_finish */
+			HAL_GPIO_WritePin(ESP_WAKE_GPIO_Port, ESP_WAKE_Pin, GPIO_PIN_RESET);
+			break;
+
+		case ESP8266_SLEEP_DEEP:
+			/* The module boots at the default rate and sends ready */
+			esp8266_uart_switch(ESP8266_DEFAULT_BAUD_RATE, false);
+			esp8266_clear();
+			HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_RESET);
+			HAL_Delay(1);
+			HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_SET);
+			break;
+
+		default:
+			break;
+	}
+}
+
+const char*
+esp8266_wake_finish(void){
+
+	char sleep_command[64] = {0};
+	bool awake = true;
+
+	if(passthrough_flag && sleep_mode != ESP8266_SLEEP_NONE)
+		return ESP8266_AT_ERROR;
+
+	switch(sleep_mode){
+		case ESP8266_SLEEP_NONE:
+			return ESP8266_AT_OK;
+
+		case ESP8266_SLEEP_LIGHT:
+			awake = esp8266_verify_link();
+			HAL_GPIO_WritePin(ESP_WAKE_GPIO_Port, ESP_WAKE_Pin, GPIO_PIN_SET);
+			break;
+
+		case ESP8266_SLEEP_DEEP:
+			sleep_mode = ESP8266_SLEEP_NONE;
+			if(!esp8266_wait_for(ESP8266_AT_READY, ESP8266_READY_TIMEOUT) || strcmp(esp8266_configure(), ESP8266_AT_OK) != 0)
+				return ESP8266_AT_ERROR;
+			/* The module joins the last access point by itself, unless it has not made it yet */
+			if(strcmp(esp8266_wifi_init(), ESP8266_AT_WIFI_CONNECTED) != 0)
+				return ESP8266_AT_ERROR;
+			return ESP8266_AT_OK;
+
+		default:
+			break;
+	}
+
+	if(!awake)
+		return ESP8266_AT_ERROR;
+
+	/* Stay awake until the next esp8266_sleep */
+	sprintf(sleep_command, "%s%u\r\n", ESP8266_AT_SLEEP, ESP8266_SLEEP_NONE);
+	if(strcmp(esp8266_send_command(sleep_command), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+	sleep_mode = ESP8266_SLEEP_NONE;
+	return ESP8266_AT_OK;
+}
+
+ESP8266_SLEEP_MODE
+esp8266_sleep_mode(void){
+	return sleep_mode;
+}
+
+const char*
+esp8266_init(void){
+
+	/* Init the uart to use here*/
+	MX_UART4_Init();
+	baud_rate = ESP8266_DEFAULT_BAUD_RATE;
+	flow_control_flag = false;
+	sleep_mode = ESP8266_SLEEP_NONE;
+	passthrough_flag = false;
+	esp8266_gpio_init();
+	HAL_Delay(100);
+
+	/* Enable interrupts for UART4 */
+	init_uart_interrupt();
+	HAL_Delay(100);
+
+	/* Get OK from esp8266, if only the L476 was restarted the esp8266 may still be at a faster rate */
+	if(!esp8266_find_link())
+		return ESP8266_AT_ERROR;
+
+	/* Still connected to wifi, then the reset, the scan and DHCP can all be skipped */
+	if(strcmp(esp8266_send_command(ESP8266_AT_CWJAP_TEST), ESP8266_AT_WIFI_CONNECTED) == 0)
+		return esp8266_configure();
+
+	/* Esp8266 sends lots of data when first started */
+	HAL_Delay(500);
+	/* Reset the esp8266 */
+	if(strcmp(esp8266_send_command(ESP8266_AT_RST), ESP8266_AT_OK) != 0){
+		return ESP8266_AT_ERROR;
+	}
+
+	/* It restarts at the default rate */
+	if(baud_rate != ESP8266_DEFAULT_BAUD_RATE)
+		esp8266_uart_switch(ESP8266_DEFAULT_BAUD_RATE, false);
+	esp8266_wait_for(ESP8266_AT_READY, ESP8266_READY_TIMEOUT);
+
+	/* Settings are lost with the reset, configure the esp8266 again */
+	return esp8266_configure();
+}
+
+/* Stores the BSSID from the answer to AT+CWJAP? in the rx buffer, +CWJAP:"<ssid>","<bssid>",<channel>,<rssi> */
+static void
+esp8266_read_bssid(void){
+	char* info = strstr(rx_buffer, ESP8266_AT_CWJAP_INFO);
+	char* bssid = (info != NULL) ? strstr(info + strlen(ESP8266_AT_CWJAP_INFO), "\",\"") : NULL;
+	if(bssid == NULL || strlen(bssid + 3) < ESP8266_BSSID_SIZE - 1)
+		return;
+	memcpy(wifi_bssid, bssid + 3, ESP8266_BSSID_SIZE - 1);
+	wifi_bssid[ESP8266_BSSID_SIZE - 1] = '\0';
+}
+
+const char*
+esp8266_reset(void){
+
+	/* Whatever the state was, nothing survives a restart */
+	link_closed_flag = true;
+	passthrough_flag = false;
+	sleep_mode = ESP8266_SLEEP_NONE;
+	HAL_GPIO_WritePin(ESP_WAKE_GPIO_Port, ESP_WAKE_Pin, GPIO_PIN_SET);
+
+	/* The module restarts at the default rate and sends ready */
+	esp8266_uart_switch(ESP8266_DEFAULT_BAUD_RATE, false);
+	esp8266_clear();
+	HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_RESET);
+	HAL_Delay(1);
+	HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_SET);
+
+	if(!esp8266_wait_for(ESP8266_AT_READY, ESP8266_READY_TIMEOUT)){
+		/* No reset line, ask the module to restart instead */
+		if(!esp8266_find_link() || strcmp(esp8266_send_command(ESP8266_AT_RST), ESP8266_AT_OK) != 0)
+			return ESP8266_AT_ERROR;
+		esp8266_uart_switch(ESP8266_DEFAULT_BAUD_RATE, false);
+		if(!esp8266_wait_for(ESP8266_AT_READY, ESP8266_READY_TIMEOUT))
+			return ESP8266_AT_ERROR;
+	}
+
+	return esp8266_configure();
+}
+
 const char*
 esp8266_wifi_init(void){
 
@@ -168,19 +785,56 @@ esp8266_wifi_init(void){
 
 	/* Buffers */
 	char wifi_command[256] = {0};
+	const char* result;
+
+	/* Nothing to do if the esp8266 kept the connection */
+	if(strcmp(esp8266_send_command(ESP8266_AT_CWJAP_TEST), ESP8266_AT_WIFI_CONNECTED) == 0){
+		if(wifi_bssid[0] == '\0')
+			esp8266_read_bssid();
+		return ESP8266_AT_WIFI_CONNECTED;
+	}
+
+#ifdef ESP8266_STATIC_IP
+	/* No DHCP, if this fails DHCP is still used */
+	sprintf(wifi_command, "%s\"%s\",\"%s\",\"%s\"\r\n", ESP8266_AT_CIPSTA_CUR, ESP8266_STATIC_IP, ESP8266_GATEWAY, ESP8266_NETMASK);
+	esp8266_send_command(wifi_command);
+#endif
+
+	/* Join the known AP directly, the AP may have been replaced so forget it if that fails */
+	if(wifi_bssid[0] != '\0'){
+		esp8266_get_wifi_bssid_command(wifi_command, wifi_bssid);
+		result = esp8266_send_command(wifi_command);
+		if(strcmp(result, ESP8266_AT_WIFI_CONNECTED) == 0)
+			return result;
+		wifi_bssid[0] = '\0';
+	}
 
 	/* Build the command */
 	esp8266_get_wifi_command(wifi_command);
 
-	/* Connect and return result */
-	return esp8266_send_command(wifi_command);
+	/* Connect, and remember the AP for the next time */
+	result = esp8266_send_command(wifi_command);
+	if(strcmp(result, ESP8266_AT_WIFI_CONNECTED) == 0 &&
+	   strcmp(esp8266_send_command(ESP8266_AT_CWJAP_TEST), ESP8266_AT_WIFI_CONNECTED) == 0)
+		esp8266_read_bssid();
+	return result;
+}
+
+const char*
+esp8266_wifi_bssid(void){
+	return wifi_bssid;
 }
 
 void
 esp8266_clear(void){
+
+	/* Remember if the connection was closed while we were not listening */
+	esp8266_link_closed();
+
 	rx_buffer_index = 0;
 	error_flag = false;
 	fail_flag = false;
+	timeout_flag = false;
 	memset(rx_buffer, 0, RX_BUFFER_SIZE);
 }
 
@@ -190,16 +844,127 @@ esp8266_get_wifi_command(char* ref){
 }
 
 void
-esp8266_get_connection_command(char* ref, char* connection_type, char* remote_ip, char* remote_port){
+esp8266_request_init(ESP8266_REQUEST* request){
+	request->count = 0;
+	request->len = 0;
+	request->overflow = false;
+	request->fields_used = 0;
+}
+
+bool
+esp8266_request_add(ESP8266_REQUEST* request, const char* data, uint16_t len){
+	if(request->count == ESP8266_REQUEST_SEGMENTS || len > UINT16_MAX - request->len){
+		request->overflow = true;
+		return false;
+	}
+	request->segments[request->count].data = data;
+	request->segments[request->count].len = len;
+	request->count++;
+	request->len += len;
+	return true;
+}
+
+bool
+esp8266_request_add_string(ESP8266_REQUEST* request, const char* string){
+	return esp8266_request_add(request, string, strlen(string));
+}
+
+/* Copies a formatted number into the field buffer and adds it as a segment */
+static bool
+esp8266_request_add_field(ESP8266_REQUEST* request, const char* field, uint8_t len){
+	if(len > ESP8266_REQUEST_FIELDS - request->fields_used){
+		request->overflow = true;
+		return false;
+	}
+	char* data = &request->fields[request->fields_used];
+	memcpy(data, field, len);
+	request->fields_used += len;
+	return esp8266_request_add(request, data, len);
+}
+
+bool
+esp8266_request_add_uint(ESP8266_REQUEST* request, uint32_t value){
+	char field[10];
+	uint8_t len = sizeof(field);
+
+	/* Written backwards from the end of the buffer */
+	do {
+		field[--len] = '0' + value % 10;
+		value /= 10;
+	} while(value > 0);
+	return esp8266_request_add_field(request, &field[len], sizeof(field) - len);
+}
+
+bool
+esp8266_request_add_fixed(ESP8266_REQUEST* request, int32_t value, uint8_t decimals){
+	char field[24];
+	uint8_t len = sizeof(field);
+	uint32_t magnitude = (value < 0) ? -(uint32_t) value : (uint32_t) value;
+
+	if(decimals > 9)
+		decimals = 9;
+
+	/* Decimals first, then the integer part, written backwards */
+	for(uint8_t i = 0; i < decimals; i++){
+		field[--len] = '0' + magnitude % 10;
+		magnitude /= 10;
+	}
+	if(decimals > 0)
+		field[--len] = '.';
+	do {
+		field[--len] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while(magnitude > 0);
+	if(value < 0)
+		field[--len] = '-';
+	return esp8266_request_add_field(request, &field[len], sizeof(field) - len);
+}
+
+bool
+esp8266_request_http_headers(ESP8266_REQUEST* request, const char* host, bool keep_alive,
+							 const char* content_type, uint16_t content_length){
+	esp8266_request_add(request, " ", 1);
+	esp8266_request_add_string(request, HTTP_VERSION);
+	esp8266_request_add_string(request, CRLF);
+	esp8266_request_add_string(request, HTTP_HOST);
+	esp8266_request_add_string(request, host);
+	esp8266_request_add_string(request, CRLF);
+	esp8266_request_add_string(request, keep_alive ? HTTP_CONNECTION_KEEP_ALIVE : HTTP_CONNECTION_CLOSE);
+	esp8266_request_add_string(request, CRLF);
+	if(content_type != NULL){
+		esp8266_request_add_string(request, HTTP_CONTENT_TYPE);
+		esp8266_request_add_string(request, content_type);
+		esp8266_request_add_string(request, CRLF);
+		esp8266_request_add_string(request, HTTP_CONTENT_LENGTH);
+		esp8266_request_add_uint(request, content_length);
+		esp8266_request_add_string(request, CRLF);
+	}
+	esp8266_request_add_string(request, CRLF);
+	return !request->overflow;
+}
+
+void
+esp8266_get_wifi_bssid_command(char* ref, const char* bssid){
+	sprintf (ref, "%s\"%s\",\"%s\",\"%s\"\r\n", ESP8266_AT_CWJAP_SET, SSID, PWD, bssid);
+}
+
+void
+esp8266_get_connection_command(char* ref, const char* connection_type, const char* remote_ip, const char* remote_port){
 	sprintf(ref, "%s\"%s\",\"%s\",%s\r\n", ESP8266_AT_START, connection_type, remote_ip, remote_port);
 }
 
 void
-esp8266_get_at_send_command(char* ref, uint8_t len){
-	sprintf(ref, "%s%d\r\n", ESP8266_AT_SEND, len);
+esp8266_get_uart_command(char* ref, uint32_t rate, bool flow_control){
+	/* flow control 2 makes the esp8266 use its CTS input, which is driven by RTS of the L476 */
+	sprintf(ref, "%s%lu,8,1,0,%u\r\n", ESP8266_AT_UART_CUR, (unsigned long) rate, flow_control ? 2 : 0);
 }
 
-uint8_t
+void
+esp8266_get_at_send_command(char* ref, uint16_t len){
+	sprintf(ref, "%s%u\r\n", ESP8266_AT_SEND, len);
+}
+
+uint16_t
 esp8266_http_get_request(char* ref, const char* http_type, char* uri, char* host){
 	sprintf(ref, "%s%s %s\r\n%s%s\r\n%s\r\n\r\n", http_type, uri, HTTP_VERSION, HTTP_HOST, host, HTTP_CONNECTION_CLOSE); // formatting and concatenating http request
 	return (strlen(ref)); // return the length of the request, the length needs to be specified before data can be sent
@@ -221,6 +986,18 @@ get_return(const char* command){
 		command = ESP8266_AT_START;
 	else if(strstr(command, ESP8266_AT_SEND) != NULL)
 		command = ESP8266_AT_SEND;
+	else if(strstr(command, ESP8266_AT_UART_CUR) != NULL)
+		command = ESP8266_AT_UART_CUR;
+	else if(strstr(command, ESP8266_AT_SLEEP) != NULL)
+		command = ESP8266_AT_SLEEP;
+	else if(strstr(command, ESP8266_AT_WAKEUPGPIO) != NULL)
+		command = ESP8266_AT_WAKEUPGPIO;
+	else if(strstr(command, ESP8266_AT_GSLP) != NULL)
+		command = ESP8266_AT_GSLP;
+	else if(strstr(command, ESP8266_AT_CIPSTA_CUR) != NULL)
+		command = ESP8266_AT_CIPSTA_CUR;
+	else if(strstr(command, ESP8266_AT_CIPDOMAIN) != NULL)
+		command = ESP8266_AT_CIPDOMAIN;
 
 	KEYS return_type = hash(command);
 	switch (return_type) {
@@ -236,6 +1013,24 @@ get_return(const char* command){
 		case ESP8266_AT_CIPMUX_KEY:
 
 		case ESP8266_AT_CWQAP_KEY:
+
+		case ESP8266_AT_CIPMODE_PASSTHROUGH_KEY:
+
+		case ESP8266_AT_CIPMODE_NORMAL_KEY:
+
+		case ESP8266_AT_SEND_PASSTHROUGH_KEY:
+
+		case ESP8266_AT_UART_CUR_KEY:
+
+		case ESP8266_AT_SLEEP_KEY:
+
+		case ESP8266_AT_WAKEUPGPIO_KEY:
+
+		case ESP8266_AT_GSLP_KEY:
+
+		case ESP8266_AT_CIPSTA_CUR_KEY:
+
+		case ESP8266_AT_CIPDOMAIN_KEY:
 			return evaluate();
 
 		case ESP8266_AT_CWMODE_TEST_KEY:
@@ -289,8 +1084,10 @@ get_return(const char* command){
 			}
 
 		case ESP8266_AT_START_KEY:
-			if(error_flag || fail_flag)
+			/* The old connection is still open, ALREADY CONNECTED comes with ERROR but the link can be used */
+			if((error_flag || fail_flag) && strstr(rx_buffer, ESP8266_AT_ALREADY_CONNECTED) == NULL)
 				return ESP8266_AT_ERROR;
+			link_closed_flag = false;
 			return ESP8266_AT_CONNECT;
 
 		case ESP8266_AT_SEND_KEY:
@@ -298,6 +1095,16 @@ get_return(const char* command){
 				return ESP8266_AT_ERROR;
 			return ESP8266_AT_SEND_OK;
 
+		case ESP8266_AT_CIPSTATUS_KEY:
+			if(error_flag || fail_flag)
+				return ESP8266_AT_ERROR;
+			else {
+				if (strstr(rx_buffer, ESP8266_AT_STATUS_3) != NULL)
+					return ESP8266_AT_CONNECT;
+				else
+					return ESP8266_AT_CLOSED;
+			}
+
 		default:
 			return ESP8266_NOT_IMPLEMENTED;
 			break;
@@ -0,0 +1,109 @@
+/**
+******************************************************************************
+@brief functions for the CBOR encoding of sensor readings
+@details Every item starts with an initial byte, the major type in the upper
+		 3 bits and the argument in the lower 5. Arguments below 24 are stored
+		 in the initial byte, larger ones follow it big endian in 1, 2 or 4
+		 bytes. See RFC 8949, https://www.rfc-editor.org/rfc/rfc8949.html
+
+@file cbor.c
+@version 1.0
+*******************************************************************************/
+#include "cbor.h"
+
+/* Writes the initial byte and the argument in as few bytes as possible */
+static void
+put_head(CBOR_WRITER* writer, uint8_t type, uint32_t arg){
+	uint8_t  head[5];
+	uint8_t  len;
+
+	if(arg < CBOR_ARG_8){
+		head[0] = type | arg;
+		len = 1;
+	}
+	else if(arg <= 0xFF){
+		head[0] = type | CBOR_ARG_8;
+		head[1] = arg;
+		len = 2;
+	}
+	else if(arg <= 0xFFFF){
+		head[0] = type | CBOR_ARG_16;
+		head[1] = arg >> 8;
+		head[2] = arg & 0xFF;
+		len = 3;
+	}
+	else {
+		head[0] = type | CBOR_ARG_32;
+		head[1] = arg >> 24;
+		head[2] = (arg >> 16) & 0xFF;
+		head[3] = (arg >> 8) & 0xFF;
+		head[4] = arg & 0xFF;
+		len = 5;
+	}
+
+	if(writer->overflow || writer->len + len > writer->size){
+		writer->overflow = true;
+		return;
+	}
+	for(uint8_t i = 0; i < len; i++)
+		writer->buffer[writer->len++] = head[i];
+}
+
+void
+cbor_writer_init(CBOR_WRITER* writer, uint8_t* buffer, uint16_t size){
+	writer->buffer	 = buffer;
+	writer->size	 = size;
+	writer->len		 = 0;
+	writer->overflow = false;
+}
+
+void
+cbor_put_uint(CBOR_WRITER* writer, uint32_t value){
+	put_head(writer, CBOR_UINT, value);
+}
+
+void
+cbor_put_int(CBOR_WRITER* writer, int32_t value){
+	/* A negative integer n is stored as -1 - n */
+	if(value < 0)
+		put_head(writer, CBOR_NEGINT, (uint32_t) (-1 - value));
+	else
+		put_head(writer, CBOR_UINT, value);
+}
+
+void
+cbor_put_array(CBOR_WRITER* writer, uint16_t count){
+	put_head(writer, CBOR_ARRAY, count);
+}
+
+int32_t
+cbor_fixed(float value){
+	return (int32_t) (value * CBOR_FIXED_SCALE + ((value < 0) ? -0.5f : 0.5f));
+}
+
+void
+cbor_put_reading(CBOR_WRITER* writer, uint16_t co2, uint16_t tvoc, float temperature, float humidity){
+	cbor_put_array(writer, CBOR_READING_SIZE);
+	cbor_put_uint (writer, co2);
+	cbor_put_uint (writer, tvoc);
+	cbor_put_int  (writer, cbor_fixed(temperature));
+	cbor_put_int  (writer, cbor_fixed(humidity));
+}
+
+void
+cbor_put_batch(CBOR_WRITER* writer, uint32_t now, uint32_t first, uint16_t count){
+	cbor_put_array(writer, CBOR_BATCH_SIZE);
+	cbor_put_uint (writer, now);
+	cbor_put_uint (writer, first);
+	cbor_put_array(writer, count);
+}
+
+void
+cbor_put_sample(CBOR_WRITER* writer, uint32_t delta, uint16_t co2, uint16_t tvoc, float temperature, float humidity){
+	cbor_put_array(writer, CBOR_SAMPLE_SIZE);
+	cbor_put_uint (writer, delta);
+	cbor_put_uint (writer, co2);
+	cbor_put_uint (writer, tvoc);
+	cbor_put_int  (writer, cbor_fixed(temperature));
+	cbor_put_int  (writer, cbor_fixed(humidity));
+}
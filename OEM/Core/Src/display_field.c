@@ -0,0 +1,60 @@
+/**
+******************************************************************************
+@brief functions for text fields at fixed places on the display
+@details The text of a field is kept padded to its size, so a new text is
+		 compared with it cell by cell. A changed cell is drawn with
+		 display_write_char, which only marks the bytes it changes as dirty.
+		 The position of the display is kept as it was, so fields can be
+		 set between other writes.
+
+@file display_field.c
+@version 1.0
+*******************************************************************************/
+#include "display_field.h"
+#include <stdbool.h>
+#include <string.h>
+
+void
+display_field_init(DISPLAY_FIELD* field, uint16_t x, uint16_t y, FontId font, uint8_t size){
+	field->x	= x;
+	field->y	= y;
+	field->font = (font < FONT_COUNT) ? font : FONT_SMALL;
+	field->size = (size < DISPLAY_FIELD_SIZE) ? size : DISPLAY_FIELD_SIZE;
+	display_field_invalidate(field);
+}
+
+void
+display_field_invalidate(DISPLAY_FIELD* field){
+	/* A canvas that differs from the current one, so every cell is drawn */
+	field->canvas = display_get_canvas() - 1;
+	memset(field->text, 0, sizeof(field->text));
+}
+
+uint8_t
+display_field_set(DISPLAY_FIELD* field, const char* text){
+	const FontDef* font = Fonts[field->font];
+	uint16_t x = display_get_x();
+	uint16_t y = display_get_y();
+	uint8_t drawn = 0;
+	bool ended = false;
+
+	if(field->canvas != display_get_canvas()){
+		memset(field->text, 0, sizeof(field->text));
+		field->canvas = display_get_canvas();
+	}
+
+	for(uint8_t i = 0; i < field->size; i++){
+		if(text[i] == '\0')
+			ended = true;
+		char c = ended ? ' ' : text[i];
+		if(c == field->text[i])
+			continue;
+
+		display_set_position(field->x + i * font->FontWidth, field->y);
+		display_write_char(c, *font, WHITE);
+		field->text[i] = c;
+		drawn++;
+	}
+	display_set_position(x, y);
+	return drawn;
+}
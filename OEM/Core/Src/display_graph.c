@@ -0,0 +1,150 @@
+/**
+******************************************************************************
+@brief functions for history graphs on the display
+@details A value is turned into a row of the plot with the scale of the
+		 graph, the bottom row for min and the top row for max. A column of
+		 the line style is white from the row of the value before to the row
+		 of its own value, so steep changes stay connected. Every column is
+		 drawn with display_draw_column, a byte per page of the plot.
+
+@file display_graph.c
+@version 1.0
+*******************************************************************************/
+#include "display_graph.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Largest multiple of step not above value, also for negative values */
+static int16_t
+round_down(int16_t value, int16_t step){
+	int16_t rest = value % step;
+	return (rest < 0) ? value - rest - step : value - rest;
+}
+
+static int16_t
+round_up(int16_t value, int16_t step){
+	int16_t down = round_down(value, step);
+	return (down == value) ? value : down + step;
+}
+
+/* The value added age values ago, 0 is the newest */
+static int16_t
+value_at(const DISPLAY_GRAPH* graph, uint8_t age){
+	return graph->values[(graph->head + DISPLAY_GRAPH_SIZE - 1 - age) % DISPLAY_GRAPH_SIZE];
+}
+
+static uint8_t
+shown(const DISPLAY_GRAPH* graph){
+	return (graph->count < graph->width) ? graph->count : graph->width;
+}
+
+static uint8_t
+row_of(const DISPLAY_GRAPH* graph, int16_t value){
+	int32_t offset = (int32_t) (value - graph->min) * (graph->height - 1) / (graph->max - graph->min);
+	return graph->y + graph->height - 1 - offset;
+}
+
+/* Draws the column of the value of the given age, empty if there is none */
+static void
+draw_column(const DISPLAY_GRAPH* graph, uint8_t age){
+	uint8_t x = graph->x + graph->width - 1 - age;
+
+	if(age >= graph->count){
+		display_draw_column(x, graph->y, graph->height, 1, 0);
+		return;
+	}
+
+	uint8_t row = row_of(graph, value_at(graph, age));
+	if(graph->style == DISPLAY_GRAPH_BARS){
+		display_draw_column(x, graph->y, graph->height, row, graph->y + graph->height - 1);
+		return;
+	}
+	uint8_t before = (age + 1 < graph->count) ? row_of(graph, value_at(graph, age + 1)) : row;
+	display_draw_column(x, graph->y, graph->height, (before < row) ? before : row, (before < row) ? row : before);
+}
+
+/* The scale of the values shown, returns true if it differs from the one drawn */
+static bool
+rescale(DISPLAY_GRAPH* graph, int16_t* min, int16_t* max){
+	int16_t low = value_at(graph, 0);
+	int16_t high = low;
+
+	for(uint8_t age = 1; age < shown(graph); age++){
+		int16_t value = value_at(graph, age);
+		if(value < low)
+			low = value;
+		if(value > high)
+			high = value;
+	}
+	*min = round_down(low, graph->step);
+	*max = round_up(high, graph->step);
+	if(*max == *min)
+		*max += graph->step;
+	return *min != graph->min || *max != graph->max;
+}
+
+static void
+set_label(DISPLAY_FIELD* label, int16_t value, int16_t divisor){
+	char text[8];
+
+	/* The field cuts what does not fit */
+	snprintf(text, sizeof(text), "%4d", value / divisor);
+	display_field_set(label, text);
+}
+
+void
+display_graph_init(DISPLAY_GRAPH* graph, uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+				   DISPLAY_GRAPH_STYLE style, int16_t step, int16_t divisor){
+	memset(graph, 0, sizeof(*graph));
+	graph->x	   = x;
+	graph->y	   = y;
+	graph->width   = (width < DISPLAY_GRAPH_SIZE) ? width : DISPLAY_GRAPH_SIZE;
+	graph->height  = height;
+	graph->style   = style;
+	graph->step	   = (step > 0) ? step : 1;
+	graph->divisor = (divisor > 0) ? divisor : 1;
+	display_field_init(&graph->max_label, x - DISPLAY_GRAPH_LABEL_WIDTH, y, FONT_SMALL, DISPLAY_GRAPH_LABEL_SIZE);
+	display_field_init(&graph->min_label, x - DISPLAY_GRAPH_LABEL_WIDTH, y + height - Font_7x10.FontHeight,
+					   FONT_SMALL, DISPLAY_GRAPH_LABEL_SIZE);
+}
+
+void
+display_graph_add(DISPLAY_GRAPH* graph, int16_t value){
+	graph->values[graph->head] = value;
+	graph->head = (graph->head + 1) % DISPLAY_GRAPH_SIZE;
+	if(graph->count < DISPLAY_GRAPH_SIZE)
+		graph->count++;
+	if(graph->added < graph->width)
+		graph->added++;
+}
+
+uint8_t
+display_graph_draw(DISPLAY_GRAPH* graph){
+	int16_t min, max;
+	uint8_t columns;
+
+	if(graph->count == 0)
+		return 0;
+
+	if(rescale(graph, &min, &max) || !graph->drawn || graph->canvas != display_get_canvas() || graph->added >= graph->width){
+		/* Everything, with the new scale */
+		graph->min	  = min;
+		graph->max	  = max;
+		graph->canvas = display_get_canvas();
+		graph->drawn  = true;
+		columns = graph->width;
+		set_label(&graph->max_label, max, graph->divisor);
+		set_label(&graph->min_label, min, graph->divisor);
+	}
+	else {
+		/* The plot moves left and the new values come in on the right */
+		columns = graph->added;
+		if(columns > 0)
+			display_scroll_left(graph->x, graph->width, graph->y, graph->height, columns);
+	}
+
+	for(uint8_t age = 0; age < columns; age++)
+		draw_column(graph, age);
+	graph->added = 0;
+	return columns;
+}
@@ -44,6 +44,29 @@ void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 2 */
+/* ESP8266 wake and reset lines, open drain and released (high) when idle
+   PA4     ------> ESP8266 GPIO0, pulled low to wake from light sleep
+   PB0     ------> ESP8266 RST, pulsed low to wake from deep sleep
+*/
+void esp8266_gpio_init(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+
+  HAL_GPIO_WritePin(ESP_WAKE_GPIO_Port, ESP_WAKE_Pin, GPIO_PIN_SET);
+  HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_SET);
+
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  GPIO_InitStruct.Pin = ESP_WAKE_Pin;
+  HAL_GPIO_Init(ESP_WAKE_GPIO_Port, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = ESP_RST_Pin;
+  HAL_GPIO_Init(ESP_RST_GPIO_Port, &GPIO_InitStruct);
+}
 
 /* USER CODE END 2 */
 
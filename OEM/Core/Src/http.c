@@ -0,0 +1,203 @@
+/**
+******************************************************************************
+@brief functions for the streaming HTTP response parser
+@details The parser is a state machine that takes one byte at a time. The
+		 status line, the headers and the chunk sizes are collected into a
+		 line buffer and handled when the line ends, body bytes are stored
+		 directly. Nothing blocks, so http_response_feed can be called from
+		 the uart receive interrupt. See RFC 9112 for the message format,
+		 https://www.rfc-editor.org/rfc/rfc9112.html
+
+@file http.c
+@version 1.0
+*******************************************************************************/
+#include "http.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+/* Header names, compared without case */
+static const char CONTENT_LENGTH[]		= "Content-Length:";
+static const char TRANSFER_ENCODING[]	= "Transfer-Encoding:";
+static const char CONNECTION[]			= "Connection:";
+
+/* Returns the value of the header if the line is that header, with the leading spaces skipped */
+static const char*
+header_value(const char* line, const char* name){
+	uint8_t len = strlen(name);
+	if(strncasecmp(line, name, len) != 0)
+		return NULL;
+	line += len;
+	while(*line == ' ' || *line == '\t')
+		line++;
+	return line;
+}
+
+static void
+store_body(HTTP_RESPONSE* response, char c){
+	if(response->body_len < HTTP_BODY_SIZE){
+		response->body[response->body_len++] = c;
+		response->body[response->body_len] = '\0';
+	}
+	response->body_received++;
+}
+
+/* Decides how the body is sent, once all headers are read */
+static void
+headers_end(HTTP_RESPONSE* response){
+
+	/* 100 Continue is followed by the real response */
+	if(response->status < 200){
+		response->status		 = 0;
+		response->content_length = -1;
+		response->chunked		 = false;
+		response->state			 = HTTP_PARSE_STATUS;
+	}
+	/* No body */
+	else if(response->status == 204 || response->status == 304)
+		response->state = HTTP_PARSE_DONE;
+	else if(response->chunked)
+		response->state = HTTP_PARSE_CHUNK_SIZE;
+	else if(response->content_length == 0)
+		response->state = HTTP_PARSE_DONE;
+	else {
+		/* Without Content-Length the body ends when the connection is closed */
+		response->remaining = response->content_length;
+		response->state		= HTTP_PARSE_BODY;
+	}
+}
+
+static void
+handle_line(HTTP_RESPONSE* response){
+	const char* line = response->line;
+	const char* value;
+	char* end;
+
+	switch(response->state){
+		case HTTP_PARSE_STATUS:
+			/* HTTP/1.1 200 OK */
+			if(strncmp(line, "HTTP/1.", 7) != 0 || response->line_len < 12 || line[8] != ' '){
+				response->state = HTTP_PARSE_ERROR;
+				break;
+			}
+			response->status = strtoul(&line[9], NULL, 10);
+			response->state	 = (response->status >= 100 && response->status < 600) ? HTTP_PARSE_HEADERS : HTTP_PARSE_ERROR;
+			break;
+
+		case HTTP_PARSE_HEADERS:
+			if(response->line_len == 0)
+				headers_end(response);
+			else if((value = header_value(line, CONTENT_LENGTH)) != NULL)
+				response->content_length = strtol(value, NULL, 10);
+			else if((value = header_value(line, TRANSFER_ENCODING)) != NULL)
+				response->chunked = (strstr(value, "chunked") != NULL);
+			else if((value = header_value(line, CONNECTION)) != NULL)
+				response->connection_close = (strncasecmp(value, "close", 5) == 0);
+			break;
+
+		case HTTP_PARSE_CHUNK_SIZE:
+			/* Size in hex, maybe followed by ;extensions */
+			response->remaining = strtoul(line, &end, 16);
+			if(end == line)
+				response->state = HTTP_PARSE_ERROR;
+			else
+				response->state = (response->remaining == 0) ? HTTP_PARSE_TRAILER : HTTP_PARSE_CHUNK_DATA;
+			break;
+
+		case HTTP_PARSE_CHUNK_END:
+			response->state = (response->line_len == 0) ? HTTP_PARSE_CHUNK_SIZE : HTTP_PARSE_ERROR;
+			break;
+
+		case HTTP_PARSE_TRAILER:
+			if(response->line_len == 0)
+				response->state = HTTP_PARSE_DONE;
+			break;
+
+		default:
+			break;
+	}
+}
+
+void
+http_response_init(HTTP_RESPONSE* response){
+	memset(response, 0, sizeof(HTTP_RESPONSE));
+	response->state			 = HTTP_PARSE_STATUS;
+	response->content_length = -1;
+}
+
+HTTP_PARSE_STATE
+http_response_feed(HTTP_RESPONSE* response, char c){
+
+	switch(response->state){
+		case HTTP_PARSE_BODY:
+			store_body(response, c);
+			if(response->content_length >= 0 && --response->remaining == 0)
+				response->state = HTTP_PARSE_DONE;
+			break;
+
+		case HTTP_PARSE_CHUNK_DATA:
+			store_body(response, c);
+			if(--response->remaining == 0)
+				response->state = HTTP_PARSE_CHUNK_END;
+			break;
+
+		case HTTP_PARSE_DONE:
+		case HTTP_PARSE_ERROR:
+			break;
+
+		default:
+			/* Line based states, a line ends with \r\n */
+			if(c == '\n'){
+				response->line[response->line_len] = '\0';
+				handle_line(response);
+				response->line_len = 0;
+			}
+			else if(c != '\r' && response->line_len < HTTP_LINE_SIZE - 1)
+				response->line[response->line_len++] = c;
+			break;
+	}
+	return response->state;
+}
+
+HTTP_PARSE_STATE
+http_response_feed_data(HTTP_RESPONSE* response, const char* data, uint16_t len){
+	for(uint16_t i = 0; i < len; i++)
+		http_response_feed(response, data[i]);
+	return response->state;
+}
+
+HTTP_PARSE_STATE
+http_response_finish(HTTP_RESPONSE* response){
+	if(response->state == HTTP_PARSE_BODY && response->content_length < 0)
+		response->state = HTTP_PARSE_DONE;
+	else if(response->state != HTTP_PARSE_DONE)
+		response->state = HTTP_PARSE_ERROR;
+	return response->state;
+}
+
+bool
+http_response_done(const HTTP_RESPONSE* response){
+	return response->state == HTTP_PARSE_DONE || response->state == HTTP_PARSE_ERROR;
+}
+
+bool
+http_form_value(const char* body, const char* key, int32_t* value){
+	uint8_t len = strlen(key);
+	char* end;
+
+	while(*body != '\0'){
+		if(strncmp(body, key, len) == 0 && body[len] == '='){
+			long number = strtol(&body[len + 1], &end, 10);
+			if(end == &body[len + 1] || (*end != '\0' && *end != '&' && *end != '\r' && *end != '\n'))
+				return false;
+			*value = number;
+			return true;
+		}
+
+		/* Next pair */
+		body += strcspn(body, "&\n");
+		if(*body != '\0')
+			body++;
+	}
+	return false;
+}
@@ -0,0 +1,196 @@
+/**
+******************************************************************************
+@brief functions for the MQTT 3.1.1 client
+@details Packets are encoded into a static buffer, and sent over the TCP
+		 connection of the ESP8266 with esp8266_send_large_data. Acknowledgements
+		 from the broker are read from the +IPD messages with esp8266_receive.
+		 See the MQTT 3.1.1 specification for the packet formats,
+		 http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/mqtt-v3.1.1.html
+
+@file mqtt.c
+@version 1.0
+*******************************************************************************/
+#include "mqtt.h"
+#include "ESP8266.h"
+
+/* Global variables */
+static uint8_t  mqtt_tx_buffer[MQTT_BUFFER_SIZE];
+static uint8_t  mqtt_rx_buffer[8];
+static uint16_t packet_id_counter = 0;
+static uint32_t last_sent = 0;		// tick of the last packet sent, used for keep alive
+static bool		connected = false;
+
+/* Writes the remaining length as a variable byte integer, returns the number of bytes used */
+static uint8_t
+encode_remaining_length(uint8_t* buffer, uint32_t len){
+	uint8_t i = 0;
+	do {
+		uint8_t byte = len % 128;
+		len /= 128;
+		if(len > 0)
+			byte |= 0x80;
+		buffer[i++] = byte;
+	} while (len > 0);
+	return i;
+}
+
+/* Writes a string prefixed with its 16 bit length, returns the number of bytes used */
+static uint16_t
+encode_string(uint8_t* buffer, const char* str){
+	uint16_t len = strlen(str);
+	buffer[0] = len >> 8;
+	buffer[1] = len & 0xFF;
+	memcpy(&buffer[2], str, len);
+	return len + 2;
+}
+
+/* Space needed for the fixed header of a packet with the given remaining length */
+static uint16_t
+fixed_header_size(uint32_t remaining){
+	return 1 + ((remaining < 128) ? 1 : (remaining < 16384) ? 2 : 3);
+}
+
+uint16_t
+mqtt_encode_connect(uint8_t* buffer, uint16_t size, const char* client_id, uint16_t keep_alive){
+
+	/* protocol name (6) + level (1) + flags (1) + keep alive (2) + client id */
+	uint32_t remaining = 10 + 2 + strlen(client_id);
+	if(fixed_header_size(remaining) + remaining > size)
+		return 0;
+
+	uint16_t i = 0;
+	buffer[i++] = MQTT_CONNECT;
+	i += encode_remaining_length(&buffer[i], remaining);
+	i += encode_string(&buffer[i], "MQTT");
+	buffer[i++] = 0x04;						// protocol level 4 is MQTT 3.1.1
+	buffer[i++] = 0x02;						// clean session
+	buffer[i++] = keep_alive >> 8;
+	buffer[i++] = keep_alive & 0xFF;
+	i += encode_string(&buffer[i], client_id);
+	return i;
+}
+
+uint16_t
+mqtt_encode_publish(uint8_t* buffer, uint16_t size, const char* topic, const uint8_t* payload,
+					uint16_t payload_len, uint8_t qos, uint16_t packet_id){
+
+	uint32_t remaining = 2 + strlen(topic) + ((qos > 0) ? 2 : 0) + payload_len;
+	if(qos > 1 || fixed_header_size(remaining) + remaining > size)
+		return 0;
+
+	uint16_t i = 0;
+	buffer[i++] = MQTT_PUBLISH | (qos << 1);
+	i += encode_remaining_length(&buffer[i], remaining);
+	i += encode_string(&buffer[i], topic);
+	if(qos > 0){
+		buffer[i++] = packet_id >> 8;
+		buffer[i++] = packet_id & 0xFF;
+	}
+	memcpy(&buffer[i], payload, payload_len);
+	return i + payload_len;
+}
+
+uint16_t
+mqtt_encode_empty(uint8_t* buffer, uint16_t size, uint8_t type){
+	if(size < 2)
+		return 0;
+	buffer[0] = type;
+	buffer[1] = 0x00;
+	return 2;
+}
+
+MQTT_STATUS
+mqtt_check_ack(const uint8_t* packet, uint16_t len, uint8_t type, uint16_t packet_id){
+
+	if(len < 2 || packet[0] != type)
+		return MQTT_NO_ACK;
+
+	switch (type) {
+
+		case MQTT_CONNACK:
+			if(len < 4 || packet[1] != 0x02)
+				return MQTT_NO_ACK;
+			return (packet[3] == 0x00) ? MQTT_SUCCESS : MQTT_REFUSED;
+
+		case MQTT_PUBACK:
+			if(len < 4 || packet[1] != 0x02)
+				return MQTT_NO_ACK;
+			return (((packet[2] << 8) | packet[3]) == packet_id) ? MQTT_SUCCESS : MQTT_NO_ACK;
+
+		case MQTT_PINGRESP:
+			return (packet[1] == 0x00) ? MQTT_SUCCESS : MQTT_NO_ACK;
+
+		default:
+			return MQTT_NO_ACK;
+	}
+}
+
+/* Sends the packet in the tx buffer, and waits for the acknowledgement if ack_type is not 0 */
+static MQTT_STATUS
+mqtt_transfer(uint16_t len, uint8_t ack_type, uint16_t packet_id){
+
+	if(len == 0)
+		return MQTT_BUFFER_OVERFLOW;
+
+	if(strcmp(esp8266_send_large_data((const char*) mqtt_tx_buffer, len), ESP8266_AT_SEND_OK) != 0){
+		connected = false;
+		return MQTT_ERROR;
+	}
+	last_sent = HAL_GetTick();
+
+	if(ack_type == 0)
+		return MQTT_SUCCESS;
+
+	uint16_t received = esp8266_receive(mqtt_rx_buffer, sizeof(mqtt_rx_buffer), MQTT_ACK_TIMEOUT);
+	MQTT_STATUS status = mqtt_check_ack(mqtt_rx_buffer, received, ack_type, packet_id);
+
+	/* The broker did not answer, so the session is treated as lost and the next publish connects again */
+	if(status == MQTT_NO_ACK)
+		connected = false;
+	return status;
+}
+
+MQTT_STATUS
+mqtt_connect(const char* client_id){
+	uint16_t len = mqtt_encode_connect(mqtt_tx_buffer, MQTT_BUFFER_SIZE, client_id, MQTT_KEEP_ALIVE);
+	MQTT_STATUS status = mqtt_transfer(len, MQTT_CONNACK, 0);
+	connected = (status == MQTT_SUCCESS);
+	return status;
+}
+
+MQTT_STATUS
+mqtt_publish(const char* topic, const char* payload, uint16_t payload_len, uint8_t qos){
+
+	/* Packet identifier 0 is not allowed */
+	if(++packet_id_counter == 0)
+		packet_id_counter = 1;
+
+	uint16_t len = mqtt_encode_publish(mqtt_tx_buffer, MQTT_BUFFER_SIZE, topic, (const uint8_t*) payload,
+									   payload_len, qos, packet_id_counter);
+	return mqtt_transfer(len, (qos > 0) ? MQTT_PUBACK : 0, packet_id_counter);
+}
+
+MQTT_STATUS
+mqtt_ping(void){
+	uint16_t len = mqtt_encode_empty(mqtt_tx_buffer, MQTT_BUFFER_SIZE, MQTT_PINGREQ);
+	return mqtt_transfer(len, MQTT_PINGRESP, 0);
+}
+
+MQTT_STATUS
+mqtt_keep_alive(void){
+	if(!connected || (HAL_GetTick() - last_sent) < (MQTT_KEEP_ALIVE * 1000 / 2))
+		return MQTT_SUCCESS;
+	return mqtt_ping();
+}
+
+MQTT_STATUS
+mqtt_disconnect(void){
+	uint16_t len = mqtt_encode_empty(mqtt_tx_buffer, MQTT_BUFFER_SIZE, MQTT_DISCONNECT);
+	connected = false;
+	return mqtt_transfer(len, 0, 0);
+}
+
+bool
+mqtt_connected(void){
+	return connected;
+}
@@ -13,7 +13,74 @@
 
 #include "office_environment_monitor.h"
 
-#define CCS811_BME280_SEND_INTERVAL 30
+#define CCS811_BME280_SEND_INTERVAL 30		// samples between uploads
+#define CCS811_BME280_BATCH_SIZE	30		// max samples posted in one request
+#define CCS811_DRIVE_MODE			1		// measurement each second, see CCS811_write_mode
+#define SAMPLE_BUFFER_SIZE			120		// samples kept while waiting for an upload
+#define HISTORY_INTERVAL			60000	// ms between the points of the history graphs, a column is a minute
+#define SCREEN_READINGS_TIME		20000	// ms the readings are shown before the history, 0 to only show the readings
+#define SCREEN_HISTORY_TIME			10000	// ms the history graphs are shown
+#define SAMPLE_ROW_SIZE				48		// max length of one formatted sample in the batch body
+
+/* MQTT settings, used with UPLOAD_TRANSPORT_MQTT. The broker is set in login.h, with MQTT_BROKER_HOST
+ * and optionally MQTT_BROKER_PORT and MQTT_CLIENT_ID. Without MQTT_CLIENT_ID the id is made from the
+ * unique id of the STM32, a broker drops the client when another one connects with the same id */
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT && !defined(MQTT_BROKER_HOST)
+#error "UPLOAD_TRANSPORT_MQTT needs MQTT_BROKER_HOST, define it in login.h"
+#endif
+#ifndef MQTT_BROKER_PORT
+#define MQTT_BROKER_PORT			"1883"
+#endif
+#define MQTT_TOPIC_SAMPLES			"oem/samples"		// every sample as csv or cbor, qos 1
+#define MQTT_TOPIC_CO2				"oem/co2"			// latest value, qos 0
+#define MQTT_TOPIC_TVOC				"oem/tvoc"
+#define MQTT_TOPIC_TEMPERATURE		"oem/temperature"
+#define MQTT_TOPIC_HUMIDITY			"oem/humidity"
+
+/* UDP settings, used with UPLOAD_TRANSPORT_UDP.
+ * One datagram is sent per batch, for one datagram per sample set
+ * CCS811_BME280_SEND_INTERVAL and CCS811_BME280_BATCH_SIZE to 1.
+ *
+ * Datagram format, all values big endian:
+ * uint32 sequence number, increased by one per datagram so the collector can count lost datagrams
+ * uint32 current tick in ms
+ * uint8  number of samples
+ * then per sample:
+ * uint32 age of the sample in ms, current tick - sample tick
+ * uint16 co2 in ppm
+ * uint16 tvoc in ppb
+ * int16  temperature in 0.01 degrees celsius
+ * uint16 humidity in 0.01 %
+ */
+#define UDP_COLLECTOR_HOST			"ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net"
+#define UDP_COLLECTOR_PORT			"5005"
+#define UDP_HEADER_SIZE				9
+#define UDP_SAMPLE_SIZE				12
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_UDP && (UDP_HEADER_SIZE + CCS811_BME280_BATCH_SIZE * UDP_SAMPLE_SIZE) > ESP8266_CIPSEND_MAX
+#error "A udp batch has to fit in one AT+CIPSEND, lower CCS811_BME280_BATCH_SIZE"
+#endif
+
+/* ESP8266 power settings.
+ * Modem sleep needs no wiring and keeps the uart usable, light sleep needs ESP_WAKE_Pin and deep
+ * sleep needs ESP_RST_Pin, see gpio.c. Deep sleep restarts the module, so every upload needs a new connection.
+ * Wake ups are started early enough to finish before the upload, counted in samples of the current drive mode.
+ */
+#define ESP8266_SLEEP_BETWEEN_UPLOADS	ESP8266_SLEEP_MODEM
+#define ESP8266_WAKE_MARGIN				1		// samples of pre-wake added on top of the longest wake up
+
+/* Typical currents from the ESP8266 datasheet in uA, used to estimate the charge used per cycle */
+#define ESP8266_CURRENT_AWAKE			70000
+#define ESP8266_CURRENT_MODEM_SLEEP		15000
+#define ESP8266_CURRENT_LIGHT_SLEEP		900
+#define ESP8266_CURRENT_DEEP_SLEEP		20
+
+/* Settings the server can send back in the body of a http answer, e.g. interval=60&batch=20&drive_mode=2.
+ * The defines above are the values used until the server has sent anything. */
+#define SERVER_SETTING_INTERVAL			"interval"		// samples between uploads, 1 to UPLOAD_INTERVAL_MAX
+#define SERVER_SETTING_BATCH			"batch"			// max samples per request, 1 to CCS811_BME280_BATCH_SIZE
+#define SERVER_SETTING_DRIVE_MODE		"drive_mode"	// CCS811 drive mode, 1 to 3
+#define UPLOAD_INTERVAL_MAX				3600
 
 /* Current return statuses */
 static RETURN_STATUS 	 current_status;			// return status for functions within this program
@@ -24,6 +91,85 @@ static const char* esp8266_return_string;
 static float	 		 temperature;
 static float			 humidity;
 
+/* Upload connection, kept open between uploads */
+static bool				 web_connected = false;
+static UPLOAD_STATS		 upload_stats;
+
+/* Settings, can be changed by the server */
+static uint16_t			 upload_interval = CCS811_BME280_SEND_INTERVAL;
+static uint16_t			 batch_size		 = CCS811_BME280_BATCH_SIZE;
+static uint8_t			 drive_mode		 = CCS811_DRIVE_MODE;	// last mode the CCS811 sampled in
+static uint8_t			 drive_mode_pending = 0;	// slower mode from the server, 0 if none
+static bool				 drive_mode_idle = false;	// the CCS811 is in mode 0 before the pending mode
+static uint32_t			 drive_mode_idle_since = 0;
+static uint32_t			 drive_mode_slowdowns = 0;	// idle periods started, for the rate limit
+
+/* Upload recovery state */
+static uint8_t			 upload_failures = 0;		// failed uploads in a row
+static uint32_t			 upload_retry_at = 0;		// tick of the next attempt after a failure
+static uint32_t			 jitter_state = 0;			// xorshift state for the backoff jitter
+
+/* ESP8266 power state */
+static POWER_STATS		 power_stats;
+static uint32_t			 power_state_since = 0;		// tick of the last sleep or wake up
+static uint64_t			 power_cycle_charge = 0;	// uA * ms used so far in this cycle
+static uint32_t			 wake_started = 0;			// tick the current wake up was started, 0 if none
+
+/* Samples waiting to be uploaded, oldest sample at sample_head */
+static SAMPLE			 sample_buffer[SAMPLE_BUFFER_SIZE];
+static uint16_t			 sample_head  = 0;
+static uint16_t			 sample_count = 0;
+
+/* Fields of show_measurements. The CO2 digits start on a page boundary so every digit is whole bytes
+ * of the display, the small chars next to them end on the same row. Labels are fields that never
+ * change, so they are drawn again after the screen has been cleared. */
+typedef enum {
+	FIELD_TEMP, FIELD_HUM, FIELD_CO2, FIELD_TVOC,
+	LABEL_TEMP, LABEL_HUM, LABEL_CO2, LABEL_CO2_UNIT, LABEL_TVOC, LABEL_TVOC_UNIT,
+	MEASUREMENT_FIELDS
+} MEASUREMENT_FIELD;
+
+static const struct {
+	uint16_t	x;
+	uint16_t	y;
+	FontId		font;
+	const char*	label;					// text of a label, NULL for a reading
+} measurement_layout[MEASUREMENT_FIELDS] = {
+	[FIELD_TEMP]	  = { 1,	1,	FONT_SMALL, NULL },
+	[FIELD_HUM]		  = { 57,	1,	FONT_SMALL, NULL },
+	[FIELD_CO2]		  = { 29,	16, FONT_LARGE, NULL },
+	[FIELD_TVOC]	  = { 36,	38, FONT_SMALL, NULL },
+	[LABEL_TEMP]	  = { 36,	1,	FONT_SMALL, "C" },
+	[LABEL_HUM]		  = { 92,	1,	FONT_SMALL, "%RH" },
+	[LABEL_CO2]		  = { 1,	24, FONT_SMALL, "CO2" },
+	[LABEL_CO2_UNIT]  = { 101,	24, FONT_SMALL, "ppm" },
+	[LABEL_TVOC]	  = { 1,	38, FONT_SMALL, "tVoc" },
+	[LABEL_TVOC_UNIT] = { 71,	38, FONT_SMALL, "ppb" }
+};
+#define MEASUREMENT_DIGITS			5		// cells of a reading
+
+static DISPLAY_FIELD	 measurement_fields[MEASUREMENT_FIELDS];
+static bool				 measurement_fields_ready = false;
+
+/* History graphs, CO2 over temperature, the labels of the scale and the unit left of each */
+#define HISTORY_PLOT_X				(DISPLAY_GRAPH_LABEL_WIDTH + 1)
+#define HISTORY_PLOT_WIDTH			(W - HISTORY_PLOT_X)
+#define HISTORY_PLOT_HEIGHT			(H / 2)
+#define HISTORY_UNIT_Y				((HISTORY_PLOT_HEIGHT - ROW_SIZE) / 2 + 1)
+
+static DISPLAY_GRAPH	 co2_history;
+static DISPLAY_GRAPH	 temperature_history;
+static DISPLAY_FIELD	 history_units[2];
+static bool				 history_ready = false;
+static uint32_t			 history_at = 0;			// tick of the last point
+static bool				 history_shown = false;		// screen of show_screen
+static uint32_t			 screen_since = 0;
+
+#if UPLOAD_TRANSPORT != UPLOAD_TRANSPORT_UDP
+/* Batch body buffer, too large for the stack */
+static char				 batch_body   [CCS811_BME280_BATCH_SIZE * SAMPLE_ROW_SIZE + 64];
+#endif
+
 void office_environment_monitor(void){
 
 	/* Initiate display, if the init fails, leds will flash and it will try to init again */
@@ -32,25 +178,29 @@ void office_environment_monitor(void){
 	HAL_Delay(2000);
 	reset_screen_canvas();
 
-	/* Initiate the wifi module */
+	/* Initiate the wifi module, if it fails sampling starts anyway and the upload recovery restarts the module later */
 	display_write_string("Starting ESP8266", WHITE);
 	current_status = esp8266_start();
+	display_set_position(1, (display_get_y() + ROW_SIZE));
 	if(current_status == ESP8266_START_ERROR){
-		error_handler();
+		display_write_string("FAILED, RETRY LATER", WHITE);
+		upload_failures = UPLOAD_RESET_AFTER;
+		HAL_Delay(2000);
 	}
-	display_set_position(1, (display_get_y() + ROW_SIZE));
-	display_write_string("STARTED", WHITE);
+	else
+		display_write_string("STARTED", WHITE);
 	reset_screen_canvas();
 
-	/* Connect to WIFI */
-	display_write_string("Connecting to WIFI", WHITE);
-	current_status = esp8266_wifi_start();
-	if(current_status == ESP8266_WIFI_CON_ERROR){
-		error_handler();
+	/* Connect to WIFI, joining again is also left to the upload recovery */
+	if(current_status == ESP8266_START_SUCCESS){
+		display_write_string("Connecting to WIFI", WHITE);
+		current_status = esp8266_wifi_start();
+		if(current_status == ESP8266_WIFI_CON_ERROR)
+			upload_failures = UPLOAD_REJOIN_AFTER;
+		display_set_position(1, (display_get_y() + ROW_SIZE));
+		display_write_string(esp8266_return_string, WHITE);
+		reset_screen_canvas();
 	}
-	display_set_position(1, (display_get_y() + ROW_SIZE));
-	display_write_string(esp8266_return_string, WHITE);
-	reset_screen_canvas();
 
 	/* Initiate CCS811 for CO2 and tVOC measurements */
 	display_write_string("Starting CCS811", WHITE);
@@ -77,9 +227,17 @@ void office_environment_monitor(void){
 	/* Loading bar when waiting for some sensor data to be available */
 	display_getting_data_screen();
 
-	uint8_t timer = 0;
+	/* The first sample is uploaded right away, the esp8266 sleeps after that */
+	uint16_t timer = upload_interval - 1;
+	bool upload_pending = false;
 	for(;;){
 
+		/* A slower drive mode from the server, the CCS811 idles after an upload and then starts it */
+		ccs811_drive_mode_update();
+
+		/* The display update that came in during a flush is started here, the I2C interrupt leaves it pending */
+		display_poll();
+
 		// TODO: BLINK GREEN LED WHILE RUNNING
 		if(CCS811_data_available() == CCS811_NEW_DATA){
 
@@ -91,15 +249,28 @@ void office_environment_monitor(void){
 			uint16_t co2 = CCS811_get_co2();
 			uint16_t tVoc = CCS811_get_tvoc();
 
-			show_measurements(temperature, humidity, co2, tVoc);
+			show_screen(temperature, humidity, co2, tVoc);
+			store_sample(co2, tVoc, temperature, humidity);
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+			/* Nothing is sent between uploads, so the broker needs a ping now and then */
+			if(esp8266_sleep_mode() == ESP8266_SLEEP_NONE || esp8266_sleep_mode() == ESP8266_SLEEP_MODEM)
+				mqtt_keep_alive();
+#endif
+
+			/* Wake the esp8266 ahead of time, so the upload does not have to wait for it */
+			if(!upload_pending && timer == upload_interval - esp8266_power_wake_lead())
+				esp8266_power_prewake();
 
-			if(timer == CCS811_BME280_SEND_INTERVAL){
+			/* The server may have lowered the interval, so the timer can be past it */
+			if(timer >= upload_interval){
 				timer = 0;
-				if((current_status = esp8266_web_connection()) != ESP8266_WEB_CONNECTED)
-					error_handler();
-				if((current_status = esp8266_web_request(co2, tVoc, temperature, humidity)) != ESP8266_WEB_REQUEST_SUCCESS)
-					error_handler();
+				upload_pending = true;
 			}
+
+			/* A failed upload is retried on a later sample, the samples are kept until then */
+			if(upload_pending)
+				upload_pending = (esp8266_upload_with_recovery() != ESP8266_WEB_REQUEST_SUCCESS);
 		}
 		/* Check for CCS811 errors */
 		else if(CCS811_read_status_error()){
@@ -112,9 +283,20 @@ void office_environment_monitor(void){
 
 void error_handler(void){
 
+	show_error(current_status);
+
+	/* Errors printed, freeze here */
+	while(1){
+		display_poll();
+		// TODO: BLINK RED LED WHILE RUNNING
+	}
+}
+
+void show_error(RETURN_STATUS status){
+
 	char buf[28];
 	reset_screen_canvas();
-	switch (current_status) {
+	switch (status) {
 
 		case ESP8266_START_ERROR:
 			 display_write_string_no_update("ESP8266 START ERR", WHITE);
@@ -139,6 +321,12 @@ void error_handler(void){
 			 display_update();
 			 break;
 
+		case ESP8266_WAKE_ERROR:
+			 display_write_string_no_update("ESP8266 WAKE FAIL", WHITE);
+			 display_string_on_line_no_update("Check connections", WHITE, 2);
+			 display_update();
+			 break;
+
 		case CCS811_START_ERROR:
 			 display_write_string_no_update("CCS811 START ERROR", WHITE);
 			 if(current_sensor_status == CCS811_I2C_ERROR){
@@ -173,10 +361,6 @@ void error_handler(void){
 			break;
 
 	}
-	/* Errors printed, freeze here */
-	while(1){
-		// TODO: BLINK RED LED WHILE RUNNING
-	}
 }
 
 void display_startscreen(void){
@@ -216,31 +400,82 @@ void display_getting_data_screen(void){
 
 void show_measurements(float temp, float hum, uint16_t co2, uint16_t tVoc){
 
-	/* String buffers */
-	char buffer    [38] = {};
-	char tempbuffer[15] = {};
-	char humbuffer [15] = {};
-	char co2buffer [19] = {};
-	char tvocbuffer[19] = {};
-
-	/* Make temperature and humidity output and print on screen */
-	snprintf (tempbuffer, 15, "Temp: %f" , temp);
-	snprintf (humbuffer,  15, "Hum:  %f" , hum);
-	sprintf  (buffer, "%s    %s    ", tempbuffer, humbuffer);
-	display_write_string_no_update(buffer, WHITE);
-
-	/* Make co2 output and print on screen */
-	sprintf  (co2buffer, "CO2:  %dppm   ", co2);
-	display_write_string_no_update(co2buffer, WHITE);
-	display_set_position(1, (display_get_y() + ROW_SIZE));
+	/* String buffer */
+	char buffer[MEASUREMENT_DIGITS + 1] = {};
+
+	if(!measurement_fields_ready){
+		for(uint8_t i = 0; i < MEASUREMENT_FIELDS; i++){
+			const char* label = measurement_layout[i].label;
+			display_field_init(&measurement_fields[i], measurement_layout[i].x, measurement_layout[i].y,
+							   measurement_layout[i].font, (label != NULL) ? strlen(label) : MEASUREMENT_DIGITS);
+		}
+		measurement_fields_ready = true;
+	}
+
+	/* Only the chars that changed since the last call are drawn */
+	snprintf (buffer, sizeof(buffer), "%5.1f", temp);
+	display_field_set(&measurement_fields[FIELD_TEMP], buffer);
+	snprintf (buffer, sizeof(buffer), "%5.1f", hum);
+	display_field_set(&measurement_fields[FIELD_HUM], buffer);
+	snprintf (buffer, sizeof(buffer), "%5u", co2);
+	display_field_set(&measurement_fields[FIELD_CO2], buffer);
+	snprintf (buffer, sizeof(buffer), "%5u", tVoc);
+	display_field_set(&measurement_fields[FIELD_TVOC], buffer);
+
+	for(uint8_t i = LABEL_TEMP; i < MEASUREMENT_FIELDS; i++)
+		display_field_set(&measurement_fields[i], measurement_layout[i].label);
+	display_update();
+}
 
-	/* Make tVOC output and print on screen */
-	sprintf  (tvocbuffer, "tVoc: %dppb   ", tVoc);
-	display_write_string_no_update(tvocbuffer, WHITE);
-	display_set_position(1, 1);
+static void history_init(void){
+	display_graph_init(&co2_history, HISTORY_PLOT_X, 0, HISTORY_PLOT_WIDTH, HISTORY_PLOT_HEIGHT, DISPLAY_GRAPH_LINE, 100, 1);
+	display_graph_init(&temperature_history, HISTORY_PLOT_X, HISTORY_PLOT_HEIGHT, HISTORY_PLOT_WIDTH, HISTORY_PLOT_HEIGHT,
+					   DISPLAY_GRAPH_BARS, 10, 10);
+	display_field_init(&history_units[0], 1, HISTORY_UNIT_Y, FONT_SMALL, 3);
+	display_field_init(&history_units[1], 1, HISTORY_PLOT_HEIGHT + HISTORY_UNIT_Y, FONT_SMALL, 3);
+	history_ready = true;
+}
+
+void store_history(float temp, uint16_t co2){
+	if(!history_ready)
+		history_init();
+
+	/* The first reading is kept right away */
+	if(co2_history.count > 0 && HAL_GetTick() - history_at < HISTORY_INTERVAL)
+		return;
+	history_at = HAL_GetTick();
+	display_graph_add(&co2_history, (co2 > INT16_MAX) ? INT16_MAX : co2);
+	display_graph_add(&temperature_history, (int16_t) (temp * 10.0f + ((temp < 0) ? -0.5f : 0.5f)));
+}
+
+void show_history(void){
+	if(!history_ready)
+		history_init();
+
+	display_graph_draw(&co2_history);
+	display_graph_draw(&temperature_history);
+	display_field_set(&history_units[0], "ppm");
+	display_field_set(&history_units[1], "  C");
 	display_update();
 }
 
+void show_screen(float temp, float hum, uint16_t co2, uint16_t tVoc){
+	store_history(temp, co2);
+
+	/* The screen is cleared when it changes, the fields and graphs of the other screen then draw everything */
+	uint32_t time = history_shown ? SCREEN_HISTORY_TIME : SCREEN_READINGS_TIME;
+	if(SCREEN_READINGS_TIME > 0 && HAL_GetTick() - screen_since >= time){
+		history_shown = !history_shown;
+		screen_since = HAL_GetTick();
+		reset_screen_canvas();
+	}
+
+	if(history_shown)
+		show_history();
+	else
+		show_measurements(temp, hum, co2, tVoc);
+}
+
 /* Initiates the wifi module */
 RETURN_STATUS esp8266_start(void){
 
@@ -313,46 +548,574 @@ RETURN_STATUS esp8266_wifi_start(void){
 	*/
 }
 
-/* Start connection to website */
-RETURN_STATUS esp8266_web_connection(void){
+/* Connects to the cached address of the host. If that fails the address may have changed,
+ * so it is looked up again and the connection is tried once more, unless the module did not answer */
+static RETURN_STATUS esp8266_connect(const char* type, const char* host, const char* port){
 	char connection_command[256] = {0};
+
+	for(uint8_t attempt = 0; attempt < 2; attempt++){
+		esp8266_get_connection_command(connection_command, type, esp8266_dns_lookup(host), port);
+		esp8266_return_string = esp8266_send_command(connection_command);
+		if(strcmp(esp8266_return_string, ESP8266_AT_CONNECT) == 0){
+			upload_stats.connections++;
+			return ESP8266_WEB_CONNECTED;
+		}
+		/* No answer at all, the module is at fault rather than the address, that is left to the upload recovery */
+		if(esp8266_command_timed_out())
+			break;
+		esp8266_dns_invalidate();
+	}
+	return ESP8266_WEB_DISCONNECTED;
+}
+
+/* Turns the answer of the server into a status. A 4xx answer means the request itself is wrong, sending the same
+ * samples again would be rejected again, except for 408 and 429 which only ask for the request to be sent later */
+static RETURN_STATUS check_response(const HTTP_RESPONSE* response){
+
+	if(HTTP_SUCCESS(response->status)){
+		if(response->state == HTTP_PARSE_DONE && apply_server_settings(response->body))
+			upload_stats.settings_updates++;
+		return ESP8266_WEB_REQUEST_SUCCESS;
+	}
+	if(HTTP_CLIENT_ERROR(response->status) && response->status != 408 && response->status != 429){
+		upload_stats.rejected_uploads++;
+		return ESP8266_WEB_REQUEST_REJECTED;
+	}
+	return ESP8266_WEB_REQUEST_ERROR;
+}
+
+RETURN_STATUS esp8266_web_connection(void){
 	char remote_ip[] 			 = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
 	char type[] 				 = "TCP";
 	char remote_port[] 		     = "80";
 
-	esp8266_get_connection_command(connection_command, type, remote_ip, remote_port);
-	esp8266_return_string = esp8266_send_command(connection_command);
-	if(strcmp(esp8266_return_string, ESP8266_AT_CONNECT) != 0){
+	if(esp8266_connect(type, remote_ip, remote_port) != ESP8266_WEB_CONNECTED){
+		web_connected = false;
 		return ESP8266_WEB_DISCONNECTED;
 	}
+	web_connected = true;
 	return ESP8266_WEB_CONNECTED;
 }
 
 RETURN_STATUS esp8266_web_request(uint16_t co2, uint16_t tvoc, float temp, float hum){
 	//"GET /api/sensor HTTP/1.1\r\nHost: ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net\r\nConnection: close\r\n\r\n";
 	///api/sensor/airquality?carbon=10&volatile=10 HTTP/1.1
-	char request	[512] = {0};
-	char init_send	[64]  = {0};
-	char data		[100]  = {0};
-	char uri		[50]  = "/api/sensor?";
-	char host		[  ]  = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	ESP8266_REQUEST request;
+	static const char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+
+#if UPLOAD_ENCODING == UPLOAD_ENCODING_CBOR
+	/* POST /api/sensor with the reading as the body, about a dozen bytes instead of the query string */
+	uint8_t body[24];
+	CBOR_WRITER writer;
+	cbor_writer_init(&writer, body, sizeof(body));
+	cbor_put_reading(&writer, co2, tvoc, temp, hum);
+
+	esp8266_request_init(&request);
+	esp8266_request_add_string(&request, HTTP_POST);
+	esp8266_request_add_string(&request, "/api/sensor");
+	esp8266_request_http_headers(&request, host, false, UPLOAD_CONTENT_TYPE, writer.len);
+	esp8266_request_add(&request, (const char*) body, writer.len);
+#else
+	/* POST /api/sensor?carbon=<co2>&volatile=<tvoc>&temperature=<temp>&humidity=<hum>, sent as segments.
+	 * The values are rounded to hundredths the same way as in the cbor body */
+	esp8266_request_init(&request);
+	esp8266_request_add_string(&request, HTTP_POST);
+	esp8266_request_add_string(&request, "/api/sensor?carbon=");
+	esp8266_request_add_uint  (&request, co2);
+	esp8266_request_add_string(&request, "&volatile=");
+	esp8266_request_add_uint  (&request, tvoc);
+	esp8266_request_add_string(&request, "&temperature=");
+	esp8266_request_add_fixed (&request, cbor_fixed(temp), 2);
+	esp8266_request_add_string(&request, "&humidity=");
+	esp8266_request_add_fixed (&request, cbor_fixed(hum), 2);
+	esp8266_request_http_headers(&request, host, false, NULL, 0);
+#endif
+
+	HTTP_RESPONSE response;
+	esp8266_response_start(&response);
+	esp8266_return_string = esp8266_send_request(&request);
+	if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+		esp8266_response_stop();
+		return ESP8266_WEB_REQUEST_ERROR;
+	}
+
+	/* Connection: close, the server closes the connection once it has answered */
+	bool closed = esp8266_wait_for(ESP8266_AT_CLOSED, ESP8266_RESPONSE_TIMEOUT);
+	esp8266_response_stop();
+	if(!closed){
+		esp8266_return_string = ESP8266_AT_ERROR;
+		return ESP8266_WEB_REQUEST_ERROR;
+	}
+	esp8266_return_string = ESP8266_AT_CLOSED;
+	return check_response(&response);
+}
+
+void store_sample(uint16_t co2, uint16_t tvoc, float temp, float hum){
 
-	sprintf  (data, "carbon=%d&volatile=%d&temperature=%f&humidity=%f", co2, tvoc, temp, hum);
-	strcat   (uri,data);
+	/* Overwrite the oldest sample when the buffer is full */
+	if(sample_count == SAMPLE_BUFFER_SIZE){
+		sample_head = (sample_head + 1) % SAMPLE_BUFFER_SIZE;
+		sample_count--;
+		upload_stats.samples_dropped++;
+	}
 
-	uint8_t len = esp8266_http_get_request(request, HTTP_POST, uri, host);
-	esp8266_get_at_send_command(init_send, len);
+	SAMPLE* sample = &sample_buffer[(sample_head + sample_count) % SAMPLE_BUFFER_SIZE];
+	sample->timestamp	= HAL_GetTick();
+	sample->co2			= co2;
+	sample->tvoc		= tvoc;
+	sample->temperature = temp;
+	sample->humidity	= hum;
+	sample_count++;
+}
 
-	esp8266_return_string = esp8266_send_command(init_send);
+#if UPLOAD_TRANSPORT != UPLOAD_TRANSPORT_UDP
+#if UPLOAD_ENCODING == UPLOAD_ENCODING_CBOR
+/* Encodes the oldest samples as a cbor batch, each timestamp as the time since the sample before it */
+static uint16_t build_batch_body(char* body, uint16_t count){
+	CBOR_WRITER writer;
+	uint32_t	previous = sample_buffer[sample_head].timestamp;
+
+	cbor_writer_init(&writer, (uint8_t*) body, sizeof(batch_body));
+	cbor_put_batch(&writer, HAL_GetTick(), previous, count);
+	for(uint16_t i = 0; i < count; i++){
+		SAMPLE* sample = &sample_buffer[(sample_head + i) % SAMPLE_BUFFER_SIZE];
+		cbor_put_sample(&writer, sample->timestamp - previous, sample->co2, sample->tvoc, sample->temperature, sample->humidity);
+		previous = sample->timestamp;
+	}
+	return writer.len;
+}
+#else
+/* Formats the oldest samples as csv, one line per sample */
+static uint16_t build_batch_body(char* body, uint16_t count){
+
+	uint16_t len = sprintf(body, "timestamp,carbon,volatile,temperature,humidity\n");
+	for(uint16_t i = 0; i < count; i++){
+		SAMPLE* sample = &sample_buffer[(sample_head + i) % SAMPLE_BUFFER_SIZE];
+		int row = snprintf(&body[len], SAMPLE_ROW_SIZE, "%lu,%u,%u,%.2f,%.2f\n", (unsigned long) sample->timestamp,
+						   sample->co2, sample->tvoc, sample->temperature, sample->humidity);
+		len += (row < SAMPLE_ROW_SIZE) ? row : (SAMPLE_ROW_SIZE - 1);
+	}
+	return len;
+}
+#endif
+#endif
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP || UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP_PASSTHROUGH
+/* Wraps the batch body in a http post request.
+ * The request points into batch_body, nothing is copied */
+static void build_batch_request(ESP8266_REQUEST* request, uint16_t body_len){
+	static const char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+
+	/* The current tick is sent along, so the server can turn the sample timestamps into wall clock time */
+	esp8266_request_init(request);
+	esp8266_request_add_string(request, HTTP_POST);
+	esp8266_request_add_string(request, "/api/sensor/batch?now=");
+	esp8266_request_add_uint  (request, HAL_GetTick());
+	esp8266_request_http_headers(request, host, true, UPLOAD_CONTENT_TYPE, body_len);
+	esp8266_request_add(request, batch_body, body_len);
+}
+#endif
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_UDP
+static uint32_t datagram_sequence = 0;
+static uint8_t	datagram[UDP_HEADER_SIZE + CCS811_BME280_BATCH_SIZE * UDP_SAMPLE_SIZE];
+
+/* Writes a value big endian, returns the number of bytes written */
+static uint8_t put_u32(uint8_t* buffer, uint32_t value){
+	buffer[0] = value >> 24;
+	buffer[1] = value >> 16;
+	buffer[2] = value >> 8;
+	buffer[3] = value;
+	return 4;
+}
+
+static uint8_t put_u16(uint8_t* buffer, uint16_t value){
+	buffer[0] = value >> 8;
+	buffer[1] = value;
+	return 2;
+}
+
+/* Encodes the oldest samples as a datagram, see the format above. Temperature and humidity
+ * are rounded to hundredths the same way as in the cbor encoding */
+static uint16_t build_datagram(uint8_t* datagram, uint16_t count){
+	uint32_t now = HAL_GetTick();
+	uint16_t len = 0;
+
+	len += put_u32(&datagram[len], datagram_sequence);
+	len += put_u32(&datagram[len], now);
+	datagram[len++] = count;
+	for(uint16_t i = 0; i < count; i++){
+		SAMPLE* sample = &sample_buffer[(sample_head + i) % SAMPLE_BUFFER_SIZE];
+		len += put_u32(&datagram[len], now - sample->timestamp);
+		len += put_u16(&datagram[len], sample->co2);
+		len += put_u16(&datagram[len], sample->tvoc);
+		len += put_u16(&datagram[len], (uint16_t) (int16_t) cbor_fixed(sample->temperature));
+		len += put_u16(&datagram[len], (uint16_t) cbor_fixed(sample->humidity));
+	}
+	return len;
+}
+
+/* The udp socket is opened once, there is no handshake and the ESP8266 never reports it closed */
+static RETURN_STATUS udp_connection(void){
+	char remote_ip[] 			 = UDP_COLLECTOR_HOST;
+	char type[] 				 = "UDP";
+	char remote_port[] 		     = UDP_COLLECTOR_PORT;
+
+	if(esp8266_connect(type, remote_ip, remote_port) != ESP8266_WEB_CONNECTED){
+		web_connected = false;
+		return ESP8266_WEB_DISCONNECTED;
+	}
+	web_connected = true;
+	return ESP8266_WEB_CONNECTED;
+}
+
+/* Sends the batch as one datagram, done as soon as the ESP8266 answers SEND OK */
+static RETURN_STATUS send_batch(uint16_t count){
+
+	uint16_t len = build_datagram(datagram, count);
+
+	if(!web_connected && udp_connection() != ESP8266_WEB_CONNECTED)
+		return ESP8266_WEB_DISCONNECTED;
+
+	/* The socket is gone if the ESP8266 was restarted since it was opened, open it again and send once more */
+	esp8266_return_string = esp8266_send_large_data((const char*) datagram, len);
 	if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+		if(udp_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+		esp8266_return_string = esp8266_send_large_data((const char*) datagram, len);
+		if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+			web_connected = false;
+			return ESP8266_WEB_REQUEST_ERROR;
+		}
+	}
+
+	/* Only counted when sent, so a gap in the sequence at the collector is a datagram lost on the way */
+	datagram_sequence++;
+	return ESP8266_WEB_REQUEST_SUCCESS;
+}
+#elif UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+/* "oem-" and 16 hex digits of the unique id, every broker has to accept ids of up to 23 characters */
+static const char* mqtt_client_id(void){
+#ifdef MQTT_CLIENT_ID
+	return MQTT_CLIENT_ID;
+#else
+	static char client_id[24] = {0};
+
+	if(client_id[0] == '\0')
+		sprintf(client_id, "oem-%08lx%08lx", (unsigned long) HAL_GetUIDw0(),
+				(unsigned long) (HAL_GetUIDw1() ^ HAL_GetUIDw2()));
+	return client_id;
+#endif
+}
+
+/* Connects to the broker, first the tcp connection and then the mqtt session */
+static RETURN_STATUS mqtt_broker_connection(void){
+	char remote_ip[] 			 = MQTT_BROKER_HOST;
+	char type[] 				 = "TCP";
+	char remote_port[] 		     = MQTT_BROKER_PORT;
+
+	if(esp8266_connect(type, remote_ip, remote_port) != ESP8266_WEB_CONNECTED)
+		return ESP8266_WEB_DISCONNECTED;
+
+	if(mqtt_connect(mqtt_client_id()) != MQTT_SUCCESS)
+		return ESP8266_WEB_DISCONNECTED;
+	return ESP8266_WEB_CONNECTED;
+}
+
+/* Publishes the batch body with qos 1, so the samples are only removed once the broker has them */
+static RETURN_STATUS send_batch(uint16_t body_len){
+
+	if(!mqtt_connected() || esp8266_link_closed()){
+		if(mqtt_broker_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+	}
+
+	/* If publishing fails the connection was probably lost, reconnect once and publish again */
+	if(mqtt_publish(MQTT_TOPIC_SAMPLES, batch_body, body_len, 1) != MQTT_SUCCESS){
+		if(mqtt_broker_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+		if(mqtt_publish(MQTT_TOPIC_SAMPLES, batch_body, body_len, 1) != MQTT_SUCCESS)
+			return ESP8266_WEB_REQUEST_ERROR;
+	}
+	return ESP8266_WEB_REQUEST_SUCCESS;
+}
+
+/* Publishes the newest sample to one topic per value, for subscribers that only want the current reading */
+static void publish_latest_sample(void){
+	char value[16] = {0};
+
+	if(sample_count == 0 || (!mqtt_connected() && mqtt_broker_connection() != ESP8266_WEB_CONNECTED))
+		return;
+
+	SAMPLE* sample = &sample_buffer[(sample_head + sample_count - 1) % SAMPLE_BUFFER_SIZE];
+
+	mqtt_publish(MQTT_TOPIC_CO2, value, sprintf(value, "%u", sample->co2), 0);
+	mqtt_publish(MQTT_TOPIC_TVOC, value, sprintf(value, "%u", sample->tvoc), 0);
+	mqtt_publish(MQTT_TOPIC_TEMPERATURE, value, sprintf(value, "%.2f", sample->temperature), 0);
+	mqtt_publish(MQTT_TOPIC_HUMIDITY, value, sprintf(value, "%.2f", sample->humidity), 0);
+}
+#elif UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP_PASSTHROUGH
+/* Sends the batch request in passthrough mode. Passthrough is started once per connection
+ * and then left on between uploads, so each upload is a single write to the uart, unless the
+ * ESP8266 sleeps between uploads, esp8266_power_sleep stops it then.
+ * The ESP8266 reconnects by itself if the server closes the connection. Each upload waits
+ * for the 20 ms packet interval of passthrough, so this is slower than UPLOAD_TRANSPORT_HTTP
+ * with a kept open connection, it only saves the uart bytes of AT+CIPSEND. */
+static RETURN_STATUS send_batch(uint16_t body_len){
+
+	ESP8266_REQUEST request;
+	static HTTP_RESPONSE response;
+	build_batch_request(&request, body_len);
+
+	if(!esp8266_passthrough_active()){
+		if((!web_connected || esp8266_link_closed()) && esp8266_web_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+
+		esp8266_return_string = esp8266_passthrough_start();
+		if(strcmp(esp8266_return_string, ESP8266_AT_OK) != 0){
+			web_connected = false;
+			return ESP8266_WEB_REQUEST_ERROR;
+		}
+	}
+
+	esp8266_response_start(&response);
+	esp8266_return_string = esp8266_passthrough_send_request(&request);
+	if(strcmp(esp8266_return_string, ESP8266_AT_OK) != 0){
+		esp8266_response_stop();
 		return ESP8266_WEB_REQUEST_ERROR;
 	}
 
-	esp8266_return_string = esp8266_send_data(request);
-	if(strcmp(esp8266_return_string, ESP8266_AT_CLOSED) != 0){
+	/* The response comes back without +IPD, every received byte goes to the parser */
+	esp8266_return_string = esp8266_wait_response();
+	esp8266_response_stop();
+	if(!http_response_done(&response)){
+		/* No answer, go back to normal mode so the next upload can find out what is wrong */
+		esp8266_return_string = esp8266_passthrough_stop();
 		return ESP8266_WEB_REQUEST_ERROR;
 	}
-	return ESP8266_WEB_REQUEST_SUCCESS;;
+	return check_response(&response);
+}
+#else
+/* Sends the batch request with AT+CIPSEND, on the connection that is kept open between uploads */
+static RETURN_STATUS send_batch(uint16_t body_len){
+
+	ESP8266_REQUEST request;
+	static HTTP_RESPONSE response;
+	build_batch_request(&request, body_len);
+
+	/* Only connect if there is no open connection, the server might have closed it since the last upload */
+	if(!web_connected || esp8266_link_closed()){
+		if(esp8266_web_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+	}
+
+	/* If sending fails the connection was probably lost, reconnect once and send the whole request again */
+	esp8266_response_start(&response);
+	esp8266_return_string = esp8266_send_request(&request);
+	if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+		esp8266_response_stop();
+		if(esp8266_web_connection() != ESP8266_WEB_CONNECTED)
+			return ESP8266_WEB_DISCONNECTED;
+		esp8266_response_start(&response);
+		esp8266_return_string = esp8266_send_request(&request);
+		if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+			esp8266_response_stop();
+			return ESP8266_WEB_REQUEST_ERROR;
+		}
+	}
+
+	/* The answer is parsed as it arrives, so it does not matter how many +IPD messages it is split into */
+	esp8266_return_string = esp8266_wait_response();
+	esp8266_response_stop();
+	if(strcmp(esp8266_return_string, ESP8266_AT_CLOSED) == 0){
+		web_connected = false;
+		upload_stats.server_closes++;
+	}
+	else if(strcmp(esp8266_return_string, ESP8266_AT_SEND_OK) != 0){
+		web_connected = false;
+		return ESP8266_WEB_REQUEST_ERROR;
+	}
+	return check_response(&response);
+}
+#endif
+
+RETURN_STATUS esp8266_web_upload(void){
+	uint32_t start = HAL_GetTick();
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+	publish_latest_sample();
+#endif
+
+	while(sample_count > 0){
+
+		uint16_t count = (sample_count < batch_size) ? sample_count : batch_size;
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_UDP
+		if((current_status = send_batch(count)) != ESP8266_WEB_REQUEST_SUCCESS)
+			return current_status;
+#else
+		uint16_t body_len = build_batch_body(batch_body, count);
+		current_status = send_batch(body_len);
+		if(current_status != ESP8266_WEB_REQUEST_SUCCESS && current_status != ESP8266_WEB_REQUEST_REJECTED)
+			return current_status;
+#endif
+
+		/* Posted or rejected, remove the samples from the buffer */
+		sample_head   = (sample_head + count) % SAMPLE_BUFFER_SIZE;
+		sample_count -= count;
+		if(current_status == ESP8266_WEB_REQUEST_REJECTED)
+			continue;
+		upload_stats.uploads++;
+		upload_stats.samples_sent += count;
+	}
+
+	upload_stats.last_upload_time   = HAL_GetTick() - start;
+	upload_stats.total_upload_time += upload_stats.last_upload_time;
+	return ESP8266_WEB_REQUEST_SUCCESS;
+}
+
+/* xorshift32, seeded from the tick of the first failure */
+static uint32_t jitter_random(void){
+	if(jitter_state == 0)
+		jitter_state = HAL_GetTick() | 1;
+	jitter_state ^= jitter_state << 13;
+	jitter_state ^= jitter_state >> 17;
+	jitter_state ^= jitter_state << 5;
+	return jitter_state;
+}
+
+RETURN_STATUS esp8266_upload_with_recovery(void){
+
+	/* Still backing off */
+	if(upload_failures > 0 && (int32_t) (HAL_GetTick() - upload_retry_at) < 0)
+		return ESP8266_UPLOAD_BACKOFF;
+
+	/* Escalate, first the association and then the whole module. The commands would be sent to the server in passthrough mode */
+	if(upload_failures >= UPLOAD_REJOIN_AFTER && esp8266_passthrough_active())
+		esp8266_passthrough_stop();
+	if(upload_failures >= UPLOAD_RESET_AFTER){
+		upload_stats.module_resets++;
+		web_connected = false;
+		if(strcmp(esp8266_reset(), ESP8266_AT_OK) == 0)
+			esp8266_wifi_start();
+	}
+	else if(upload_failures >= UPLOAD_REJOIN_AFTER){
+		/* Only if the module answers that the AP is gone, a module that does not answer is left for the reset */
+		if(strcmp(esp8266_send_command(ESP8266_AT_CWJAP_TEST), ESP8266_AT_WIFI_DISCONNECTED) == 0){
+			upload_stats.wifi_rejoins++;
+			web_connected = false;
+			esp8266_wifi_start();
+		}
+	}
+
+	if((current_status = esp8266_power_wake()) == ESP8266_WAKE_SUCCESS)
+		current_status = esp8266_web_upload();
+
+	if(current_status == ESP8266_WEB_REQUEST_SUCCESS){
+		upload_failures = 0;
+		esp8266_power_sleep();
+		return current_status;
+	}
+
+	/* Wait base * 2^failures, half of it fixed and half of it random so that several devices do not retry together */
+	upload_stats.failed_uploads++;
+	if(upload_failures < UINT8_MAX)
+		upload_failures++;
+	uint32_t backoff = UPLOAD_RETRY_MAX;
+	if(upload_failures < 16 && (UPLOAD_RETRY_BASE << (upload_failures - 1)) < UPLOAD_RETRY_MAX)
+		backoff = UPLOAD_RETRY_BASE << (upload_failures - 1);
+	upload_retry_at = HAL_GetTick() + backoff / 2 + jitter_random() % (backoff / 2 + 1);
+	return current_status;
+}
+
+const UPLOAD_STATS* get_upload_stats(void){
+	return &upload_stats;
+}
+
+/* Adds the charge used since the last change of power state */
+static void power_account(uint32_t current){
+	uint32_t now = HAL_GetTick();
+	power_cycle_charge += (uint64_t) current * (now - power_state_since);
+	power_state_since = now;
+}
+
+static uint32_t sleep_current(ESP8266_SLEEP_MODE mode){
+	switch(mode){
+		case ESP8266_SLEEP_MODEM: return ESP8266_CURRENT_MODEM_SLEEP;
+		case ESP8266_SLEEP_LIGHT: return ESP8266_CURRENT_LIGHT_SLEEP;
+		case ESP8266_SLEEP_DEEP:  return ESP8266_CURRENT_DEEP_SLEEP;
+		default:				  return ESP8266_CURRENT_AWAKE;
+	}
+}
+
+void esp8266_power_sleep(void){
+
+	/* The cycle ends here, uA * ms to uAh */
+	power_account(ESP8266_CURRENT_AWAKE);
+	power_stats.last_cycle_charge = power_cycle_charge / 3600000;
+	power_stats.total_charge 	 += power_stats.last_cycle_charge;
+	power_cycle_charge = 0;
+
+	if(ESP8266_SLEEP_BETWEEN_UPLOADS == ESP8266_SLEEP_NONE)
+		return;
+
+	/* AT+SLEEP would be sent to the server in passthrough mode, send_batch starts it again on the next upload */
+	if(esp8266_passthrough_active() && strcmp(esp8266_passthrough_stop(), ESP8266_AT_OK) != 0)
+		return;
+
+	/* Wake up by itself after two intervals at the latest, if GPIO16 is wired to RST */
+	esp8266_return_string = esp8266_sleep(ESP8266_SLEEP_BETWEEN_UPLOADS, 2 * upload_interval * ccs811_sample_period());
+	if(strcmp(esp8266_return_string, ESP8266_AT_OK) != 0)
+		return;
+
+	/* A restart drops the connection */
+	if(ESP8266_SLEEP_BETWEEN_UPLOADS == ESP8266_SLEEP_DEEP)
+		web_connected = false;
+	power_stats.sleep_cycles++;
+}
+
+void esp8266_power_prewake(void){
+	if(esp8266_sleep_mode() == ESP8266_SLEEP_NONE || wake_started != 0)
+		return;
+
+	power_account(sleep_current(esp8266_sleep_mode()));
+	wake_started = HAL_GetTick();
+	esp8266_wake_start();
+}
+
+RETURN_STATUS esp8266_power_wake(void){
+	if(esp8266_sleep_mode() == ESP8266_SLEEP_NONE)
+		return ESP8266_WAKE_SUCCESS;
+
+	/* Not woken up ahead of time, the upload waits for all of it */
+	esp8266_power_prewake();
+
+	uint32_t wait_start = HAL_GetTick();
+	esp8266_return_string = esp8266_wake_finish();
+	uint32_t now = HAL_GetTick();
+
+	power_stats.last_wake_latency = now - wake_started;
+	power_stats.last_wake_delay   = now - wait_start;
+	power_stats.total_wake_delay += power_stats.last_wake_delay;
+	if(power_stats.last_wake_latency > power_stats.max_wake_latency)
+		power_stats.max_wake_latency = power_stats.last_wake_latency;
+	wake_started = 0;
+
+	if(strcmp(esp8266_return_string, ESP8266_AT_OK) != 0)
+		return ESP8266_WAKE_ERROR;
+	return ESP8266_WAKE_SUCCESS;
+}
+
+uint8_t esp8266_power_wake_lead(void){
+	uint32_t period = ccs811_sample_period();
+	uint32_t lead = (power_stats.max_wake_latency + period - 1) / period + ESP8266_WAKE_MARGIN;
+	if(lead >= upload_interval)
+		lead = upload_interval - 1;
+	return lead;
+}
+
+const POWER_STATS* get_power_stats(void){
+	return &power_stats;
 }
 
 /* Initiate CCS811 */
@@ -413,7 +1176,7 @@ RETURN_STATUS ccs811_start(void){
 	 * mode 3; measurement every 60 seconds
 	 * mode 4; measurement every 250ms
 	 **/
-	current_sensor_status = CCS811_write_mode(1);
+	current_sensor_status = CCS811_write_mode(drive_mode);
 	if(current_sensor_status != CCS811_SUCCESS)
 		return CCS811_START_ERROR;
 	HAL_Delay(30);
@@ -429,6 +1192,75 @@ RETURN_STATUS ccs811_start(void){
 	return CCS811_START_SUCCESS;
 }
 
+bool apply_server_settings(const char* body){
+	int32_t value;
+	bool changed = false;
+
+	if(http_form_value(body, SERVER_SETTING_INTERVAL, &value) && value >= 1 && value <= UPLOAD_INTERVAL_MAX && value != upload_interval){
+		upload_interval = value;
+		changed = true;
+	}
+	if(http_form_value(body, SERVER_SETTING_BATCH, &value) && value >= 1 && value <= CCS811_BME280_BATCH_SIZE && value != batch_size){
+		batch_size = value;
+		changed = true;
+	}
+
+	/* Mode 4 gives raw data only, so it is not allowed */
+	uint8_t current = drive_mode_pending ? drive_mode_pending : drive_mode;
+	if(http_form_value(body, SERVER_SETTING_DRIVE_MODE, &value) && value >= 1 && value <= 3 && value != current){
+		changed = true;
+		if(value <= drive_mode){
+			/* Not slower than the last mode sampled in, can be used right away, also ends an idle period */
+			if((value == drive_mode && !drive_mode_idle) || CCS811_write_mode(value) == CCS811_SUCCESS){
+				drive_mode = value;
+				drive_mode_pending = 0;
+				drive_mode_idle = false;
+			}
+		}
+		else
+			/* Slower, the ccs811 keeps sampling in the current mode until ccs811_drive_mode_update idles it */
+			drive_mode_pending = value;
+	}
+	return changed;
+}
+
+void ccs811_drive_mode_update(void){
+	if(drive_mode_pending == 0)
+		return;
+
+	/* Nothing is sampled while idle, so the idle period starts once everything sampled has been uploaded,
+	 * and no sooner than CCS811_SLOWDOWN_INTERVAL after the one before */
+	if(!drive_mode_idle){
+		if(sample_count > 0 || (drive_mode_slowdowns > 0 && HAL_GetTick() - drive_mode_idle_since < CCS811_SLOWDOWN_INTERVAL))
+			return;
+		if(CCS811_write_mode(0) == CCS811_SUCCESS){
+			drive_mode_idle = true;
+			drive_mode_idle_since = HAL_GetTick();
+			drive_mode_slowdowns++;
+		}
+		return;
+	}
+
+	if(HAL_GetTick() - drive_mode_idle_since >= CCS811_IDLE_TIME && CCS811_write_mode(drive_mode_pending) == CCS811_SUCCESS){
+		drive_mode = drive_mode_pending;
+		drive_mode_pending = 0;
+		drive_mode_idle = false;
+	}
+}
+
+uint8_t ccs811_drive_mode(void){
+	return drive_mode_idle ? 0 : drive_mode;
+}
+
+uint32_t ccs811_sample_period(void){
+	switch(drive_mode_idle ? drive_mode_pending : drive_mode){
+		case 2:  return 10000;
+		case 3:  return 60000;
+		case 4:  return 250;
+		default: return 1000;
+	}
+}
+
 /* Initiate BME280 */
 RETURN_STATUS bme280_start(void){
 
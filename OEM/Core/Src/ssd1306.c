@@ -10,6 +10,7 @@
 #include "i2c.h"
 #include "fonts.h"
 #include "stdio.h"
+#include "string.h"
 //#include "ERR.h"
 
 //Define write and read device address
@@ -19,16 +20,129 @@
 #define COMMAND_MODE 0x00
 #define DATA_MODE 0x40
 
+//ms a whole frame takes at most at 100 kHz, with margin
+#define DISPLAY_FLUSH_TIMEOUT 500
+
+//Memory addressing mode set by the 0x20 command, only bits 1:0 count
+#if DISPLAY_HORIZONTAL_ADDRESSING
+#define MEMORY_MODE 0x00
+#else
+#define MEMORY_MODE 0x02
+#endif
+
+//Bytes on the bus for a window, one transfer of 0x21 and 0x22 with their arguments and one for the data
+#define WINDOW_COST(bytes) ((1 + 6) + 1 + (bytes))
+
+//On the board the front buffer is put in SRAM2, and the DMA is given its alias right after SRAM1
+#ifdef SRAM2_BASE
+#define RAM2 __attribute__((section(".ram2")))
+#define DMA_ADDRESS(p) ((uint8_t*) ((uintptr_t) (p) - SRAM2_BASE + SRAM1_BASE + SRAM1_SIZE_MAX))
+#else
+#define RAM2
+#define DMA_ADDRESS(p) (p)
+#endif
+
+//The I2C interrupts mark the windows of a failed flush dirty again, maybe while the dirty state is being changed
+#if DISPLAY_DMA
+#define DIRTY_LOCK() uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define DIRTY_UNLOCK() __set_PRIMASK(primask)
+#else
+#define DIRTY_LOCK()
+#define DIRTY_UNLOCK()
+#endif
+
 //Screen object - used for information about mostly the display buffer
-static Display_t display;
+static Display_t display = {.Font = &Font_7x10};
 
 //screen buffer
 static uint8_t buffer[BUFFERSIZE];
 
+#if DISPLAY_HORIZONTAL_ADDRESSING
+//front buffer - what is being sent, the changed windows of the screen buffer one after the other
+static uint8_t front_buffer[BUFFERSIZE] RAM2;
+
+//a window of the display RAM, the 0x21 and 0x22 commands that set it and where its data is in the front buffer
+typedef struct {
+	uint8_t command[6];
+	uint16_t offset;
+	uint16_t size;
+} Display_Window;
+
+//the flush in progress, one window per page at most
+static struct {
+	Display_Window windows[PAGES];
+	uint8_t count;
+	volatile uint8_t index;
+	volatile uint8_t data_stage;
+} flush;
+#endif
+
+//called when a flush is done
+static Display_FlushCallback flush_callback = NULL;
+
 //initialization array - all commands used in initializing the display are stored in this array
-uint8_t instruct[28] = {0xAE, 0x20, 0x10, 0xB0, 0xC8, 0x00, 0x10, 0x40, 0x81, 0xFF, 0xA1, 0xA6, 0xA8, 63, 0xA4,
+uint8_t instruct[28] = {0xAE, 0x20, MEMORY_MODE, 0xB0, 0xC8, 0x00, 0x10, 0x40, 0x81, 0xFF, 0xA1, 0xA6, 0xA8, 63, 0xA4,
 		                0xD3, 0x00, 0xD5, 0xF0, 0xD9, 0x22, 0xDA, 0x12, 0xDB, 0x20, 0x8D, 0x14, 0xAF};
 
+/**
+ * @brief mark columns of a page as changed, the dirty range of the page grows to cover them
+ *
+ * @param page - the page, 0 to 7
+ * @param first - first changed column
+ * @param last - last changed column
+ * @retval none
+ */
+static void mark_dirty(uint8_t page, uint8_t first, uint8_t last)
+{
+	DIRTY_LOCK();
+	if (!(display.Dirty_Pages & (1 << page)))
+	{
+		display.Dirty_First[page] = first;
+		display.Dirty_Last[page] = last;
+		display.Dirty_Pages |= 1 << page;
+	}
+	else
+	{
+		if (first < display.Dirty_First[page])
+			display.Dirty_First[page] = first;
+		if (last > display.Dirty_Last[page])
+			display.Dirty_Last[page] = last;
+	}
+	DIRTY_UNLOCK();
+}
+
+#if DISPLAY_HORIZONTAL_ADDRESSING
+/**
+ * @brief add a window to the flush and copy its part of the screen buffer to the front buffer
+ *
+ * @param first_column - left edge of the window
+ * @param last_column - right edge of the window
+ * @param first_page - top page of the window
+ * @param last_page - bottom page of the window
+ * @param offset - where in the front buffer the data goes
+ * @retval size of the data
+ */
+static uint16_t add_window(uint8_t first_column, uint8_t last_column, uint8_t first_page, uint8_t last_page, uint16_t offset)
+{
+	Display_Window* window = &flush.windows[flush.count++];
+	uint16_t columns = last_column - first_column + 1;
+
+	window->command[0] = 0x21;
+	window->command[1] = first_column;
+	window->command[2] = last_column;
+	window->command[3] = 0x22;
+	window->command[4] = first_page;
+	window->command[5] = last_page;
+	window->offset = offset;
+	window->size = columns * (last_page - first_page + 1);
+
+	/* The display fills the window row of pages by row of pages */
+	for (uint8_t page = first_page; page <= last_page; page++)
+		memcpy(&front_buffer[offset + columns * (page - first_page)], &buffer[W * page + first_column], columns);
+	return window->size;
+}
+#endif
+
 /**
  * @brief get the current y coordinate for canvas
  *
@@ -40,6 +154,17 @@ display_get_y(void){
 	return display.thisY;
 }
 
+/**
+ * @brief get the screen buffer, W bytes per page with the top row of a page in bit 0
+ *
+ * @param none
+ * @retval the buffer, BUFFERSIZE bytes
+ */
+const uint8_t*
+display_get_buffer(void){
+	return buffer;
+}
+
 /**
  * @brief get the current x coordinate for canvas
  *
@@ -62,6 +187,42 @@ display_get_update_status(void)
 {
     return display.Update_Status;
 }
+
+/**
+ * @brief get the pages that have changed since the last display_update
+ *
+ * @param none
+ * @retval bit i is set if page i, rows 8*i to 8*i+7, has to be sent
+ */
+uint8_t
+display_get_dirty_pages(void)
+{
+	return display.Dirty_Pages;
+}
+
+/**
+ * @brief get the number of bytes display_update has sent since start, control bytes included
+ *
+ * @param none
+ * @retval number of bytes
+ */
+uint32_t
+display_get_flushed_bytes(void)
+{
+	return display.Flushed_Bytes;
+}
+
+/**
+ * @brief get the number of times reset_screen_canvas has cleared the buffer
+ *
+ * @param none
+ * @retval a new number after every clear, a widget that drew with another number has to draw again
+ */
+uint16_t
+display_get_canvas(void)
+{
+	return display.Canvas;
+}
 /**
  * @brief a function for initializing the display with the recommended initialization sequence
  *
@@ -83,7 +244,10 @@ void display_init(void)
 	    }
 	}
 
+	/* What the display RAM holds is unknown, so every page is sent */
 	reset_screen_canvas();
+	display_invalidate();
+	display_update();
 
 	display.thisX = 0;
 	display.thisY = 0;
@@ -101,6 +265,11 @@ void display_init(void)
 HAL_StatusTypeDef command(uint8_t command)
 {
 	HAL_StatusTypeDef status;
+
+	/* The bus is taken while a flush is sent */
+	status = display_wait_flush(DISPLAY_FLUSH_TIMEOUT);
+	if (status != HAL_OK)
+		return status;
 	status = HAL_I2C_Mem_Write(&hi2c2, DISPLAY_ADDR, COMMAND_MODE, I2C_MEMADD_SIZE_8BIT, &command, 1, HAL_MAX_DELAY);
 
 	return status;
@@ -108,22 +277,36 @@ HAL_StatusTypeDef command(uint8_t command)
 
 
 /**
- * @brief a function that fills the screen with black pixels (our only known way of "resetting" it) and then resetting the buffer position
+ * @brief a function that clears the screen buffer and resets the buffer position
+ * @note Nothing is sent, the next display_update sends the columns that were cleared together with
+ * 		 whatever is drawn in the meantime
  *
  * @param none
  * @retval none
  */
 void reset_screen_canvas(void)
 {
-	Display_ColourDef colour = BLACK;
-	for (int i = 0; i < sizeof(buffer); i++)
-		buffer[i] = (colour == BLACK) ? 0x00 : 0xFF;
+	for (uint8_t page = 0; page < PAGES; page++)
+	{
+		uint8_t *row = &buffer[page * W];
+		int16_t first = -1;
+		int16_t last = -1;
+
+		for (uint8_t i = 0; i < W; i++)
+		{
+			if (row[i] == 0)
+				continue;
+			if (first < 0)
+				first = i;
+			last = i;
+			row[i] = 0;
+		}
+		if (first >= 0)
+			mark_dirty(page, first, last);
+	}
 
-	HAL_Delay(10);
-	display_update();
 	display_set_position(1,1);
-	for(uint16_t j = 0; j < BUFFERSIZE; j++)
-		buffer[j] = 0;
+	display.Canvas++;
 }
 
 /**
@@ -163,6 +346,8 @@ void draw_pixel(uint8_t w, uint8_t h, Display_ColourDef colour)
 		return;
 	}
 
+	uint8_t old = buffer[w + (h/8) * W];
+
 	if (colour == WHITE)
 	{
 		buffer[w + (h/8) * W] |= 1 << (h % 8);
@@ -171,10 +356,250 @@ void draw_pixel(uint8_t w, uint8_t h, Display_ColourDef colour)
 	{
 		buffer[w + (h/8) * W] &= ~(1 << (h % 8));
 	}
+
+	/* Drawing what is already there, like the same digit again, leaves the page clean */
+	if (buffer[w + (h/8) * W] != old)
+		mark_dirty(h / 8, w, w);
+}
+
+/**
+ * @brief write the masked bits of one byte of the screen buffer, 8 rows of a column
+ *
+ * @param page - the page of the byte
+ * @param column - the column of the byte
+ * @param bits - the new pixels, top row in bit 0
+ * @param mask - the pixels to change
+ * @retval none
+ */
+static void write_byte(uint8_t page, uint8_t column, uint8_t bits, uint8_t mask)
+{
+	if (mask == 0 || page >= PAGES)
+		return;
+
+	uint8_t value = (buffer[column + page * W] & ~mask) | (bits & mask);
+	if (value == buffer[column + page * W])
+		return;
+	buffer[column + page * W] = value;
+	mark_dirty(page, column, column);
+}
+
+#if DISPLAY_HORIZONTAL_ADDRESSING
+/**
+ * @brief copy what changed into the front buffer as one or more windows and mark it as sent
+ * @note one window around everything that changed is used, unless the changes are far apart and
+ *       a window for each changed page is less to send
+ *
+ * @param none
+ * @retval number of windows, 0 if nothing changed
+ */
+static uint8_t prepare_flush(void)
+{
+	uint8_t dirty, first[PAGES], last[PAGES];
+	uint8_t first_page = PAGES, last_page = 0;
+	uint8_t first_column = W - 1, last_column = 0;
+	uint16_t page_cost = 0;
+	uint16_t offset = 0;
+
+	/* Only the dirty state is taken under the lock, the I2C interrupts must not wait for the copying */
+	DIRTY_LOCK();
+	dirty = display.Dirty_Pages;
+	memcpy(first, display.Dirty_First, PAGES);
+	memcpy(last, display.Dirty_Last, PAGES);
+	display.Dirty_Pages = 0;
+	DIRTY_UNLOCK();
+
+	for (uint8_t i = 0; i < PAGES; i++)
+	{
+		if (!(dirty & (1 << i)))
+			continue;
+		if (first_page == PAGES)
+			first_page = i;
+		last_page = i;
+		if (first[i] < first_column)
+			first_column = first[i];
+		if (last[i] > last_column)
+			last_column = last[i];
+		page_cost += WINDOW_COST(last[i] - first[i] + 1);
+	}
+
+	flush.count = 0;
+	flush.index = 0;
+	if (first_page == PAGES)
+		return 0;
+
+	uint16_t box = (last_column - first_column + 1) * (last_page - first_page + 1);
+	if (WINDOW_COST(box) <= page_cost)
+	{
+		add_window(first_column, last_column, first_page, last_page, 0);
+		return flush.count;
+	}
+
+	for (uint8_t i = first_page; i <= last_page; i++)
+		if (dirty & (1 << i))
+			offset += add_window(first[i], last[i], i, i, offset);
+	return flush.count;
+}
+
+/**
+ * @brief a window that could not be sent is marked dirty again, so that the next update sends it
+ *
+ * @param none
+ * @retval none
+ */
+static void flush_failed(void)
+{
+	for (uint8_t i = flush.index; i < flush.count; i++)
+		for (uint8_t page = flush.windows[i].command[4]; page <= flush.windows[i].command[5]; page++)
+			mark_dirty(page, flush.windows[i].command[1], flush.windows[i].command[2]);
+	display.Update_Status = HAL_ERROR;
+}
+
+#if DISPLAY_DMA
+/**
+ * @brief start the next transfer of the flush, the window command or its data
+ *
+ * @param none
+ * @retval status - status codes for the I2C transmission
+ */
+static HAL_StatusTypeDef flush_start_transfer(void)
+{
+	Display_Window* window = &flush.windows[flush.index];
+
+	if (!flush.data_stage)
+		return HAL_I2C_Mem_Write_DMA(&hi2c2, DISPLAY_ADDR, COMMAND_MODE, 1, window->command, sizeof(window->command));
+	return HAL_I2C_Mem_Write_DMA(&hi2c2, DISPLAY_ADDR, DATA_MODE, 1, DMA_ADDRESS(&front_buffer[window->offset]), window->size);
+}
+
+/**
+ * @brief end the flush and tell whoever waits for it
+ * @note an update that came in meanwhile stays pending, display_poll starts it. Copying it into the
+ *       front buffer takes too long for the interrupt
+ *
+ * @param status - how the flush went
+ * @retval none
+ */
+static void flush_done(HAL_StatusTypeDef status)
+{
+	if (status != HAL_OK)
+		flush_failed();
+	else
+		display.Update_Status = HAL_OK;
+
+	display.Flush_Busy = 0;
+	if (flush_callback != NULL)
+		flush_callback(status);
+}
+
+/**
+ * @brief a transfer of the flush is done, called from the I2C interrupt
+ *
+ * @param hi2c - the I2C handle of the transfer
+ * @retval none
+ */
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c->Instance != hi2c2.Instance || !display.Flush_Busy)
+		return;
+
+	if (flush.data_stage)
+	{
+		display.Flushed_Bytes += WINDOW_COST(flush.windows[flush.index].size);
+		flush.index++;
+		if (flush.index == flush.count)
+		{
+			flush_done(HAL_OK);
+			return;
+		}
+	}
+	flush.data_stage = !flush.data_stage;
+	if (flush_start_transfer() != HAL_OK)
+		flush_done(HAL_ERROR);
 }
 
+/**
+ * @brief a transfer of the flush failed, called from the I2C interrupt
+ *
+ * @param hi2c - the I2C handle of the transfer
+ * @retval none
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c->Instance != hi2c2.Instance || !display.Flush_Busy)
+		return;
+	flush_done(HAL_ERROR);
+}
+
+/**
+ * @brief a function for updating the contents of the display, from the display buffer
+ * @note the changes are copied to the front buffer and sent with DMA, the function returns at
+ *       once and drawing can go on. An update while a flush is in progress is left pending, and
+ *       display_poll starts it once the flush has ended
+ *
+ * @param none
+ * @retval none
+ */
+void display_update(void)
+{
+	DIRTY_LOCK();
+	if (display.Flush_Busy)
+	{
+		display.Flush_Pending = 1;
+		DIRTY_UNLOCK();
+		return;
+	}
+	display.Flush_Busy = 1;
+	display.Flush_Pending = 0;
+	DIRTY_UNLOCK();
+
+	if (prepare_flush() == 0)
+	{
+		flush_done(HAL_OK);
+		return;
+	}
+
+	flush.data_stage = 0;
+	if (flush_start_transfer() != HAL_OK)
+		flush_done(HAL_ERROR);
+}
+#else
+/**
+ * @brief a function for updating the contents of the display, from the display buffer
+ * @note blocks until the changes are sent, windows that fail stay dirty
+ *
+ * @param none
+ * @retval none
+ */
+void display_update(void)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+
+	prepare_flush();
+	for (; flush.index < flush.count; flush.index++)
+	{
+		Display_Window* window = &flush.windows[flush.index];
+
+		status = HAL_I2C_Mem_Write(&hi2c2, DISPLAY_ADDR, COMMAND_MODE, 1, window->command, sizeof(window->command), HAL_MAX_DELAY);
+		if (status == HAL_OK)
+			status = HAL_I2C_Mem_Write(&hi2c2, DISPLAY_ADDR, DATA_MODE, 1, &front_buffer[window->offset], window->size, HAL_MAX_DELAY);
+		if (status != HAL_OK)
+		{
+			flush_failed();
+			break;
+		}
+		display.Flushed_Bytes += WINDOW_COST(window->size);
+	}
+
+	if (status == HAL_OK)
+		display.Update_Status = HAL_OK;
+	if (flush_callback != NULL)
+		flush_callback(status);
+}
+#endif
+#else
 /**
  * @brief a function for updating the contents of the display, from the display buffer
+ * @note only the changed columns of the pages that changed since the last update are sent, a page
+ *       that fails stays dirty
  *
  * @param none
  * @retval none
@@ -182,8 +607,14 @@ void draw_pixel(uint8_t w, uint8_t h, Display_ColourDef colour)
 void display_update(void)
 {
 	HAL_StatusTypeDef status;
-	for(uint8_t i = 0; i < 8; i++)
+	for(uint8_t i = 0; i < PAGES; i++)
 	{
+		 if (!(display.Dirty_Pages & (1 << i)))
+			 continue;
+
+		 uint8_t first = display.Dirty_First[i];
+		 uint8_t length = display.Dirty_Last[i] - first + 1;
+
 		 status = command(0xB0 + i);
 		 if (status != HAL_OK)
 		 {
@@ -191,32 +622,106 @@ void display_update(void)
 		    goto end;
 		 }
 
-		 status = command(0x00);
+		 /* Page addressing, the column to start at is sent as two nibbles */
+		 status = command(0x00 | (first & 0x0F));
 		 if (status != HAL_OK)
 		 {
 			display.Update_Status = HAL_ERROR;
 			goto end;
 		 }
 
-		 status = command(0x10);
+		 status = command(0x10 | (first >> 4));
 		 if (status != HAL_OK)
 		 {
 			display.Update_Status = HAL_ERROR;
 			goto end;
 		 }
 
-		status = HAL_I2C_Mem_Write(&hi2c2, DISPLAY_ADDR, DATA_MODE, 1, &buffer[W * i], W, HAL_MAX_DELAY);
+		status = HAL_I2C_Mem_Write(&hi2c2, DISPLAY_ADDR, DATA_MODE, 1, &buffer[W * i + first], length, HAL_MAX_DELAY);
 		 if (status != HAL_OK)
 		 {
 			 display.Update_Status = HAL_ERROR;
 			 goto end;
 		 }
 
+		 /* Three commands and the columns, each transfer starts with its control byte */
+		 display.Flushed_Bytes += 3 * 2 + 1 + length;
+		 display.Dirty_Pages &= ~(1 << i);
 	}
 	display.Update_Status = HAL_OK;
 
 	end:
-	return;
+	if (flush_callback != NULL)
+		flush_callback(display.Update_Status);
+}
+#endif
+
+/**
+ * @brief mark the whole buffer as changed, everything is sent at the next update
+ *
+ * @param none
+ * @retval none
+ */
+void display_invalidate(void)
+{
+	for (uint8_t page = 0; page < PAGES; page++)
+		mark_dirty(page, 0, W - 1);
+}
+
+/**
+ * @brief tells if a flush is being sent, the screen buffer can be drawn in meanwhile
+ * @note a pending update is started here, see display_poll
+ *
+ * @param none
+ * @retval 1 while the flush is in progress
+ */
+uint8_t display_flush_in_progress(void)
+{
+	display_poll();
+	return display.Flush_Busy || display.Flush_Pending;
+}
+
+/**
+ * @brief start the update that was left pending during a flush, once the flush has ended
+ * @note call regularly from the main loop, not from an interrupt. Does nothing without DMA
+ *
+ * @param none
+ * @retval none
+ */
+void display_poll(void)
+{
+#if DISPLAY_DMA
+	if (display.Flush_Pending && !display.Flush_Busy)
+		display_update();
+#endif
+}
+
+/**
+ * @brief wait for the flush in progress and the one after it, if any, to be sent
+ *
+ * @param timeout - ms to wait at most
+ * @retval HAL_OK when done, HAL_TIMEOUT if not done in time
+ */
+HAL_StatusTypeDef display_wait_flush(uint32_t timeout)
+{
+	uint32_t start = HAL_GetTick();
+	while (display_flush_in_progress())
+	{
+		if (HAL_GetTick() - start >= timeout)
+			return HAL_TIMEOUT;
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief set the function called when a flush is done
+ *
+ * @param callback - the function, NULL for none
+ * @retval none
+ */
+void display_set_flush_callback(Display_FlushCallback callback)
+{
+	flush_callback = callback;
 }
 
 /**
@@ -231,26 +736,127 @@ void display_update(void)
  */
 void display_write_char(char c, FontDef Font, Display_ColourDef colour)
 {
-	uint32_t i, j, k;
+	uint8_t pages = FONT_PAGES(Font);
+	uint8_t shift = display.thisY % 8;
+
+	if (c < Font.FirstChar || c > Font.LastChar)
+		c = Font.FirstChar;
+	const uint8_t* glyph = &Font.columns[(c - Font.FirstChar) * pages * Font.FontWidth];
 
 	if (W <= (display.thisX + Font.FontWidth) || H <= (display.thisY + Font.FontHeight))
 		return;
 
-
-	for (i = 0; i < Font.FontHeight; i++)
+	/* The glyph is stored as whole bytes of the display, moved down by the rows the char starts into its page */
+	for (uint8_t i = 0; i < pages; i++)
 	{
-		k = Font.data[(c-32) * Font.FontHeight + i];
-		for (j = 0; j < Font.FontWidth; j++)
+		uint8_t rows = Font.FontHeight - 8 * i;
+		uint8_t mask = (rows >= 8) ? 0xFF : (1 << rows) - 1;
+		uint8_t page = display.thisY / 8 + i;
+
+		for (uint8_t j = 0; j < Font.FontWidth; j++)
 		{
-			if ((k << j) & 0x8000)
-				draw_pixel((display.thisX + j), (display.thisY + i), (Display_ColourDef) colour);
-			else
-				draw_pixel((display.thisX + j), (display.thisY + i), (Display_ColourDef)!colour);
+			uint8_t bits = (colour == WHITE) ? glyph[i * Font.FontWidth + j] : ~glyph[i * Font.FontWidth + j];
+			uint8_t x = display.thisX + j;
+
+			write_byte(page, x, bits << shift, mask << shift);
+			if (shift != 0)
+				write_byte(page + 1, x, bits >> (8 - shift), mask >> (8 - shift));
 		}
 	}
 	display.thisX += Font.FontWidth;
 }
 
+/**
+ * @brief draw a column of an area, rows first to last white and the other rows of the area black
+ * @note Every page of the column is written as one byte, for graphs that are drawn a column at a time.
+ * 		 first > last gives an empty column
+ *
+ * @param x - the column
+ * @param y - top row of the area
+ * @param height - rows of the area
+ * @param first - first white row, counted from the top of the display
+ * @param last - last white row
+ * @retval none
+ */
+void display_draw_column(uint8_t x, uint8_t y, uint8_t height, uint8_t first, uint8_t last)
+{
+	if (x >= W || height == 0)
+		return;
+
+	for (uint8_t page = y / 8; page <= (y + height - 1) / 8 && page < PAGES; page++)
+	{
+		uint8_t top = page * 8;
+		uint8_t mask = 0xFF;
+		uint8_t bits = 0;
+
+		if (y > top)
+			mask &= 0xFF << (y - top);
+		if (y + height < top + 8)
+			mask &= 0xFF >> (top + 8 - y - height);
+		for (uint8_t row = 0; row < 8; row++)
+			if (top + row >= first && top + row <= last)
+				bits |= 1 << row;
+
+		write_byte(page, x, bits, mask);
+	}
+}
+
+/**
+ * @brief move the columns of an area left, the columns that come in on the right are black
+ * @note The area is whole pages, y and height are rounded to them. Every column of the area changes
+ * 		 on the display, so all of it is sent by the next display_update
+ *
+ * @param x - left column of the area
+ * @param width - columns of the area
+ * @param y - top row of the area
+ * @param height - rows of the area
+ * @param columns - how far to move
+ * @retval none
+ */
+void display_scroll_left(uint8_t x, uint8_t width, uint8_t y, uint8_t height, uint8_t columns)
+{
+	if (x >= W || width == 0 || height == 0)
+		return;
+	if (x + width > W)
+		width = W - x;
+	if (columns > width)
+		columns = width;
+
+	for (uint8_t page = y / 8; page <= (y + height - 1) / 8 && page < PAGES; page++)
+	{
+		uint8_t *row = &buffer[page * W + x];
+
+		memmove(row, row + columns, width - columns);
+		memset(row + width - columns, 0, columns);
+		mark_dirty(page, x, x + width - 1);
+	}
+}
+
+/**
+ * @brief set the font of display_write_string and display_string_on_line
+ * @note The chars on a line and the lines on the display follow from the size of the font.
+ * 		 Fonts[FONT_LARGE] only has ' ' to '9', other chars are drawn as ' '
+ *
+ * @param id - FONT_SMALL, the default, or FONT_LARGE
+ * @retval none
+ */
+void display_set_font(FontId id)
+{
+	if (id < FONT_COUNT)
+		display.Font = Fonts[id];
+}
+
+/**
+ * @brief get the font of display_write_string and display_string_on_line
+ *
+ * @param none
+ * @retval the font, its width, height and RowSize tell how much room text takes
+ */
+const FontDef* display_get_font(void)
+{
+	return display.Font;
+}
+
 /**
  * @brief a function for writing strings on the display
  *
@@ -261,24 +867,27 @@ void display_write_char(char c, FontDef Font, Display_ColourDef colour)
  */
 void display_write_string(const char *str, Display_ColourDef colour)
 {
+	const FontDef* font = display.Font;
+	uint8_t max_chars = (W - 1) / font->FontWidth;
+	uint8_t max_rows = H / font->RowSize;
 	uint8_t char_counter = 0;
 	uint8_t row_counter = 0;
 
 	while (*str != 0)
 	{
-		display_write_char(*str, Font_7x10, colour);
+		display_write_char(*str, *font, colour);
 		char_counter++;
-		if (char_counter == MAX_CHARS)
+		if (char_counter == max_chars)
 		{
 			row_counter++;
-			if (row_counter > MAX_ROWS)
+			if (row_counter > max_rows)
 			{
 				display_error_message();
 				return;
 			}
 			else
 			{
-				display_set_position(1, (display.thisY + ROW_SIZE));
+				display_set_position(1, (display.thisY + font->RowSize));
 				char_counter = 0;
 			}
 		}
@@ -288,24 +897,27 @@ void display_write_string(const char *str, Display_ColourDef colour)
 }
 void display_write_string_no_update(const char *str, Display_ColourDef colour)
 {
+	const FontDef* font = display.Font;
+	uint8_t max_chars = (W - 1) / font->FontWidth;
+	uint8_t max_rows = H / font->RowSize;
 	uint8_t char_counter = 0;
 	uint8_t row_counter = 0;
 
 	while (*str != 0)
 	{
-		display_write_char(*str, Font_7x10, colour);
+		display_write_char(*str, *font, colour);
 		char_counter++;
-		if (char_counter == MAX_CHARS)
+		if (char_counter == max_chars)
 		{
 			row_counter++;
-			if (row_counter > MAX_ROWS)
+			if (row_counter > max_rows)
 			{
 				display_error_message();
 				return;
 			}
 			else
 			{
-				display_set_position(1, (display.thisY + ROW_SIZE));
+				display_set_position(1, (display.thisY + font->RowSize));
 				char_counter = 0;
 			}
 		}
@@ -315,21 +927,19 @@ void display_write_string_no_update(const char *str, Display_ColourDef colour)
 
 void display_string_on_line(const char *str, Display_ColourDef colour, uint8_t Line)
 {
-	if (Line < 1 || Line > MAX_ROWS)
+	if (Line < 1 || Line > H / display.Font->RowSize)
 	{return;}
 
-	display_set_position(1, Line * ROW_SIZE);
-	HAL_Delay(10);
+	display_set_position(1, Line * display.Font->RowSize);
 	display_write_string(str, colour);
 }
 
 void display_string_on_line_no_update(const char *str, Display_ColourDef colour, uint8_t Line)
 {
-	if (Line < 1 || Line > MAX_ROWS)
+	if (Line < 1 || Line > H / display.Font->RowSize)
 	{return;}
 
-	display_set_position(1, Line * ROW_SIZE);
-	HAL_Delay(10);
+	display_set_position(1, Line * display.Font->RowSize);
 	display_write_string_no_update(str, colour);
 	}
 /**
@@ -340,11 +950,13 @@ void display_string_on_line_no_update(const char *str, Display_ColourDef colour,
  */
 void display_error_message(void)
 {
+	const FontDef* font = display.Font;
+
+	/* The message fits in the default font only */
+	display.Font = &Font_7x10;
 	reset_screen_canvas();
-	HAL_Delay(100);
 	display_write_string("String too large! Please shorten it", WHITE);
-	display_update();
-    HAL_Delay(100);
+	display.Font = font;
 }
 
 /**
@@ -16,11 +16,16 @@
 #include "ESP8266.h"
 #include "CCS811_BME280.h"
 #include "ssd1306.h"
+#include "mqtt.h"
+#include "cbor.h"
 
 #define RUN_SSD1306_TEST
 #define RUN_ESP8266_TEST
 #define RUN_CCS811_TEST
 #define RUN_BME280_TEST
+#define RUN_MQTT_TEST
+#define RUN_CBOR_TEST
+#define RUN_HTTP_TEST
 
 ///////////////////////////////////////////////////
 // Undefine here to exclude some select test
@@ -42,6 +47,10 @@ UNITY_BEGIN();
 
 	/* Display init test */
 	RUN_TEST(test_display_init);
+	RUN_TEST(test_display_dirty_pages);
+
+	/* Prints the time of a whole frame, build with DISPLAY_DMA or DISPLAY_HORIZONTAL_ADDRESSING 0 to compare */
+	RUN_TEST(test_display_benchmark);
 
 #endif
 
@@ -59,18 +68,77 @@ UNITY_BEGIN();
 	/* Test initiation of ESP8266 */
   	RUN_TEST(test_esp8266_init);
 
+    /* Test the baud rate negotiated by init */
+    RUN_TEST(test_esp8266_baud_rate);
+
     /* Test connecting to wifi */
     RUN_TEST(test_esp8266_wifi_connect);
 
+    /* Test that the AP is remembered, and that joining again is skipped */
+    RUN_TEST(test_esp8266_wifi_rejoin);
+
+    /* Test looking up the website once and using the cached address */
+    RUN_TEST(test_esp8266_dns_lookup);
+
+    /* Test modem sleep and waking up again */
+    RUN_TEST(test_esp8266_sleep);
+
     /* Test connecting to a website */
     RUN_TEST(test_esp8266_web_connection);
 
+    /* Test assembling a http post request with a body */
+    RUN_TEST(test_esp8266_http_post_request);
+
+    /* Test assembling the same request from segments */
+    RUN_TEST(test_esp8266_request_segments);
+
+    /* Test making a http web request that keeps the connection open */
+    RUN_TEST(test_esp8266_web_request_keep_alive);
+
+    /* Test sending a request larger than one cipsend */
+    RUN_TEST(test_esp8266_send_large_data);
+
+    /* Test sending a request in passthrough mode and going back to normal mode */
+    RUN_TEST(test_esp8266_passthrough);
+
     /* Test making a http web request to connected website */
     RUN_TEST(test_esp8266_web_request);
     HAL_Delay(2000);
 
 #endif
 
+/* Run test for the MQTT client
+ * Only the packet encoding and the handling of broker replies are tested, no broker is needed */
+#ifdef RUN_MQTT_TEST
+
+    RUN_TEST(test_mqtt_encode_connect);
+    RUN_TEST(test_mqtt_encode_publish);
+    RUN_TEST(test_mqtt_encode_publish_long);
+    RUN_TEST(test_mqtt_check_ack);
+
+#endif
+
+/* Run test for the CBOR encoding
+ * The benchmark prints the size and encode time of a batch as csv and as cbor */
+#ifdef RUN_CBOR_TEST
+
+    RUN_TEST(test_cbor_encode_reading);
+    RUN_TEST(test_cbor_encode_int);
+    RUN_TEST(test_cbor_benchmark);
+
+#endif
+
+/* Run test for the HTTP response parser
+ * The responses are fed byte by byte, the same way the uart interrupt does it */
+#ifdef RUN_HTTP_TEST
+
+    RUN_TEST(test_http_response_content_length);
+    RUN_TEST(test_http_response_chunked);
+    RUN_TEST(test_http_response_close);
+    RUN_TEST(test_http_form_value);
+
+#endif
+
 /* Run test for CCS811
  * Does not test reading the values, since these vary depending on environment	*/
 #ifdef RUN_CCS811_TEST
@@ -99,6 +167,17 @@ void setUp(void){}
 /* Teardown */
 void tearDown(void){}
 
+/* Copies the segments of a request into one string, for the tests that send a plain buffer */
+static uint16_t request_join(const ESP8266_REQUEST* request, char* buffer){
+	uint16_t len = 0;
+	for(uint8_t i = 0; i < request->count; i++){
+		memcpy(&buffer[len], request->segments[i].data, request->segments[i].len);
+		len += request->segments[i].len;
+	}
+	buffer[len] = '\0';
+	return len;
+}
+
 void test_BME280_init(void){
 	TEST_ASSERT_EQUAL_UINT(BME280_SUCCESS, BME280_init());
 }
@@ -107,10 +186,55 @@ void test_esp8266_init(void){
 	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
 }
 
+void test_esp8266_baud_rate(void){
+	char uart_command[64] = {0};
+	esp8266_get_uart_command(uart_command, 921600, true);
+	TEST_ASSERT_EQUAL_STRING("AT+UART_CUR=921600,8,1,0,2\r\n", uart_command);
+
+	/* Whatever rate init settled on, the module should answer at it */
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(ESP8266_DEFAULT_BAUD_RATE, esp8266_baud_rate());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(ESP8266_AT));
+}
+
 void test_esp8266_wifi_connect(void){
 	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init());
 }
 
+void test_esp8266_wifi_rejoin(void){
+	TEST_ASSERT_EQUAL_UINT(ESP8266_BSSID_SIZE - 1, strlen(esp8266_wifi_bssid()));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init());
+
+	char wifi_command[256] = {0};
+	char expected[256] = {0};
+	esp8266_get_wifi_bssid_command(wifi_command, "ca:d7:19:d8:a6:44");
+	sprintf(expected, "AT+CWJAP=\"%s\",\"%s\",\"ca:d7:19:d8:a6:44\"\r\n", SSID, PWD);
+	TEST_ASSERT_EQUAL_STRING(expected, wifi_command);
+}
+
+void test_esp8266_dns_lookup(void){
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	const char* ip = esp8266_dns_lookup(host);
+	TEST_ASSERT_EQUAL_UINT(strlen(ip), strspn(ip, "0123456789."));
+
+	/* Cached, no new lookup */
+	TEST_ASSERT_EQUAL_PTR(ip, esp8266_dns_lookup(host));
+
+	/* Addresses are used as they are */
+	TEST_ASSERT_EQUAL_STRING("10.0.0.1", esp8266_dns_lookup("10.0.0.1"));
+}
+
+void test_esp8266_sleep(void){
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_sleep(ESP8266_SLEEP_MODEM, 0));
+	TEST_ASSERT_EQUAL_UINT(ESP8266_SLEEP_MODEM, esp8266_sleep_mode());
+
+	/* The uart still works in modem sleep */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(ESP8266_AT));
+
+	esp8266_wake_start();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_wake_finish());
+	TEST_ASSERT_EQUAL_UINT(ESP8266_SLEEP_NONE, esp8266_sleep_mode());
+}
+
 void test_esp8266_web_connection(void){
 	char connection_command[256] = {0};
 	char remote_ip[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
@@ -129,13 +253,118 @@ void test_esp8266_web_request(void){
 	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
 
 	//	uint8_t len = esp8266_http_get_request(request, HTTP_GET, uri, host);
-	uint8_t len = esp8266_http_get_request(request, HTTP_POST, uri, host);
+	uint16_t len = esp8266_http_get_request(request, HTTP_POST, uri, host);
 	esp8266_get_at_send_command(init_send, len);
 
 	test_esp8266_at_send(init_send);
 	test_esp8266_send_data(request);
 }
 
+void test_esp8266_web_request_keep_alive(void){
+	char request[256] = {0};
+	char init_send[64] = {0};
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	ESP8266_REQUEST segments;
+
+	esp8266_request_init(&segments);
+	esp8266_request_add_string(&segments, HTTP_POST);
+	esp8266_request_add_string(&segments, "/api/sensor/airquality?data=22335");
+	esp8266_request_http_headers(&segments, host, true, NULL, 0);
+	uint16_t len = request_join(&segments, request);
+	esp8266_get_at_send_command(init_send, len);
+
+	test_esp8266_at_send(init_send);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send_data_keep_alive(request));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_connection_status());
+}
+
+void test_esp8266_http_post_request(void){
+	char request[512] = {0};
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	char body[] = "timestamp,carbon,volatile,temperature,humidity\n1000,400,0,21.50,40.00\n";
+	ESP8266_REQUEST segments;
+
+	esp8266_request_init(&segments);
+	esp8266_request_add_string(&segments, HTTP_POST);
+	esp8266_request_add_string(&segments, "/api/sensor/batch?now=1000");
+	esp8266_request_http_headers(&segments, host, true, "text/csv", strlen(body));
+	esp8266_request_add_string(&segments, body);
+
+	uint16_t len = request_join(&segments, request);
+	TEST_ASSERT_EQUAL_UINT(strlen(request), len);
+	TEST_ASSERT_NOT_NULL(strstr(request, "Content-Length: 70\r\n\r\n"));
+	TEST_ASSERT_EQUAL_STRING(body, &request[len - strlen(body)]);
+}
+
+void test_esp8266_request_segments(void){
+	char joined[512] = {0};
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	char body[] = "timestamp,carbon,volatile,temperature,humidity\n1000,400,0,21.50,40.00\n";
+	ESP8266_REQUEST segments;
+
+	esp8266_request_init(&segments);
+	esp8266_request_add_string(&segments, HTTP_POST);
+	esp8266_request_add_string(&segments, "/api/sensor/batch?now=");
+	esp8266_request_add_uint(&segments, 1000);
+	esp8266_request_http_headers(&segments, host, true, "text/csv", strlen(body));
+	esp8266_request_add_string(&segments, body);
+	TEST_ASSERT_FALSE(segments.overflow);
+
+	/* The whole request, with the number formatted into its own segment */
+	request_join(&segments, joined);
+	TEST_ASSERT_EQUAL_STRING("POST /api/sensor/batch?now=1000 HTTP/1.1\r\n"
+							 "Host: ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net\r\n"
+							 "Connection: keep-alive\r\n"
+							 "Content-Type: text/csv\r\n"
+							 "Content-Length: 70\r\n\r\n"
+							 "timestamp,carbon,volatile,temperature,humidity\n1000,400,0,21.50,40.00\n", joined);
+
+	/* Fixed point numbers */
+	esp8266_request_init(&segments);
+	esp8266_request_add_fixed(&segments, 2153, 2);
+	esp8266_request_add_fixed(&segments, -5, 2);
+	esp8266_request_add_fixed(&segments, 0, 0);
+	TEST_ASSERT_EQUAL_STRING_LEN("21.53", segments.segments[0].data, segments.segments[0].len);
+	TEST_ASSERT_EQUAL_STRING_LEN("-0.05", segments.segments[1].data, segments.segments[1].len);
+	TEST_ASSERT_EQUAL_STRING_LEN("0", segments.segments[2].data, segments.segments[2].len);
+}
+
+void test_esp8266_send_large_data(void){
+	static char request[3000] = {0};
+	static char body[2500] = {0};
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	ESP8266_REQUEST segments;
+
+	/* Body larger than ESP8266_CIPSEND_MAX, needs to be sent in two chunks */
+	memset(body, 'a', sizeof(body) - 1);
+	esp8266_request_init(&segments);
+	esp8266_request_add_string(&segments, HTTP_POST);
+	esp8266_request_add_string(&segments, "/api/sensor/batch");
+	esp8266_request_http_headers(&segments, host, true, "text/plain", strlen(body));
+	esp8266_request_add_string(&segments, body);
+	uint16_t len = request_join(&segments, request);
+	TEST_ASSERT_GREATER_THAN_UINT(ESP8266_CIPSEND_MAX, len);
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send_large_data(request, len));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_wait_response());
+}
+
+void test_esp8266_passthrough(void){
+	char host[] = "ii1302-project-office-enviroment-monitor.eu-gb.mybluemix.net";
+	ESP8266_REQUEST segments;
+
+	esp8266_request_init(&segments);
+	esp8266_request_add_string(&segments, HTTP_POST);
+	esp8266_request_add_string(&segments, "/api/sensor/airquality?data=22335");
+	esp8266_request_http_headers(&segments, host, true, NULL, 0);
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_start());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_send_request(&segments));
+	TEST_ASSERT_TRUE(esp8266_wait_for(HTTP_VERSION, ESP8266_RESPONSE_TIMEOUT));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_stop());
+	TEST_ASSERT_FALSE(esp8266_passthrough_active());
+}
+
 void test_CCS811_init(void){
 	TEST_ASSERT_EQUAL_UINT(CCS811_SUCCESS, CCS811_init());
 }
@@ -152,3 +381,244 @@ void test_display_init(void){
 	display_init();
 	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_get_init_status());
 }
+
+void test_display_dirty_pages(void){
+	display_init();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+
+	/* Rows 12 to 21 are pages 1 and 2 */
+	display_set_position(1, 12);
+	display_write_char('7', Font_7x10, WHITE);
+	TEST_ASSERT_EQUAL_HEX8(0x06, display_get_dirty_pages());
+
+	uint32_t flushed = display_get_flushed_bytes();
+	display_update();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+	/* Two pages of three commands and at most the 7 columns of the char, not two whole pages */
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * (3 * 2 + 1 + 7), display_get_flushed_bytes() - flushed);
+
+	/* The same char again changes nothing and nothing is sent */
+	display_set_position(1, 12);
+	display_write_char('7', Font_7x10, WHITE);
+	flushed = display_get_flushed_bytes();
+	display_update();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	TEST_ASSERT_EQUAL_UINT32(0, display_get_flushed_bytes() - flushed);
+}
+
+void test_display_benchmark(void){
+	char	 message[96];
+	uint32_t call_cycles, frame_cycles;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL		 |= DWT_CTRL_CYCCNTENA_Msk;
+
+	display_init();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	display_invalidate();
+	DWT->CYCCNT = 0;
+	display_update();
+	call_cycles = DWT->CYCCNT;
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	frame_cycles = DWT->CYCCNT;
+
+	/* With DMA the call returns long before the frame is sent, without they are the same */
+	sprintf(message, "%s addressing%s, display_update %lu cycles, whole frame %lu cycles",
+			DISPLAY_HORIZONTAL_ADDRESSING ? "horizontal" : "page", DISPLAY_DMA ? " with dma" : "",
+			(unsigned long) call_cycles, (unsigned long) frame_cycles);
+	TEST_MESSAGE(message);
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_get_update_status());
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+}
+
+void test_mqtt_encode_connect(void){
+	uint8_t packet[32] = {0};
+	const uint8_t expected[] = {0x10, 0x0F, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x3C, 0x00, 0x03, 'o', 'e', 'm'};
+
+	TEST_ASSERT_EQUAL_UINT(sizeof(expected), mqtt_encode_connect(packet, sizeof(packet), "oem", 60));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, packet, sizeof(expected));
+
+	/* Does not fit */
+	TEST_ASSERT_EQUAL_UINT(0, mqtt_encode_connect(packet, 8, "oem", 60));
+}
+
+void test_mqtt_encode_publish(void){
+	uint8_t packet[32] = {0};
+	const uint8_t expected[] = {0x32, 0x09, 0x00, 0x03, 'a', '/', 'b', 0x00, 0x0A, '1', '2'};
+
+	TEST_ASSERT_EQUAL_UINT(sizeof(expected), mqtt_encode_publish(packet, sizeof(packet), "a/b", (const uint8_t*) "12", 2, 1, 10));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, packet, sizeof(expected));
+}
+
+void test_mqtt_encode_publish_long(void){
+	static uint8_t packet[256] = {0};
+	static uint8_t payload[200] = {0};
+
+	/* Remaining length 203 needs two bytes, 0xCB 0x01 */
+	TEST_ASSERT_EQUAL_UINT(206, mqtt_encode_publish(packet, sizeof(packet), "t", payload, sizeof(payload), 0, 0));
+	TEST_ASSERT_EQUAL_HEX8(0x30, packet[0]);
+	TEST_ASSERT_EQUAL_HEX8(0xCB, packet[1]);
+	TEST_ASSERT_EQUAL_HEX8(0x01, packet[2]);
+}
+
+void test_mqtt_check_ack(void){
+	const uint8_t connack_accepted[] = {0x20, 0x02, 0x00, 0x00};
+	const uint8_t connack_refused[]  = {0x20, 0x02, 0x00, 0x05};
+	const uint8_t puback[]  		 = {0x40, 0x02, 0x00, 0x0A};
+	const uint8_t pingresp[]  		 = {0xD0, 0x00};
+
+	TEST_ASSERT_EQUAL_UINT(MQTT_SUCCESS, mqtt_check_ack(connack_accepted, 4, MQTT_CONNACK, 0));
+	TEST_ASSERT_EQUAL_UINT(MQTT_REFUSED, mqtt_check_ack(connack_refused, 4, MQTT_CONNACK, 0));
+	TEST_ASSERT_EQUAL_UINT(MQTT_SUCCESS, mqtt_check_ack(puback, 4, MQTT_PUBACK, 10));
+	TEST_ASSERT_EQUAL_UINT(MQTT_NO_ACK,  mqtt_check_ack(puback, 4, MQTT_PUBACK, 11));
+	TEST_ASSERT_EQUAL_UINT(MQTT_SUCCESS, mqtt_check_ack(pingresp, 2, MQTT_PINGRESP, 0));
+	TEST_ASSERT_EQUAL_UINT(MQTT_NO_ACK,  mqtt_check_ack(puback, 0, MQTT_PUBACK, 10));
+}
+
+void test_cbor_encode_reading(void){
+	uint8_t buffer[16] = {0};
+	CBOR_WRITER writer;
+	/* [412, 5, 2137, 4550] */
+	const uint8_t expected[] = {0x84, 0x19, 0x01, 0x9C, 0x05, 0x19, 0x08, 0x59, 0x19, 0x11, 0xC6};
+
+	cbor_writer_init(&writer, buffer, sizeof(buffer));
+	cbor_put_reading(&writer, 412, 5, 21.37f, 45.5f);
+	TEST_ASSERT_FALSE(writer.overflow);
+	TEST_ASSERT_EQUAL_UINT(sizeof(expected), writer.len);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+
+	/* Does not fit, nothing is written past the end */
+	cbor_writer_init(&writer, buffer, 6);
+	cbor_put_reading(&writer, 412, 5, 21.37f, 45.5f);
+	TEST_ASSERT_TRUE(writer.overflow);
+	TEST_ASSERT_EQUAL_UINT(5, writer.len);
+}
+
+void test_cbor_encode_int(void){
+	uint8_t buffer[32] = {0};
+	CBOR_WRITER writer;
+	/* 23, 24, -1, -525, 70000 */
+	const uint8_t expected[] = {0x17, 0x18, 0x18, 0x20, 0x39, 0x02, 0x0C, 0x1A, 0x00, 0x01, 0x11, 0x70};
+
+	cbor_writer_init(&writer, buffer, sizeof(buffer));
+	cbor_put_int(&writer, 23);
+	cbor_put_int(&writer, 24);
+	cbor_put_int(&writer, -1);
+	cbor_put_int(&writer, cbor_fixed(-5.25f));
+	cbor_put_uint(&writer, 70000);
+	TEST_ASSERT_EQUAL_UINT(sizeof(expected), writer.len);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_cbor_benchmark(void){
+	static char	   csv[30 * 48 + 64];
+	static uint8_t cbor[30 * 48 + 64];
+	char		   message[96];
+	CBOR_WRITER    writer;
+	uint32_t	   csv_cycles, cbor_cycles;
+	uint16_t	   csv_len = 0;
+
+	/* The cycle counter gives the encode time, HAL_GetTick is too coarse */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL		 |= DWT_CTRL_CYCCNTENA_Msk;
+
+	/* A full batch of one sample per second, formatted the same way as build_batch_body */
+	DWT->CYCCNT = 0;
+	csv_len = sprintf(csv, "timestamp,carbon,volatile,temperature,humidity\n");
+	for(uint16_t i = 0; i < 30; i++)
+		csv_len += sprintf(&csv[csv_len], "%lu,%u,%u,%.2f,%.2f\n", (unsigned long) (600000 + i * 1000),
+						   412 + i, 25 + i, 21.5f + i * 0.01f, 38.25f + i * 0.01f);
+	csv_cycles = DWT->CYCCNT;
+
+	DWT->CYCCNT = 0;
+	cbor_writer_init(&writer, cbor, sizeof(cbor));
+	cbor_put_batch(&writer, 630000, 600000, 30);
+	for(uint16_t i = 0; i < 30; i++)
+		cbor_put_sample(&writer, (i == 0) ? 0 : 1000, 412 + i, 25 + i, 21.5f + i * 0.01f, 38.25f + i * 0.01f);
+	cbor_cycles = DWT->CYCCNT;
+
+	sprintf(message, "csv %u bytes %lu cycles, cbor %u bytes %lu cycles", csv_len, (unsigned long) csv_cycles,
+			writer.len, (unsigned long) cbor_cycles);
+	TEST_MESSAGE(message);
+
+	TEST_ASSERT_FALSE(writer.overflow);
+	TEST_ASSERT_LESS_THAN_UINT(csv_len, writer.len);
+	TEST_ASSERT_LESS_THAN_UINT32(csv_cycles, cbor_cycles);
+}
+
+void test_http_response_content_length(void){
+	HTTP_RESPONSE response;
+	const char answer[] = "HTTP/1.1 200 OK\r\ncontent-length: 21\r\nConnection: keep-alive\r\n\r\ninterval=60&batch=20\n";
+
+	http_response_init(&response);
+	/* Everything but the last byte, the body is not complete yet */
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_BODY, http_response_feed_data(&response, answer, strlen(answer) - 1));
+	TEST_ASSERT_FALSE(http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_DONE, http_response_feed(&response, answer[strlen(answer) - 1]));
+
+	TEST_ASSERT_EQUAL_UINT(200, response.status);
+	TEST_ASSERT_EQUAL_INT(21, response.content_length);
+	TEST_ASSERT_FALSE(response.connection_close);
+	TEST_ASSERT_EQUAL_STRING("interval=60&batch=20\n", response.body);
+
+	/* Anything after the response is ignored */
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_DONE, http_response_feed_data(&response, "HTTP/1.1", 8));
+	TEST_ASSERT_EQUAL_UINT(21, response.body_received);
+}
+
+void test_http_response_chunked(void){
+	HTTP_RESPONSE response;
+	const char answer[] = "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n"
+						  "9\r\ninterval=\r\n3;ext=1\r\n120\r\n0\r\n\r\n";
+
+	http_response_init(&response);
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_DONE, http_response_feed_data(&response, answer, strlen(answer)));
+	TEST_ASSERT_EQUAL_UINT(201, response.status);
+	TEST_ASSERT_TRUE(response.chunked);
+	TEST_ASSERT_EQUAL_STRING("interval=120", response.body);
+
+	/* Not a chunk size */
+	const char invalid[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n";
+	http_response_init(&response);
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_ERROR, http_response_feed_data(&response, invalid, strlen(invalid)));
+}
+
+void test_http_response_close(void){
+	HTTP_RESPONSE response;
+	const char answer[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\nbad sample";
+
+	/* Without Content-Length the body ends when the connection is closed */
+	http_response_init(&response);
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_BODY, http_response_feed_data(&response, answer, strlen(answer)));
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_DONE, http_response_finish(&response));
+	TEST_ASSERT_EQUAL_UINT(400, response.status);
+	TEST_ASSERT_TRUE(response.connection_close);
+	TEST_ASSERT_TRUE(HTTP_CLIENT_ERROR(response.status));
+	TEST_ASSERT_EQUAL_STRING("bad sample", response.body);
+
+	/* Closed in the middle of the headers */
+	http_response_init(&response);
+	http_response_feed_data(&response, answer, 20);
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_ERROR, http_response_finish(&response));
+
+	/* Not http */
+	http_response_init(&response);
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_ERROR, http_response_feed_data(&response, "CLOSED\r\n", 8));
+}
+
+void test_http_form_value(void){
+	int32_t value = 0;
+
+	TEST_ASSERT_TRUE(http_form_value("interval=60&batch=20&drive_mode=2", "batch", &value));
+	TEST_ASSERT_EQUAL_INT(20, value);
+	TEST_ASSERT_TRUE(http_form_value("interval=60\r\ndrive_mode=2\r\n", "drive_mode", &value));
+	TEST_ASSERT_EQUAL_INT(2, value);
+
+	/* A key that only starts the same, a value that is not a number, and no value */
+	TEST_ASSERT_FALSE(http_form_value("batch_size=5", "batch", &value));
+	TEST_ASSERT_FALSE(http_form_value("batch=5x", "batch", &value));
+	TEST_ASSERT_FALSE(http_form_value("interval=60", "batch", &value));
+	TEST_ASSERT_EQUAL_INT(2, value);
+}
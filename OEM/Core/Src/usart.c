@@ -86,6 +86,15 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     HAL_NVIC_EnableIRQ(UART4_IRQn);
   /* USER CODE BEGIN UART4_MspInit 1 */
     HAL_NVIC_SetPriority(UART4_IRQn, 5, 5);
+
+    /* RTS is only used after uart4_reconfigure has enabled flow control.
+     * PA15 ------> UART4_RTS, wired to the CTS pin of the ESP8266 (GPIO13).
+     * UART4_CTS is on PB7 which is taken by I2C1_SDA, so only RTS is used.
+     */
+    if(uartHandle->Init.HwFlowCtl & UART_HWCONTROL_RTS){
+      GPIO_InitStruct.Pin = GPIO_PIN_15;
+      HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    }
   /* USER CODE END UART4_MspInit 1 */
   }
 }
@@ -110,12 +119,23 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     /* UART4 interrupt Deinit */
     HAL_NVIC_DisableIRQ(UART4_IRQn);
   /* USER CODE BEGIN UART4_MspDeInit 1 */
+    if(uartHandle->Init.HwFlowCtl & UART_HWCONTROL_RTS)
+      HAL_GPIO_DeInit(GPIOA, GPIO_PIN_15);
 
   /* USER CODE END UART4_MspDeInit 1 */
   }
 }
 
 /* USER CODE BEGIN 1 */
+HAL_StatusTypeDef uart4_reconfigure(uint32_t baud_rate, uint32_t flow_control)
+{
+  if (HAL_UART_DeInit(&huart4) != HAL_OK)
+    return HAL_ERROR;
+
+  huart4.Init.BaudRate = baud_rate;
+  huart4.Init.HwFlowCtl = flow_control;
+  return HAL_UART_Init(&huart4);
+}
 
 /* USER CODE END 1 */
 
@@ -0,0 +1,67 @@
+/**
+******************************************************************************
+@brief header for the CBOR decoder of the host tests
+@details Decodes what cbor.c encodes, unsigned and negative integers and
+		 arrays, so the tests can check what the device sends. The firmware
+		 only encodes, so the decoder is not part of Core.
+
+		 Usage:
+		 CBOR_READER reader;
+		 cbor_reader_init(&reader, buffer, len);
+		 cbor_get_array(&reader, &count);
+		 ...
+		 if(!reader.error)
+			use(count);
+
+@file cbor_reader.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_CBOR_READER_H_
+#define HOST_CBOR_READER_H_
+
+#include "cbor.h"
+
+/* Decoder state, reads from buffer */
+typedef struct
+{
+	const uint8_t* buffer;
+	uint16_t	   len;				// bytes in the buffer
+	uint16_t	   pos;				// next byte to read
+	bool		   error;			// set on a type mismatch or when reading past the end
+} CBOR_READER;
+
+/**
+ * @brief start decoding a buffer.
+ * @param CBOR_READER* reader, the decoder state
+ * @param const uint8_t* buffer, the encoded data
+ * @param uint16_t len, number of bytes in the buffer
+ * @return None
+ */
+void cbor_reader_init(CBOR_READER* reader, const uint8_t* buffer, uint16_t len);
+
+/**
+ * @brief decode an unsigned integer.
+ * @param CBOR_READER* reader, the decoder state
+ * @param uint32_t* value, where the value is stored
+ * @return bool, false if the next item is not an unsigned integer
+ */
+bool cbor_get_uint(CBOR_READER* reader, uint32_t* value);
+
+/**
+ * @brief decode an unsigned or negative integer.
+ * @param CBOR_READER* reader, the decoder state
+ * @param int32_t* value, where the value is stored
+ * @return bool, false if the next item is not an integer or does not fit in 32 bits
+ */
+bool cbor_get_int(CBOR_READER* reader, int32_t* value);
+
+/**
+ * @brief decode the header of an array.
+ * @param CBOR_READER* reader, the decoder state
+ * @param uint16_t* count, where the number of items is stored
+ * @return bool, false if the next item is not an array
+ */
+bool cbor_get_array(CBOR_READER* reader, uint16_t* count);
+
+#endif /* HOST_CBOR_READER_H_ */
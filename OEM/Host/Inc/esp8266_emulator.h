@@ -0,0 +1,204 @@
+/**
+******************************************************************************
+@brief header for the host ESP8266 emulator
+@details A Linux stand-in for the ESP8266 running the Espressif AT firmware,
+		 speaking the subset of the AT dialect that ESP8266.c uses:
+		 AT, AT+RST, AT+GMR, AT+CWMODE, AT+CWJAP, AT+CIPMUX, AT+CIPSTART,
+		 AT+CIPSEND with the > prompt, SEND OK, +IPD and CLOSED, AT+CIPCLOSE,
+		 AT+CIPSTATUS, AT+CIPMODE and passthrough with +++, AT+CIPDOMAIN,
+		 AT+CIPSTA_CUR, AT+UART_CUR, AT+SLEEP, AT+WAKEUPGPIO and AT+GSLP.
+
+		 AT+CIPSTART opens a real socket, TCP or UDP, to connect_host. Host
+		 names are never resolved, AT+CIPDOMAIN answers with connect_host, so
+		 the firmware can keep its real host names and ports while talking to
+		 a server on localhost.
+
+		 Every byte sent to the firmware is given the time it is due. The time
+		 includes the latency before an answer, the uart time of each byte at
+		 the current rate, and the gaps between fragments. Bytes are only
+		 delivered while both sides use the same baud rate, so a rate change
+		 that only one side makes loses the link as it would on the board.
+		 Passthrough data is sent to the socket as the module does it, in a
+		 packet after 20 ms without uart bytes or once 2048 bytes are in.
+
+		 Faults can be injected per command, and a fraction of the bytes to
+		 the firmware can be dropped. Drops use a seeded generator, so a run
+		 can be repeated exactly.
+
+		 Usage, see hal_shim.c:
+		 ESP8266_EMULATOR_CONFIG config;
+		 esp8266_emulator_default_config(&config);
+		 config.port = 8080;
+		 esp8266_emulator_start(&config, deliver_byte_to_uart_callback);
+		 then from HAL_UART_Init:	  esp8266_emulator_host_baud_rate(baud_rate);
+		 from HAL_UART_Transmit:  esp8266_emulator_write(data, len);
+		 and from HAL_GetTick:	  esp8266_emulator_poll();
+
+@file esp8266_emulator.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_ESP8266_EMULATOR_H_
+#define HOST_ESP8266_EMULATOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EMULATOR_DEFAULT_BAUD_RATE	115200	// rate after a restart
+#define EMULATOR_BOOT_BAUD_RATE		74880	// rate of the boot messages, never readable by the firmware
+#define EMULATOR_QUEUE_SIZE			65536	// bytes waiting to be delivered to the firmware
+#define EMULATOR_LINE_SIZE			512		// longest command
+#define EMULATOR_CIPSEND_MAX		2048	// longest AT+CIPSEND
+#define EMULATOR_FAULTS				8		// faults that can be waiting at the same time
+
+/* What an injected fault does to the command it hits */
+typedef enum
+{
+	EMULATOR_FAULT_ERROR = 0,		// answer ERROR instead of doing the command
+	EMULATOR_FAULT_SILENT,			// do not answer at all, the firmware has to time out
+	EMULATOR_FAULT_BUSY,			// answer busy p... and then ERROR, as when the module is still working
+	EMULATOR_FAULT_CLOSE			// the server closes the connection just before the command
+} ESP8266_EMULATOR_FAULT;
+
+typedef struct
+{
+	/* Access point */
+	const char* ssid;				// the only AP that can be joined
+	const char* password;
+	const char* bssid;				// reported by AT+CWJAP?, a join with another bssid fails with +CWJAP:3
+	bool		joined;				// associated when started, as if it had joined before the firmware started
+	uint32_t	join_time;			// ms a join takes, also after a restart when it joins by itself
+
+	/* Network */
+	const char* connect_host;		// address every AT+CIPSTART connects to, and the answer to AT+CIPDOMAIN
+	uint16_t	port;				// port every AT+CIPSTART connects to, 0 uses the port in the command
+	uint16_t	ipd_size;			// max bytes in one +IPD message, the ESP8266 uses 1460
+
+	/* Timing */
+	uint32_t	latency;			// ms from the end of a command, or from data arriving on the socket, to the answer
+	uint16_t	fragment_size;		// bytes sent to the firmware back to back, 0 sends everything back to back
+	uint32_t	fragment_gap;		// ms between fragments
+	bool		uart_timing;		// add the time each byte takes on the uart at the current rate
+	uint32_t	boot_time;			// ms from a restart until ready
+	uint32_t	escape_guard;		// ms of silence needed around +++
+
+	/* Faults */
+	uint32_t	drop_rate;			// bytes to the firmware lost per million
+	uint32_t	seed;				// seed for the drops
+	bool		echo;				// echo commands, as the AT firmware does by default (ATE1)
+} ESP8266_EMULATOR_CONFIG;
+
+/* Counters, reset by esp8266_emulator_start */
+typedef struct
+{
+	uint32_t commands;				// AT commands received
+	uint32_t faults;				// injected faults that were used
+	uint32_t restarts;				// AT+RST, reset pin and wake ups from deep sleep
+	uint32_t connections;			// sockets opened by AT+CIPSTART
+	uint32_t ipd_messages;			// +IPD messages sent to the firmware
+	uint32_t bytes_to_socket;		// payload sent to the server
+	uint32_t bytes_from_socket;		// payload received from the server
+	uint32_t bytes_to_host;			// bytes delivered to the firmware
+	uint32_t bytes_from_host;		// bytes received from the firmware
+	uint32_t bytes_dropped;			// bytes lost on the way to the firmware, by drop_rate
+	uint32_t bytes_garbled;			// bytes lost because the two sides used different rates
+} ESP8266_EMULATOR_STATS;
+
+/**
+ * @brief fill in the defaults: ssid and password from login.h, joined, 127.0.0.1, no latency,
+ * 		  no fragmentation and no faults.
+ * @param ESP8266_EMULATOR_CONFIG* config, the configuration to fill in
+ * @return None
+ */
+void esp8266_emulator_default_config(ESP8266_EMULATOR_CONFIG* config);
+
+/**
+ * @brief power on the emulated module. It starts awake at EMULATOR_DEFAULT_BAUD_RATE, without waiting for boot_time.
+ * @param const ESP8266_EMULATOR_CONFIG* config, copied, change it later with esp8266_emulator_config
+ * @param void (*deliver)(uint8_t), called for every byte that reaches the firmware
+ * @return None
+ */
+void esp8266_emulator_start(const ESP8266_EMULATOR_CONFIG* config, void (*deliver)(uint8_t));
+
+/**
+ * @brief power off the emulated module, the socket is closed and everything not yet delivered is lost.
+ * @param void
+ * @return None
+ */
+void esp8266_emulator_stop(void);
+
+/**
+ * @brief the configuration in use, changes take effect from the next command or byte.
+ * @param void
+ * @return ESP8266_EMULATOR_CONFIG*, the configuration
+ */
+ESP8266_EMULATOR_CONFIG* esp8266_emulator_config(void);
+
+/**
+ * @brief read the socket and deliver the bytes that are due. Call it often, hal_shim.c calls it from HAL_GetTick.
+ * @param void
+ * @return None
+ */
+void esp8266_emulator_poll(void);
+
+/**
+ * @brief bytes sent by the firmware on the uart. They are lost if the module uses another rate than the firmware.
+ * @param const uint8_t* data, the bytes
+ * @param uint16_t len, number of bytes
+ * @return None
+ */
+void esp8266_emulator_write(const uint8_t* data, uint16_t len);
+
+/**
+ * @brief the rate the firmware side of the uart uses, call it whenever the uart is configured.
+ * @param uint32_t baud_rate, the rate
+ * @return None
+ */
+void esp8266_emulator_host_baud_rate(uint32_t baud_rate);
+
+/**
+ * @brief level of the reset pin, the module restarts when it is released.
+ * @param bool high, the pin level
+ * @return None
+ */
+void esp8266_emulator_reset_pin(bool high);
+
+/**
+ * @brief level of the wake pin, the module only listens in light sleep while it is low.
+ * @param bool high, the pin level
+ * @return None
+ */
+void esp8266_emulator_wake_pin(bool high);
+
+/**
+ * @brief make the next count commands that start with command fail.
+ * @param const char* command, start of the command, e.g. "AT+CIPSEND="
+ * @param uint16_t count, number of commands to fail
+ * @param ESP8266_EMULATOR_FAULT fault, what happens instead
+ * @return bool, false if EMULATOR_FAULTS faults are already waiting
+ */
+bool esp8266_emulator_inject_fault(const char* command, uint16_t count, ESP8266_EMULATOR_FAULT fault);
+
+/**
+ * @brief lose or get back the association, as when the access point goes away or comes back.
+ * 		  Losing it also closes the connection.
+ * @param bool joined, associated or not
+ * @return None
+ */
+void esp8266_emulator_set_joined(bool joined);
+
+/**
+ * @brief the current rate of the module.
+ * @param void
+ * @return uint32_t, baud rate
+ */
+uint32_t esp8266_emulator_baud_rate(void);
+
+/**
+ * @brief counters since esp8266_emulator_start.
+ * @param void
+ * @return const ESP8266_EMULATOR_STATS*, the counters
+ */
+const ESP8266_EMULATOR_STATS* esp8266_emulator_stats(void);
+
+#endif /* HOST_ESP8266_EMULATOR_H_ */
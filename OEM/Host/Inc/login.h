@@ -0,0 +1,24 @@
+/**
+******************************************************************************
+@brief wifi login for the host build
+@details The firmware reads SSID and PWD from login.h, which is kept out of the
+		 repository. On the host they only have to match the access point of
+		 the ESP8266 emulator, esp8266_emulator_default_config uses the same
+		 strings.
+
+		 The emulator connects every host to the test server, which also
+		 answers as an mqtt broker, so any broker name will do.
+
+@file login.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_LOGIN_H_
+#define INC_LOGIN_H_
+
+static const char SSID[] = "oem-host";
+static const char PWD[]	 = "password";
+
+#define MQTT_BROKER_HOST	"broker.oem-host"
+
+#endif /* INC_LOGIN_H_ */
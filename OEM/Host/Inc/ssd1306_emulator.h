@@ -0,0 +1,100 @@
+/**
+******************************************************************************
+@brief header for the host SSD1306 emulator
+@details A Linux stand-in for the SSD1306 on hi2c2. It decodes what
+		 ssd1306.c writes, the command stream with the memory addressing
+		 mode (0x20), the column and page windows of horizontal addressing
+		 (0x21, 0x22) and the page (0xB0-0xB7) and column nibbles
+		 (0x00-0x1F) of page addressing, and puts the data bytes in a
+		 128x64 copy of the display RAM. Commands that only change how the
+		 panel is driven are accepted and skipped with their arguments.
+
+		 The RAM is what the display shows, so a test can check it against
+		 the buffer of the driver, save it as a PBM image, or compare it with
+		 a golden image pixel by pixel. The bytes on the bus are counted, the
+		 address and control byte of every transfer included.
+
+		 Usage, see hal_shim.c:
+		 ssd1306_emulator_reset();
+		 from HAL_I2C_Mem_Write to DISPLAY_ADDR:	ssd1306_emulator_write(control, data, len);
+		 ...
+		 ssd1306_emulator_write_pbm("screen.pbm");
+
+@file ssd1306_emulator.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_SSD1306_EMULATOR_H_
+#define HOST_SSD1306_EMULATOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SSD1306_EMULATOR_ADDRESS	0x78	// 8 bit address of the display, as ssd1306.c uses it
+#define SSD1306_EMULATOR_WIDTH		128
+#define SSD1306_EMULATOR_HEIGHT		64
+#define SSD1306_EMULATOR_PAGES		(SSD1306_EMULATOR_HEIGHT / 8)
+
+/* What has been sent to the display since the last reset */
+typedef struct
+{
+	uint32_t transfers;				// i2c writes
+	uint32_t bus_bytes;				// bytes on the bus, address and control bytes included
+	uint32_t commands;				// command bytes, arguments included
+	uint32_t data_bytes;			// bytes written to the display RAM
+	uint32_t unknown;				// command bytes that were not understood
+} SSD1306_EMULATOR_STATS;
+
+/**
+ * @brief clear the RAM, the counters and the addressing state, as a display that was just powered up.
+ * @param void
+ * @return None
+ */
+void ssd1306_emulator_reset(void);
+
+/**
+ * @brief one i2c write to the display.
+ * @param uint8_t control, 0x00 for commands, 0x40 for data
+ * @param const uint8_t* data
+ * @param uint16_t len
+ * @return None
+ */
+void ssd1306_emulator_write(uint8_t control, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief a pixel of the RAM.
+ * @param uint8_t x, 0 to 127
+ * @param uint8_t y, 0 to 63
+ * @return bool, true if it is lit
+ */
+bool ssd1306_emulator_pixel(uint8_t x, uint8_t y);
+
+/**
+ * @brief the RAM, in the layout of the buffer of ssd1306.c: page by page, a byte per column, top row in bit 0.
+ * @param void
+ * @return const uint8_t*, SSD1306_EMULATOR_PAGES * SSD1306_EMULATOR_WIDTH bytes
+ */
+const uint8_t* ssd1306_emulator_ram(void);
+
+/**
+ * @brief the counters.
+ * @param void
+ * @return const SSD1306_EMULATOR_STATS*
+ */
+const SSD1306_EMULATOR_STATS* ssd1306_emulator_stats(void);
+
+/**
+ * @brief save the RAM as a plain PBM image, 1 for a lit pixel.
+ * @param const char* path
+ * @return bool, false if the file could not be written
+ */
+bool ssd1306_emulator_write_pbm(const char* path);
+
+/**
+ * @brief compare the RAM with a PBM image.
+ * @param const char* path, a plain (P1) or raw (P4) PBM image of 128x64 pixels
+ * @return int32_t, the pixels that differ, -1 if the image could not be read
+ */
+int32_t ssd1306_emulator_compare_pbm(const char* path);
+
+#endif /* HOST_SSD1306_EMULATOR_H_ */
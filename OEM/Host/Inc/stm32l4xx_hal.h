@@ -0,0 +1,204 @@
+/**
+******************************************************************************
+@brief host stand-in for the STM32L4 HAL
+@details Only the types, defines and functions that the project files use are
+		 declared, so ESP8266.c and the rest of Core/Src can be built for Linux
+		 without the STM32Cube drivers. The functions are implemented in
+		 hal_shim.c: UART4 is connected to the ESP8266 emulator, I2C accepts
+		 every write and reads zeros, GPIO writes to the ESP8266 reset and wake
+		 pins are passed on to the emulator and everything else is ignored.
+
+		 HAL_GetTick is the real time in ms since the program started, plus what
+		 hal_shim_skip_time has skipped, and every call to it lets the emulator
+		 deliver the bytes that are due. The firmware polls HAL_GetTick in all
+		 its wait loops, so this takes the place of the uart interrupt.
+
+		 I2C writes take no time unless hal_shim_i2c_timing is turned on, they
+		 then block for as long as the bytes take on the bus. A DMA write is
+		 reported done by HAL_GetTick once that time has passed.
+
+@file stm32l4xx_hal.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_STM32L4XX_HAL_H_
+#define HOST_STM32L4XX_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum
+{
+	HAL_OK = 0,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+	HAL_I2C_STATE_READY = 0x20
+} HAL_I2C_StateTypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+/* Peripherals, only used to tell instances apart */
+typedef struct { uint8_t id; } USART_TypeDef;
+typedef struct { uint8_t id; } I2C_TypeDef;
+typedef struct { uint8_t id; } GPIO_TypeDef;
+
+extern USART_TypeDef host_uart4;
+extern I2C_TypeDef	 host_i2c1, host_i2c2, host_i2c3;
+extern GPIO_TypeDef	 host_gpioa, host_gpiob, host_gpioc;
+
+#define UART4		(&host_uart4)
+#define I2C1		(&host_i2c1)
+#define I2C2		(&host_i2c2)
+#define I2C3		(&host_i2c3)
+#define GPIOA		(&host_gpioa)
+#define GPIOB		(&host_gpiob)
+#define GPIOC		(&host_gpioc)
+
+typedef struct
+{
+	uint32_t BaudRate;
+	uint32_t WordLength;
+	uint32_t StopBits;
+	uint32_t Parity;
+	uint32_t Mode;
+	uint32_t HwFlowCtl;
+	uint32_t OverSampling;
+	uint32_t OneBitSampling;
+} UART_InitTypeDef;
+
+typedef struct
+{
+	uint32_t AdvFeatureInit;
+} UART_AdvFeatureInitTypeDef;
+
+typedef struct
+{
+	USART_TypeDef*			   Instance;
+	UART_InitTypeDef		   Init;
+	UART_AdvFeatureInitTypeDef AdvancedInit;
+} UART_HandleTypeDef;
+
+typedef struct
+{
+	I2C_TypeDef* Instance;
+} I2C_HandleTypeDef;
+
+/* Only declared by i2c.h, the DMA is not set up on the host */
+typedef struct
+{
+	void* Instance;
+} DMA_HandleTypeDef;
+
+typedef struct
+{
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+/* Cycle counter, only counts on the target */
+typedef struct { volatile uint32_t CTRL; volatile uint32_t CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+extern DWT_Type		  host_dwt;
+extern CoreDebug_Type host_core_debug;
+#define DWT							(&host_dwt)
+#define CoreDebug					(&host_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk	(1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk		1UL
+
+#define HAL_MAX_DELAY				0xFFFFFFFFU
+
+#define UART_HWCONTROL_NONE			0x000
+#define UART_HWCONTROL_RTS			0x100
+#define UART_HWCONTROL_CTS			0x200
+#define UART_HWCONTROL_RTS_CTS		0x300
+#define UART_WORDLENGTH_8B			0
+#define UART_STOPBITS_1				0
+#define UART_PARITY_NONE			0
+#define UART_MODE_TX_RX				0x0C
+#define UART_OVERSAMPLING_16		0
+#define UART_ONE_BIT_SAMPLE_DISABLE	0
+#define UART_ADVFEATURE_NO_INIT		0
+
+#define I2C_MEMADD_SIZE_8BIT		1
+
+#define GPIO_PIN_0					0x0001
+#define GPIO_PIN_1					0x0002
+#define GPIO_PIN_2					0x0004
+#define GPIO_PIN_3					0x0008
+#define GPIO_PIN_4					0x0010
+#define GPIO_PIN_5					0x0020
+#define GPIO_PIN_15					0x8000
+#define GPIO_MODE_OUTPUT_PP			0x01
+#define GPIO_MODE_OUTPUT_OD			0x11
+#define GPIO_MODE_AF_PP				0x02
+#define GPIO_NOPULL					0
+#define GPIO_SPEED_FREQ_LOW			0
+#define GPIO_SPEED_FREQ_VERY_HIGH	3
+#define GPIO_AF8_UART4				8
+
+#define UART4_IRQn					52
+#define __HAL_RCC_UART4_CLK_ENABLE()	((void) 0)
+#define __HAL_RCC_UART4_CLK_DISABLE()	((void) 0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()	((void) 0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()	((void) 0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()	((void) 0)
+
+uint32_t			 HAL_GetTick(void);
+void				 HAL_Delay(uint32_t delay);
+uint32_t			 HAL_GetUIDw0(void);
+uint32_t			 HAL_GetUIDw1(void);
+uint32_t			 HAL_GetUIDw2(void);
+
+HAL_StatusTypeDef	 HAL_UART_Init(UART_HandleTypeDef* huart);
+HAL_StatusTypeDef	 HAL_UART_DeInit(UART_HandleTypeDef* huart);
+HAL_StatusTypeDef	 HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef	 HAL_UART_Receive_IT(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size);
+void				 HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart);
+
+HAL_StatusTypeDef	 HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+									   uint8_t* data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef	 HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+									  uint8_t* data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef	 HAL_I2C_Master_Transmit(I2C_HandleTypeDef* hi2c, uint16_t address, uint8_t* data, uint16_t size, uint32_t timeout);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef* hi2c);
+HAL_StatusTypeDef	 HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+										   uint8_t* data, uint16_t size);
+void				 HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef* hi2c);
+void				 HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c);
+
+void				 HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init);
+void				 HAL_GPIO_DeInit(GPIO_TypeDef* port, uint32_t pin);
+void				 HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state);
+
+void				 HAL_NVIC_SetPriority(int irq, uint32_t preempt_priority, uint32_t sub_priority);
+void				 HAL_NVIC_EnableIRQ(int irq);
+void				 HAL_NVIC_DisableIRQ(int irq);
+
+/* No interrupts on the host, nothing to mask */
+static inline uint32_t __get_PRIMASK(void){ return 0; }
+static inline void	   __set_PRIMASK(uint32_t primask){ (void) primask; }
+static inline void	   __disable_irq(void){ }
+
+/* Host only, pass to esp8266_emulator_start so that the emulator answers on UART4 */
+void				 hal_shim_uart4_deliver(uint8_t byte);
+
+/* Host only, make I2C writes take as long as on the bus of the board */
+void				 hal_shim_i2c_timing(bool on);
+
+/* Host only, move HAL_GetTick ahead as if ms had passed, the emulators keep their own time */
+void				 hal_shim_skip_time(uint32_t ms);
+
+#endif /* HOST_STM32L4XX_HAL_H_ */
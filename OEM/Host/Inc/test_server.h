@@ -0,0 +1,120 @@
+/**
+******************************************************************************
+@brief header for the local test server of the host build
+@details A small HTTP/1.1 server on 127.0.0.1 that the ESP8266 emulator
+		 connects to. It runs in its own thread, takes one connection at a
+		 time and answers every request with the configured status and body.
+		 The last request is kept so that tests can check what the firmware
+		 sent. Datagrams sent to the same port over UDP are counted.
+
+		 A connection that starts with an mqtt CONNECT is served as an mqtt
+		 broker instead, CONNECT is answered with CONNACK, a qos 1 PUBLISH
+		 with PUBACK and PINGREQ with PINGRESP. Messages are not passed on
+		 to anyone.
+
+		 Usage:
+		 uint16_t port = test_server_start();
+		 test_server_respond(200, "interval=60", false);
+		 config.port = port;		// of the ESP8266 emulator
+		 ...
+		 test_server_stop();
+
+@file test_server.h
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_TEST_SERVER_H_
+#define HOST_TEST_SERVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TEST_SERVER_REQUEST_SIZE	8192	// longest request that is kept
+#define TEST_SERVER_BODY_SIZE		512		// longest body of the answer
+#define TEST_SERVER_DATAGRAM_SIZE	2048	// longest datagram that is received
+
+/* What the server has seen since test_server_start or test_server_reset */
+typedef struct
+{
+	uint32_t connections;			// tcp connections accepted
+	uint32_t requests;				// http requests answered
+	uint32_t datagrams;				// udp datagrams received
+	uint32_t datagram_bytes;
+	uint8_t	 datagram[TEST_SERVER_DATAGRAM_SIZE];	// the last datagram
+	uint16_t datagram_len;
+	uint32_t closes;				// connections the server closed after answering
+	uint32_t mqtt_connects;			// mqtt CONNECT packets
+	uint32_t publishes;				// mqtt PUBLISH packets, the last one is kept in request
+	uint32_t pings;					// mqtt PINGREQ packets
+	char	 request[TEST_SERVER_REQUEST_SIZE + 1];	// the last request, headers and body, zero terminated
+	uint16_t request_len;			// length of the last request, the body may contain zeros
+	uint16_t body_offset;			// where the body of the last request starts, or the payload of the last PUBLISH
+} TEST_SERVER_STATS;
+
+/**
+ * @brief start the server on a free port of 127.0.0.1. It answers 200 with an empty body and keeps the connection open.
+ * @param void
+ * @return uint16_t, the port, 0 if the server could not be started
+ */
+uint16_t test_server_start(void);
+
+/**
+ * @brief stop the server and close its connection.
+ * @param void
+ * @return None
+ */
+void test_server_stop(void);
+
+/**
+ * @brief set the answer to the following requests.
+ * @param uint16_t status, status code
+ * @param const char* body, body of the answer, sent with Content-Length
+ * @param bool close, answer with Connection: close and close the connection, requests with
+ * 		  Connection: close are always answered this way
+ * @return None
+ */
+void test_server_respond(uint16_t status, const char* body, bool close);
+
+/**
+ * @brief send the body of the following answers with Transfer-Encoding: chunked, in chunks of the given size.
+ * @param uint16_t chunk_size, 0 to use Content-Length again
+ * @return None
+ */
+void test_server_chunked(uint16_t chunk_size);
+
+/**
+ * @brief wait before answering, as a slow server would.
+ * @param uint32_t delay, ms
+ * @return None
+ */
+void test_server_delay(uint32_t delay);
+
+/**
+ * @brief close the open connection without answering, as a server that times out an idle connection would.
+ * @param void
+ * @return None
+ */
+void test_server_drop_connection(void);
+
+/**
+ * @brief leave the following mqtt acknowledgements unanswered, as a broker that has stopped would.
+ * @param uint16_t count, number of PUBACK and PINGRESP not sent
+ * @return None
+ */
+void test_server_mqtt_drop_acks(uint16_t count);
+
+/**
+ * @brief clear the counters and the last request.
+ * @param void
+ * @return None
+ */
+void test_server_reset(void);
+
+/**
+ * @brief a copy of the counters and the last request, taken under the lock of the server.
+ * @param TEST_SERVER_STATS* stats, where the copy is stored
+ * @return None
+ */
+void test_server_stats(TEST_SERVER_STATS* stats);
+
+#endif /* HOST_TEST_SERVER_H_ */
@@ -0,0 +1,84 @@
+/**
+******************************************************************************
+@brief CBOR decoder of the host tests
+@details The counterpart of put_head in cbor.c, see RFC 8949,
+		 https://www.rfc-editor.org/rfc/rfc8949.html
+
+@file cbor_reader.c
+@version 1.0
+*******************************************************************************/
+#include "cbor_reader.h"
+
+/* Reads an initial byte of the given major type and its argument, 64 bit arguments are not used */
+static bool
+get_head(CBOR_READER* reader, uint8_t type, uint32_t* arg){
+	if(reader->error || reader->pos >= reader->len || (reader->buffer[reader->pos] & 0xE0) != type){
+		reader->error = true;
+		return false;
+	}
+
+	uint8_t info = reader->buffer[reader->pos] & 0x1F;
+	uint8_t len  = (info < CBOR_ARG_8) ? 0 : (info == CBOR_ARG_8) ? 1 : (info == CBOR_ARG_16) ? 2 : (info == CBOR_ARG_32) ? 4 : 0xFF;
+	if(len == 0xFF || reader->pos + 1 + len > reader->len){
+		reader->error = true;
+		return false;
+	}
+
+	reader->pos++;
+	if(len == 0){
+		*arg = info;
+		return true;
+	}
+	*arg = 0;
+	for(uint8_t i = 0; i < len; i++)
+		*arg = (*arg << 8) | reader->buffer[reader->pos++];
+	return true;
+}
+
+void
+cbor_reader_init(CBOR_READER* reader, const uint8_t* buffer, uint16_t len){
+	reader->buffer = buffer;
+	reader->len	   = len;
+	reader->pos	   = 0;
+	reader->error  = false;
+}
+
+bool
+cbor_get_uint(CBOR_READER* reader, uint32_t* value){
+	return get_head(reader, CBOR_UINT, value);
+}
+
+bool
+cbor_get_int(CBOR_READER* reader, int32_t* value){
+	uint32_t arg;
+
+	if(reader->pos < reader->len && (reader->buffer[reader->pos] & 0xE0) == CBOR_NEGINT){
+		if(!get_head(reader, CBOR_NEGINT, &arg))
+			return false;
+		if(arg > INT32_MAX){
+			reader->error = true;
+			return false;
+		}
+		*value = -1 - (int32_t) arg;
+		return true;
+	}
+
+	if(!get_head(reader, CBOR_UINT, &arg))
+		return false;
+	if(arg > INT32_MAX){
+		reader->error = true;
+		return false;
+	}
+	*value = arg;
+	return true;
+}
+
+bool
+cbor_get_array(CBOR_READER* reader, uint16_t* count){
+	uint32_t arg;
+
+	if(!get_head(reader, CBOR_ARRAY, &arg))
+		return false;
+	*count = arg;
+	return true;
+}
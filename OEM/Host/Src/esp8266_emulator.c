@@ -0,0 +1,845 @@
+/**
+******************************************************************************
+@brief functions for the host ESP8266 emulator
+@details Bytes from the firmware are collected into lines and handled as AT
+		 commands when \r\n arrives, except while AT+CIPSEND data or passthrough
+		 data is expected. Everything the module says is put in an output queue
+		 together with the time it is due and the rate it is sent at, and
+		 esp8266_emulator_poll hands the due bytes to the firmware. Things that
+		 happen later by themselves, the end of a restart, an automatic join or
+		 the wake up from deep sleep, are kept as times and checked in poll.
+
+		 The answers follow the AT firmware 1.7, see
+		 https://www.espressif.com/sites/default/files/documentation/4a-esp8266_at_instruction_set_en.pdf
+
+@file esp8266_emulator.c
+@version 1.0
+*******************************************************************************/
+#define _GNU_SOURCE
+#include "esp8266_emulator.h"
+#include <login.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define US_PER_MS				1000ULL
+#define BOOT_MESSAGE			" ets Jan  8 2013,rst cause:2, boot mode:(3,6)\r\n"
+#define RECONNECT_INTERVAL		1000	// ms between the reconnects of passthrough mode
+#define PASSTHROUGH_INTERVAL	20		// ms of uart silence before passthrough data is sent as a packet
+#define PASSTHROUGH_PACKET		2048	// or as soon as this much has been collected
+
+typedef enum
+{
+	POWER_ON = 0,		// awake, or in light or modem sleep
+	POWER_BOOTING,		// restarting, deaf until ready
+	POWER_RESET,		// held in reset by the reset pin
+	POWER_DEEP_SLEEP,	// after AT+GSLP, until the timer or the reset pin
+	POWER_OFF			// not started
+} POWER_STATE;
+
+typedef enum
+{
+	INPUT_COMMAND = 0,	// collecting an AT command
+	INPUT_CIPSEND,		// collecting the data of AT+CIPSEND=<len>
+	INPUT_PASSTHROUGH	// everything goes to the socket
+} INPUT_STATE;
+
+/* A byte on its way to the firmware */
+typedef struct
+{
+	uint8_t	 byte;
+	uint32_t baud_rate;
+	uint64_t due;		// us
+} QUEUED_BYTE;
+
+typedef struct
+{
+	char					prefix[32];
+	uint16_t				count;
+	ESP8266_EMULATOR_FAULT	fault;
+} FAULT;
+
+static ESP8266_EMULATOR_CONFIG config;
+static ESP8266_EMULATOR_STATS  stats;
+static void					   (*deliver)(uint8_t) = NULL;
+
+/* Uart */
+static uint32_t		  baud_rate		 = EMULATOR_DEFAULT_BAUD_RATE;
+static uint32_t		  host_baud_rate = EMULATOR_DEFAULT_BAUD_RATE;
+static QUEUED_BYTE	  queue[EMULATOR_QUEUE_SIZE];
+static uint32_t		  queue_head  = 0;
+static uint32_t		  queue_count = 0;
+static uint64_t		  queue_tail_due = 0;		// due time of the last queued byte
+static uint32_t		  fragment_used	 = 0;		// bytes sent since the last fragment gap
+static uint32_t		  drop_state	 = 1;
+
+/* Power and wifi */
+static POWER_STATE	  power = POWER_OFF;
+static uint64_t		  ready_at		= 0;		// end of the restart, us
+static uint64_t		  wake_at		= 0;		// end of deep sleep, us, 0 if only the reset pin wakes the module
+static uint64_t		  join_at		= 0;		// end of an automatic join, us, 0 if none
+static bool			  joined		= false;
+static bool			  autoconnect	= false;	// an AP has been joined, it is joined again after a restart
+static bool			  reset_pin		= true;
+static bool			  wake_pin		= true;
+static bool			  light_sleep	= false;	// AT+SLEEP=1, the uart only listens while the wake pin is low
+static bool			  wake_gpio		= false;	// AT+WAKEUPGPIO=1
+static uint8_t		  cwmode		= 1;
+static uint8_t		  cipmux		= 0;
+static uint8_t		  cipmode		= 0;
+
+/* Connection */
+static int			  socket_fd		= -1;
+static bool			  socket_udp	= false;
+static bool			  had_connection = false;	// for STATUS:4
+static struct sockaddr_in remote;
+static uint64_t		  reconnect_at	= 0;		// passthrough lost its connection, us, 0 if not
+
+/* Input */
+static INPUT_STATE	  input = INPUT_COMMAND;
+static char			  line[EMULATOR_LINE_SIZE];
+static uint16_t		  line_len		= 0;
+static uint8_t		  cipsend_data[EMULATOR_CIPSEND_MAX];
+static uint16_t		  cipsend_len	= 0;
+static uint16_t		  cipsend_expected = 0;
+static uint64_t		  last_input	= 0;		// time of the last byte from the firmware, us
+static uint64_t		  escape_at		= 0;		// +++ received alone, us, 0 if not
+static uint8_t		  passthrough_data[PASSTHROUGH_PACKET];	// passthrough bytes waiting to be sent
+static uint16_t		  passthrough_len = 0;
+static uint64_t		  passthrough_due = 0;		// when they are sent if nothing more comes, us
+
+static FAULT		  faults[EMULATOR_FAULTS];
+
+static uint64_t
+now_us(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* xorshift32, seeded from the config so that a run can be repeated */
+static uint32_t
+drop_random(void){
+	drop_state ^= drop_state << 13;
+	drop_state ^= drop_state >> 17;
+	drop_state ^= drop_state << 5;
+	return drop_state;
+}
+
+/* Queues bytes at the current rate, the first one delay us from now or after what is already queued */
+static void
+emit_after(uint64_t delay, const uint8_t* data, uint32_t len, uint32_t rate){
+	uint64_t due = now_us() + delay;
+	if(due < queue_tail_due)
+		due = queue_tail_due;
+	else
+		fragment_used = 0;
+
+	for(uint32_t i = 0; i < len && queue_count < EMULATOR_QUEUE_SIZE; i++){
+		if(config.fragment_size > 0 && fragment_used == config.fragment_size){
+			due += config.fragment_gap * US_PER_MS;
+			fragment_used = 0;
+		}
+		if(config.uart_timing)
+			due += 10ULL * 1000000ULL / rate;	// start bit, 8 data bits and stop bit
+
+		QUEUED_BYTE* slot = &queue[(queue_head + queue_count) % EMULATOR_QUEUE_SIZE];
+		slot->byte		= data[i];
+		slot->baud_rate = rate;
+		slot->due		= due;
+		queue_count++;
+		fragment_used++;
+	}
+	queue_tail_due = due;
+}
+
+/* An answer, after the configured latency */
+static void
+emit(const char* text){
+	emit_after(config.latency * US_PER_MS, (const uint8_t*) text, strlen(text), baud_rate);
+}
+
+/* An answer that comes later, e.g. after a join */
+static void
+emit_later(uint32_t delay, const char* text){
+	emit_after((config.latency + delay) * US_PER_MS, (const uint8_t*) text, strlen(text), baud_rate);
+}
+
+static void
+socket_close(void){
+	if(socket_fd >= 0)
+		close(socket_fd);
+	socket_fd		= -1;
+	reconnect_at	= 0;
+	passthrough_len = 0;
+}
+
+/* The connection ends without the firmware asking for it */
+static void
+connection_lost(void){
+	if(socket_fd < 0)
+		return;
+	socket_close();
+	if(input != INPUT_PASSTHROUGH)
+		emit("CLOSED\r\n");
+}
+
+static bool
+socket_open(void){
+	socket_fd = socket(AF_INET, socket_udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if(socket_fd < 0)
+		return false;
+	if(connect(socket_fd, (struct sockaddr*) &remote, sizeof(remote)) != 0){
+		socket_close();
+		return false;
+	}
+	int one = 1;
+	if(!socket_udp)
+		setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+	had_connection = true;
+	stats.connections++;
+	return true;
+}
+
+static void
+socket_send(const uint8_t* data, uint16_t len){
+	if(socket_fd < 0)
+		return;
+	if(send(socket_fd, data, len, MSG_NOSIGNAL) == len)
+		stats.bytes_to_socket += len;
+}
+
+/* Everything that is lost when the module restarts, the uart goes back to the default rate */
+static void
+restart(uint64_t start){
+	socket_close();
+	had_connection = false;
+	joined		   = false;
+	light_sleep	   = false;
+	wake_gpio	   = false;
+	cwmode		   = 1;
+	cipmux		   = 0;
+	cipmode		   = 0;
+	input		   = INPUT_COMMAND;
+	line_len	   = 0;
+	escape_at	   = 0;
+
+	uint64_t now = now_us();
+	baud_rate = EMULATOR_DEFAULT_BAUD_RATE;
+	emit_after((start > now) ? start - now : 0, (const uint8_t*) BOOT_MESSAGE, strlen(BOOT_MESSAGE), EMULATOR_BOOT_BAUD_RATE);
+
+	power	 = POWER_BOOTING;
+	ready_at = start + config.boot_time * US_PER_MS;
+	join_at	 = autoconnect ? ready_at + config.join_time * US_PER_MS : 0;
+	stats.restarts++;
+}
+
+/* Reads the next "quoted" argument of a command, returns the position after it or NULL */
+static const char*
+quoted(const char* at, char* out, uint16_t size){
+	const char* start = strchr(at, '"');
+	if(start == NULL)
+		return NULL;
+	const char* end = strchr(start + 1, '"');
+	if(end == NULL || (uint16_t) (end - start - 1) >= size)
+		return NULL;
+	memcpy(out, start + 1, end - start - 1);
+	out[end - start - 1] = '\0';
+	return end + 1;
+}
+
+static void
+join(const char* args){
+	char ssid[64], password[72], bssid[24] = {0};
+	const char* at;
+
+	if(cwmode == 2 || (at = quoted(args, ssid, sizeof(ssid))) == NULL || (at = quoted(at, password, sizeof(password))) == NULL){
+		emit("\r\nERROR\r\n");
+		return;
+	}
+	quoted(at, bssid, sizeof(bssid));
+
+	if(joined){
+		connection_lost();
+		emit("WIFI DISCONNECT\r\n");
+		joined = false;
+	}
+	join_at = 0;
+
+	if(strcmp(ssid, config.ssid) != 0 || (bssid[0] != '\0' && strcasecmp(bssid, config.bssid) != 0)){
+		emit_later(config.join_time, "+CWJAP:3\r\n\r\nFAIL\r\n");
+		return;
+	}
+	if(strcmp(password, config.password) != 0){
+		emit_later(config.join_time, "+CWJAP:2\r\n\r\nFAIL\r\n");
+		return;
+	}
+	joined		= true;
+	autoconnect = true;
+	emit_later(config.join_time, "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+}
+
+static void
+cipstart(const char* args){
+	char type[8], host[64];
+	const char* at;
+
+	if(socket_fd >= 0){
+		emit("ALREADY CONNECTED\r\n\r\nERROR\r\n");
+		return;
+	}
+	if(!joined){
+		emit("no ip\r\n\r\nERROR\r\n");
+		return;
+	}
+	if((at = quoted(args, type, sizeof(type))) == NULL || (at = quoted(at, host, sizeof(host))) == NULL || *at != ','){
+		emit("\r\nERROR\r\n");
+		return;
+	}
+
+	/* Every host is the configured one, only the port of the command may be kept */
+	memset(&remote, 0, sizeof(remote));
+	remote.sin_family = AF_INET;
+	remote.sin_port	  = htons(config.port != 0 ? config.port : (uint16_t) atoi(at + 1));
+	inet_pton(AF_INET, config.connect_host, &remote.sin_addr);
+	socket_udp = (strcmp(type, "UDP") == 0);
+
+	if(strcmp(type, "TCP") != 0 && !socket_udp){
+		emit("\r\nERROR\r\n");
+		return;
+	}
+	if(!socket_open()){
+		emit("\r\nERROR\r\nCLOSED\r\n");
+		return;
+	}
+	emit("CONNECT\r\n\r\nOK\r\n");
+}
+
+static void
+cipsend(const char* args){
+	if(socket_fd < 0){
+		emit("link is not valid\r\n\r\nERROR\r\n");
+		return;
+	}
+
+	/* AT+CIPSEND without length starts passthrough */
+	if(*args == '\0'){
+		if(cipmode != 1){
+			emit("\r\nERROR\r\n");
+			return;
+		}
+		input = INPUT_PASSTHROUGH;
+		emit("\r\nOK\r\n\r\n>");
+		return;
+	}
+
+	long len = strtol(args + 1, NULL, 10);
+	if(cipmode != 0 || len <= 0 || len > EMULATOR_CIPSEND_MAX){
+		emit("\r\nERROR\r\n");
+		return;
+	}
+	cipsend_expected = len;
+	cipsend_len		 = 0;
+	input			 = INPUT_CIPSEND;
+	emit("\r\nOK\r\n> ");
+}
+
+static void
+cipsend_done(void){
+	char answer[32];
+
+	input = INPUT_COMMAND;
+	sprintf(answer, "\r\nRecv %u bytes\r\n", cipsend_len);
+	emit(answer);
+	if(socket_fd < 0){
+		emit("\r\nSEND FAIL\r\n");
+		return;
+	}
+	socket_send(cipsend_data, cipsend_len);
+	emit("\r\nSEND OK\r\n");
+}
+
+static void
+cipstatus(void){
+	char answer[128];
+
+	if(!joined)
+		emit("STATUS:5\r\n\r\nOK\r\n");
+	else if(socket_fd >= 0){
+		sprintf(answer, "STATUS:3\r\n+CIPSTATUS:0,\"%s\",\"%s\",%u,4096,0\r\n\r\nOK\r\n",
+				socket_udp ? "UDP" : "TCP", config.connect_host, ntohs(remote.sin_port));
+		emit(answer);
+	}
+	else
+		emit(had_connection ? "STATUS:4\r\n\r\nOK\r\n" : "STATUS:2\r\n\r\nOK\r\n");
+}
+
+/* Returns true if an injected fault took the place of the command */
+static bool
+fault(const char* command){
+	for(uint8_t i = 0; i < EMULATOR_FAULTS; i++){
+		if(faults[i].count == 0 || strncmp(command, faults[i].prefix, strlen(faults[i].prefix)) != 0)
+			continue;
+
+		faults[i].count--;
+		stats.faults++;
+		switch(faults[i].fault){
+			case EMULATOR_FAULT_ERROR:
+				emit("\r\nERROR\r\n");
+				return true;
+			case EMULATOR_FAULT_SILENT:
+				return true;
+			case EMULATOR_FAULT_BUSY:
+				emit("busy p...\r\n\r\nERROR\r\n");
+				return true;
+			case EMULATOR_FAULT_CLOSE:
+				connection_lost();
+				return false;
+		}
+	}
+	return false;
+}
+
+static void
+command(const char* command){
+	char answer[128];
+	const char* args;
+
+	stats.commands++;
+	if(fault(command))
+		return;
+
+#define IS(name)		(strcmp(command, name) == 0)
+#define STARTS(name)	(strncmp(command, name, strlen(name)) == 0 && (args = command + strlen(name)) != NULL)
+
+	if(IS("AT"))
+		emit("\r\nOK\r\n");
+	else if(IS("AT+RST")){
+		emit("\r\nOK\r\n");
+		restart(queue_tail_due);
+	}
+	else if(IS("AT+GMR"))
+		emit("AT version:1.7.4.0(May 11 2020 19:13:04)\r\nSDK version:3.0.4(9532ceb)\r\n"
+			 "compile time:May 27 2020 10:12:22\r\nBin version(Wroom 02):1.7.4\r\n\r\nOK\r\n");
+	else if(STARTS("AT+CWMODE=") || STARTS("AT+CWMODE_CUR=")){
+		if(*args < '1' || *args > '3')
+			emit("\r\nERROR\r\n");
+		else {
+			cwmode = *args - '0';
+			emit("\r\nOK\r\n");
+		}
+	}
+	else if(IS("AT+CWMODE_CUR?") || IS("AT+CWMODE?")){
+		sprintf(answer, "+CWMODE%s:%u\r\n\r\nOK\r\n", IS("AT+CWMODE?") ? "" : "_CUR", cwmode);
+		emit(answer);
+	}
+	else if(IS("AT+CWJAP?") || IS("AT+CWJAP_CUR?")){
+		if(joined){
+			sprintf(answer, "+CWJAP:\"%s\",\"%s\",6,-60\r\n\r\nOK\r\n", config.ssid, config.bssid);
+			emit(answer);
+		}
+		else
+			emit("No AP\r\n\r\nOK\r\n");
+	}
+	else if(STARTS("AT+CWJAP=") || STARTS("AT+CWJAP_CUR="))
+		join(args);
+	else if(IS("AT+CWQAP")){
+		connection_lost();
+		if(joined)
+			emit("WIFI DISCONNECT\r\n");
+		joined	= false;
+		join_at = 0;
+		emit("\r\nOK\r\n");
+	}
+	else if(STARTS("AT+CIPSTA_CUR=") || STARTS("AT+CIPSTA="))
+		emit("\r\nOK\r\n");
+	else if(STARTS("AT+CIPMUX=")){
+		if(socket_fd >= 0 || (*args != '0' && *args != '1'))
+			emit("link is builded\r\n\r\nERROR\r\n");
+		else {
+			cipmux = *args - '0';
+			emit("\r\nOK\r\n");
+		}
+	}
+	else if(IS("AT+CIPMUX?")){
+		sprintf(answer, "+CIPMUX:%u\r\n\r\nOK\r\n", cipmux);
+		emit(answer);
+	}
+	else if(STARTS("AT+CIPMODE=")){
+		if((*args != '0' && *args != '1') || (*args == '1' && cipmux != 0))
+			emit("\r\nERROR\r\n");
+		else {
+			cipmode = *args - '0';
+			emit("\r\nOK\r\n");
+		}
+	}
+	else if(STARTS("AT+CIPSTART="))
+		cipstart(args);
+	else if(STARTS("AT+CIPSEND"))
+		cipsend(args);
+	else if(IS("AT+CIPCLOSE") || IS("AT+CIPCLOSE=0")){
+		if(socket_fd < 0)
+			emit("\r\nERROR\r\n");
+		else {
+			socket_close();
+			emit("CLOSED\r\n\r\nOK\r\n");
+		}
+	}
+	else if(IS("AT+CIPSTATUS"))
+		cipstatus();
+	else if(STARTS("AT+CIPDOMAIN=")){
+		if(!joined)
+			emit("DNS Fail\r\n\r\nERROR\r\n");
+		else {
+			sprintf(answer, "+CIPDOMAIN:%s\r\n\r\nOK\r\n", config.connect_host);
+			emit(answer);
+		}
+	}
+	else if(STARTS("AT+UART_CUR=") || STARTS("AT+UART_DEF=")){
+		long rate = strtol(args, NULL, 10);
+		if(rate < 110 || rate > 4500000)
+			emit("\r\nERROR\r\n");
+		else {
+			/* OK goes out at the old rate, everything after at the new one */
+			emit("\r\nOK\r\n");
+			baud_rate = rate;
+		}
+	}
+	else if(STARTS("AT+SLEEP=")){
+		if(*args < '0' || *args > '2')
+			emit("\r\nERROR\r\n");
+		else {
+			emit("\r\nOK\r\n");
+			light_sleep = (*args == '1');
+		}
+	}
+	else if(STARTS("AT+WAKEUPGPIO=")){
+		wake_gpio = (*args == '1');
+		emit("\r\nOK\r\n");
+	}
+	else if(STARTS("AT+GSLP=")){
+		long time = strtol(args, NULL, 10);
+		emit("\r\nOK\r\n");
+		socket_close();
+		joined	= false;
+		join_at = 0;
+		power	= POWER_DEEP_SLEEP;
+		wake_at = (time > 0) ? now_us() + time * US_PER_MS : 0;
+	}
+	else
+		emit("\r\nERROR\r\n");
+
+#undef IS
+#undef STARTS
+}
+
+/* Light sleep keeps the uart deaf unless the wake pin is held low */
+static bool
+listening(void){
+	return power == POWER_ON && (!light_sleep || !wake_pin);
+}
+
+static void
+input_byte(uint8_t c){
+	switch(input){
+		case INPUT_CIPSEND:
+			cipsend_data[cipsend_len++] = c;
+			if(cipsend_len == cipsend_expected)
+				cipsend_done();
+			break;
+
+		case INPUT_PASSTHROUGH:
+			passthrough_data[passthrough_len++] = c;
+			if(passthrough_len == PASSTHROUGH_PACKET){
+				socket_send(passthrough_data, passthrough_len);
+				passthrough_len = 0;
+			}
+			break;
+
+		case INPUT_COMMAND:
+			if(config.echo)
+				emit_after(0, &c, 1, baud_rate);
+			if(c == '\n' && line_len > 0 && line[line_len - 1] == '\r'){
+				line[line_len - 1] = '\0';
+				line_len = 0;
+				if(line[0] != '\0')
+					command(line);
+			}
+			else if(line_len < EMULATOR_LINE_SIZE - 1)
+				line[line_len++] = c;
+			else
+				line_len = 0;
+			break;
+	}
+}
+
+void
+esp8266_emulator_default_config(ESP8266_EMULATOR_CONFIG* c){
+	memset(c, 0, sizeof(ESP8266_EMULATOR_CONFIG));
+	c->ssid			= SSID;
+	c->password		= PWD;
+	c->bssid		= "ca:d7:19:d8:a6:44";
+	c->joined		= true;
+	c->join_time	= 0;
+	c->connect_host = "127.0.0.1";
+	c->port			= 0;
+	c->ipd_size		= 1460;
+	c->uart_timing	= false;
+	c->boot_time	= 0;
+	c->escape_guard = 990;	// the AT firmware needs 1 s, HAL_Delay on the host may be a fraction of a ms short
+	c->seed			= 1;
+	c->echo			= true;
+}
+
+void
+esp8266_emulator_start(const ESP8266_EMULATOR_CONFIG* c, void (*deliver_byte)(uint8_t)){
+	esp8266_emulator_stop();
+	config	= *c;
+	deliver = deliver_byte;
+	memset(&stats, 0, sizeof(stats));
+	memset(faults, 0, sizeof(faults));
+
+	baud_rate	   = EMULATOR_DEFAULT_BAUD_RATE;
+	queue_head	   = 0;
+	queue_count	   = 0;
+	queue_tail_due = 0;
+	drop_state	   = config.seed ? config.seed : 1;
+	power		   = POWER_ON;
+	joined		   = config.joined;
+	autoconnect	   = config.joined;
+	join_at		   = 0;
+	wake_at		   = 0;
+	had_connection = false;
+	light_sleep	   = false;
+	wake_gpio	   = false;
+	cwmode		   = 1;
+	cipmux		   = 0;
+	cipmode		   = 0;
+	input		   = INPUT_COMMAND;
+	line_len	   = 0;
+	escape_at	   = 0;
+	last_input	   = now_us();
+}
+
+void
+esp8266_emulator_stop(void){
+	socket_close();
+	power		= POWER_OFF;
+	queue_count = 0;
+}
+
+ESP8266_EMULATOR_CONFIG*
+esp8266_emulator_config(void){
+	return &config;
+}
+
+/* Reads what the server sent, in +IPD messages or as is in passthrough mode */
+static void
+poll_socket(uint64_t now){
+	uint8_t data[1460];
+	char header[24];
+
+	if(reconnect_at != 0 && now >= reconnect_at){
+		if(socket_open())
+			reconnect_at = 0;
+		else
+			reconnect_at = now + RECONNECT_INTERVAL * US_PER_MS;
+	}
+	if(socket_fd < 0 || power != POWER_ON)
+		return;
+
+	uint16_t size = (config.ipd_size > 0 && config.ipd_size < sizeof(data)) ? config.ipd_size : sizeof(data);
+	ssize_t len = recv(socket_fd, data, (input == INPUT_PASSTHROUGH) ? sizeof(data) : size, 0);
+	if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if(len <= 0){
+		if(socket_udp)
+			return;
+		/* Passthrough connects again by itself until +++ */
+		if(input == INPUT_PASSTHROUGH){
+			socket_close();
+			reconnect_at = now + RECONNECT_INTERVAL * US_PER_MS;
+			return;
+		}
+		connection_lost();
+		return;
+	}
+
+	stats.bytes_from_socket += len;
+	if(input == INPUT_PASSTHROUGH){
+		emit_after(0, data, len, baud_rate);
+		return;
+	}
+	sprintf(header, "\r\n+IPD,%u:", (unsigned) len);
+	emit(header);
+	emit_after(0, data, len, baud_rate);
+	stats.ipd_messages++;
+}
+
+static void
+poll_power(uint64_t now){
+	if(power == POWER_DEEP_SLEEP && wake_at != 0 && now >= wake_at)
+		restart(now);
+
+	if(power == POWER_BOOTING && now >= ready_at){
+		power = POWER_ON;
+		emit_after(0, (const uint8_t*) "\r\nready\r\n", 9, baud_rate);
+	}
+
+	if(power == POWER_ON && join_at != 0 && now >= join_at){
+		join_at = 0;
+		joined	= config.joined || autoconnect;
+		if(joined)
+			emit_after(0, (const uint8_t*) "WIFI CONNECTED\r\nWIFI GOT IP\r\n", 29, baud_rate);
+	}
+
+	/* Passthrough data goes out as a packet once the uart has been quiet for a while */
+	if(passthrough_len > 0 && now >= passthrough_due){
+		socket_send(passthrough_data, passthrough_len);
+		passthrough_len = 0;
+	}
+
+	/* +++ followed by silence, back to command mode */
+	if(escape_at != 0 && now - escape_at >= config.escape_guard * US_PER_MS){
+		escape_at	 = 0;
+		input		 = INPUT_COMMAND;
+		reconnect_at = 0;
+		if(socket_fd < 0)
+			had_connection = true;
+	}
+}
+
+void
+esp8266_emulator_poll(void){
+	if(power == POWER_OFF)
+		return;
+
+	uint64_t now = now_us();
+	poll_power(now);
+	poll_socket(now);
+
+	while(queue_count > 0 && queue[queue_head].due <= now){
+		QUEUED_BYTE byte = queue[queue_head];
+		queue_head = (queue_head + 1) % EMULATOR_QUEUE_SIZE;
+		queue_count--;
+
+		if(byte.baud_rate != host_baud_rate)
+			stats.bytes_garbled++;
+		else if(config.drop_rate > 0 && drop_random() % 1000000 < config.drop_rate)
+			stats.bytes_dropped++;
+		else {
+			stats.bytes_to_host++;
+			if(deliver != NULL)
+				deliver(byte.byte);
+		}
+	}
+	if(queue_count == 0)
+		queue_tail_due = 0;
+}
+
+void
+esp8266_emulator_write(const uint8_t* data, uint16_t len){
+	uint64_t now = now_us();
+
+	if(!listening() || host_baud_rate != baud_rate){
+		if(power == POWER_ON && host_baud_rate != baud_rate)
+			stats.bytes_garbled += len;
+		return;
+	}
+	stats.bytes_from_host += len;
+
+	if(input == INPUT_PASSTHROUGH){
+		/* +++ only counts as a packet of its own with silence before and after */
+		if(len == 3 && memcmp(data, "+++", 3) == 0 && now - last_input >= config.escape_guard * US_PER_MS){
+			escape_at  = now;
+			last_input = now;
+			return;
+		}
+		if(escape_at != 0){
+			escape_at = 0;
+			socket_send((const uint8_t*) "+++", 3);
+		}
+	}
+
+	last_input = now;
+	for(uint16_t i = 0; i < len; i++)
+		input_byte(data[i]);
+
+	/* The interval counts from the last byte, which is still on the uart for a while */
+	if(input == INPUT_PASSTHROUGH){
+		passthrough_due = now + PASSTHROUGH_INTERVAL * US_PER_MS;
+		if(config.uart_timing)
+			passthrough_due += (uint64_t) len * 10 * 1000000ULL / baud_rate;
+	}
+}
+
+void
+esp8266_emulator_host_baud_rate(uint32_t rate){
+	host_baud_rate = rate;
+}
+
+void
+esp8266_emulator_reset_pin(bool high){
+	if(power == POWER_OFF || high == reset_pin){
+		reset_pin = high;
+		return;
+	}
+	reset_pin = high;
+	if(!high){
+		socket_close();
+		queue_count = 0;
+		power		= POWER_RESET;
+	}
+	else
+		restart(now_us());
+}
+
+void
+esp8266_emulator_wake_pin(bool high){
+	/* Woken by the pin the module stays awake until the next AT+SLEEP=1 */
+	if(!high && wake_pin && light_sleep && wake_gpio)
+		light_sleep = false;
+	wake_pin = high;
+}
+
+bool
+esp8266_emulator_inject_fault(const char* prefix, uint16_t count, ESP8266_EMULATOR_FAULT type){
+	for(uint8_t i = 0; i < EMULATOR_FAULTS; i++){
+		if(faults[i].count != 0)
+			continue;
+		strncpy(faults[i].prefix, prefix, sizeof(faults[i].prefix) - 1);
+		faults[i].prefix[sizeof(faults[i].prefix) - 1] = '\0';
+		faults[i].count = count;
+		faults[i].fault = type;
+		return true;
+	}
+	return false;
+}
+
+void
+esp8266_emulator_set_joined(bool state){
+	if(!state && joined){
+		connection_lost();
+		emit_after(0, (const uint8_t*) "WIFI DISCONNECT\r\n", 17, baud_rate);
+	}
+	joined = state;
+}
+
+uint32_t
+esp8266_emulator_baud_rate(void){
+	return baud_rate;
+}
+
+const ESP8266_EMULATOR_STATS*
+esp8266_emulator_stats(void){
+	return &stats;
+}
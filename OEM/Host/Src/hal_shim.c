@@ -0,0 +1,337 @@
+/**
+******************************************************************************
+@brief host stand-in for the STM32L4 HAL and the CubeMX init code
+@details Takes the place of the STM32Cube drivers and of usart.c, gpio.c and
+		 i2c.c when the project files are built for Linux, see stm32l4xx_hal.h.
+
+		 UART4 is wired to the ESP8266 emulator. Bytes from the emulator are
+		 written to the buffer given to HAL_UART_Receive_IT and reported with
+		 HAL_UART_RxCpltCallback, like the receive interrupt does. There are no
+		 interrupts on the host, so the emulator is polled from HAL_GetTick,
+		 which every wait loop of the firmware calls. If uart_timing is set in
+		 the emulator config, HAL_UART_Transmit blocks for as long as the bytes
+		 take at the current rate, as the blocking HAL call does on the board.
+		 The same goes for I2C writes when hal_shim_i2c_timing is turned on.
+		 DMA writes return at once and HAL_I2C_MemTxCpltCallback is called from
+		 HAL_GetTick when the bytes would have been sent, in place of the DMA
+		 interrupt. Writes to the display on hi2c2 are given to the SSD1306
+		 emulator, DMA writes when they are done.
+
+@file hal_shim.c
+@version 1.0
+*******************************************************************************/
+#include "main.h"
+#include "usart.h"
+#include "gpio.h"
+#include "i2c.h"
+#include "esp8266_emulator.h"
+#include "ssd1306_emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define I2C_CLOCK		100000		// Hz, standard mode as hi2c2 is set up by CubeMX
+#define I2C_FRAME_BITS	2			// start and stop condition
+
+USART_TypeDef	   host_uart4;
+I2C_TypeDef		   host_i2c1, host_i2c2, host_i2c3;
+GPIO_TypeDef	   host_gpioa, host_gpiob, host_gpioc;
+DWT_Type		   host_dwt;
+CoreDebug_Type	   host_core_debug;
+
+UART_HandleTypeDef huart4;
+I2C_HandleTypeDef  hi2c1;
+I2C_HandleTypeDef  hi2c2;
+I2C_HandleTypeDef  hi2c3;
+
+static uint8_t*	   rx_target = NULL;	// buffer of the pending HAL_UART_Receive_IT, NULL if none
+static bool		   polling	 = false;
+static bool		   i2c_timing = false;
+static I2C_HandleTypeDef* i2c_dma = NULL;	// handle of the DMA write in progress, NULL if none
+static uint64_t	   i2c_dma_done = 0;	// when it is done, in us
+static uint16_t	   i2c_dma_address, i2c_dma_mem_address, i2c_dma_size;
+static uint8_t*	   i2c_dma_data;
+static uint64_t	   start_us	 = 0;
+static uint32_t	   tick_skipped = 0;	// ms added to HAL_GetTick by hal_shim_skip_time
+
+static uint64_t
+host_us(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t now = (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+	if(start_us == 0)
+		start_us = now;
+	return now - start_us;
+}
+
+/* Called by the emulator for every byte that reaches UART4, like the rx interrupt */
+void
+hal_shim_uart4_deliver(uint8_t byte){
+	if(rx_target == NULL)
+		return;
+	uint8_t* target = rx_target;
+	rx_target = NULL;
+	*target = byte;
+	HAL_UART_RxCpltCallback(&huart4);
+}
+
+/* The display is the only device on the host that takes writes */
+static void
+i2c_deliver(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, const uint8_t* data, uint16_t size){
+	if(hi2c == &hi2c2 && address == SSD1306_EMULATOR_ADDRESS)
+		ssd1306_emulator_write(mem_address, data, size);
+}
+
+/* Reports the DMA write as done once its time has passed, like the interrupt */
+static void
+i2c_dma_poll(void){
+	if(i2c_dma == NULL || host_us() < i2c_dma_done)
+		return;
+	I2C_HandleTypeDef* hi2c = i2c_dma;
+	i2c_dma = NULL;
+	i2c_deliver(hi2c, i2c_dma_address, i2c_dma_mem_address, i2c_dma_data, i2c_dma_size);
+	HAL_I2C_MemTxCpltCallback(hi2c);
+}
+
+uint32_t
+HAL_GetTick(void){
+	/* The callbacks may end up here again, bytes are delivered one poll at a time */
+	if(!polling){
+		polling = true;
+		esp8266_emulator_poll();
+		i2c_dma_poll();
+		polling = false;
+	}
+	return host_us() / 1000 + tick_skipped;
+}
+
+void
+HAL_Delay(uint32_t delay){
+	uint32_t start = HAL_GetTick();
+	while(HAL_GetTick() - start < delay)
+		;
+}
+
+/* The unique id of one board, the wafer position, wafer number and lot */
+uint32_t
+HAL_GetUIDw0(void){
+	return 0x0041002B;
+}
+
+uint32_t
+HAL_GetUIDw1(void){
+	return 0x4E4B5012;
+}
+
+uint32_t
+HAL_GetUIDw2(void){
+	return 0x20343537;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Init(UART_HandleTypeDef* huart){
+	if(huart->Instance == UART4)
+		esp8266_emulator_host_baud_rate(huart->Init.BaudRate);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_DeInit(UART_HandleTypeDef* huart){
+	if(huart->Instance == UART4)
+		rx_target = NULL;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size, uint32_t timeout){
+	(void) timeout;
+	if(huart->Instance != UART4)
+		return HAL_OK;
+
+	esp8266_emulator_write(data, size);
+	if(esp8266_emulator_config()->uart_timing){
+		uint64_t end = host_us() + (uint64_t) size * 10 * 1000000ULL / huart->Init.BaudRate;
+		while(host_us() < end)
+			HAL_GetTick();
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Receive_IT(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size){
+	(void) size;
+	if(huart->Instance == UART4)
+		rx_target = data;
+	return HAL_OK;
+}
+
+/* Time of the address, memory address and data bytes, 9 clocks each with the ack */
+static uint64_t
+i2c_time(uint16_t mem_size, uint16_t size){
+	if(!i2c_timing)
+		return 0;
+	return ((1 + mem_size + (uint64_t) size) * 9 + I2C_FRAME_BITS) * 1000000ULL / I2C_CLOCK;
+}
+
+static void
+i2c_wait(uint16_t mem_size, uint16_t size){
+	uint64_t end = host_us() + i2c_time(mem_size, size);
+	while(host_us() < end)
+		HAL_GetTick();
+}
+
+void
+hal_shim_i2c_timing(bool on){
+	i2c_timing = on;
+}
+
+void
+hal_shim_skip_time(uint32_t ms){
+	tick_skipped += ms;
+}
+
+/* No sensors on the host, writes are accepted and reads give zeros */
+HAL_StatusTypeDef
+HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+				  uint8_t* data, uint16_t size, uint32_t timeout){
+	(void) timeout;
+	if(i2c_dma == hi2c)
+		return HAL_BUSY;
+	i2c_wait(mem_size, size);
+	i2c_deliver(hi2c, address, mem_address, data, size);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+					  uint8_t* data, uint16_t size){
+	if(i2c_dma != NULL)
+		return HAL_BUSY;
+	i2c_dma				= hi2c;
+	i2c_dma_done		= host_us() + i2c_time(mem_size, size);
+	i2c_dma_address		= address;
+	i2c_dma_mem_address = mem_address;
+	i2c_dma_data		= data;
+	i2c_dma_size		= size;
+	return HAL_OK;
+}
+
+/* Weak like in the HAL, ssd1306.c has its own when it uses DMA */
+__attribute__((weak)) void
+HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef* hi2c){
+	(void) hi2c;
+}
+
+__attribute__((weak)) void
+HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c){
+	(void) hi2c;
+}
+
+HAL_StatusTypeDef
+HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t address, uint16_t mem_address, uint16_t mem_size,
+				 uint8_t* data, uint16_t size, uint32_t timeout){
+	(void) hi2c; (void) address; (void) mem_address; (void) mem_size; (void) timeout;
+	memset(data, 0, size);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_I2C_Master_Transmit(I2C_HandleTypeDef* hi2c, uint16_t address, uint8_t* data, uint16_t size, uint32_t timeout){
+	(void) hi2c; (void) address; (void) data; (void) size; (void) timeout;
+	return HAL_OK;
+}
+
+HAL_I2C_StateTypeDef
+HAL_I2C_GetState(I2C_HandleTypeDef* hi2c){
+	(void) hi2c;
+	return HAL_I2C_STATE_READY;
+}
+
+void
+HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init){
+	(void) port; (void) init;
+}
+
+void
+HAL_GPIO_DeInit(GPIO_TypeDef* port, uint32_t pin){
+	(void) port; (void) pin;
+}
+
+void
+HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state){
+	if(port == ESP_RST_GPIO_Port && pin == ESP_RST_Pin)
+		esp8266_emulator_reset_pin(state == GPIO_PIN_SET);
+	else if(port == ESP_WAKE_GPIO_Port && pin == ESP_WAKE_Pin)
+		esp8266_emulator_wake_pin(state == GPIO_PIN_SET);
+}
+
+void
+HAL_NVIC_SetPriority(int irq, uint32_t preempt_priority, uint32_t sub_priority){
+	(void) irq; (void) preempt_priority; (void) sub_priority;
+}
+
+void
+HAL_NVIC_EnableIRQ(int irq){
+	(void) irq;
+}
+
+void
+HAL_NVIC_DisableIRQ(int irq){
+	(void) irq;
+}
+
+/* CubeMX init code, see usart.c, gpio.c and i2c.c */
+void
+MX_UART4_Init(void){
+	huart4.Instance			 = UART4;
+	huart4.Init.BaudRate	 = 115200;
+	huart4.Init.WordLength	 = UART_WORDLENGTH_8B;
+	huart4.Init.StopBits	 = UART_STOPBITS_1;
+	huart4.Init.Parity		 = UART_PARITY_NONE;
+	huart4.Init.Mode		 = UART_MODE_TX_RX;
+	huart4.Init.HwFlowCtl	 = UART_HWCONTROL_NONE;
+	huart4.Init.OverSampling = UART_OVERSAMPLING_16;
+	if(HAL_UART_Init(&huart4) != HAL_OK)
+		Error_Handler();
+}
+
+HAL_StatusTypeDef
+uart4_reconfigure(uint32_t baud_rate, uint32_t flow_control){
+	if(HAL_UART_DeInit(&huart4) != HAL_OK)
+		return HAL_ERROR;
+	huart4.Init.BaudRate  = baud_rate;
+	huart4.Init.HwFlowCtl = flow_control;
+	return HAL_UART_Init(&huart4);
+}
+
+void
+MX_GPIO_Init(void){
+}
+
+void
+esp8266_gpio_init(void){
+	HAL_GPIO_WritePin(ESP_WAKE_GPIO_Port, ESP_WAKE_Pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(ESP_RST_GPIO_Port, ESP_RST_Pin, GPIO_PIN_SET);
+}
+
+void
+MX_I2C1_Init(void){
+	hi2c1.Instance = I2C1;
+}
+
+void
+MX_I2C2_Init(void){
+	hi2c2.Instance = I2C2;
+}
+
+void
+MX_I2C3_Init(void){
+	hi2c3.Instance = I2C3;
+}
+
+void
+Error_Handler(void){
+	fprintf(stderr, "Error_Handler called\n");
+	exit(EXIT_FAILURE);
+}
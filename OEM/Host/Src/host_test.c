@@ -0,0 +1,1118 @@
+/**
+******************************************************************************
+@brief regression tests and benchmark of the network and display code, run on Linux
+@details ESP8266.c and office_environment_monitor.c are built for the host,
+		 with the HAL replaced by hal_shim.c and the ESP8266 by the emulator
+		 in esp8266_emulator.c. The emulator connects to the test server in
+		 test_server.c, which is also the mqtt broker, so no hardware and no
+		 internet is needed. Writes to
+		 the display are accepted by the shim, what ssd1306.c sends is
+		 counted by the driver itself.
+
+		 Build and run from the OEM directory:
+		 gcc -std=gnu11 -O2 -I Host/Inc -I Core/Inc \
+			 Host/Src/host_test.c Host/Src/hal_shim.c Host/Src/esp8266_emulator.c Host/Src/test_server.c \
+			 Host/Src/ssd1306_emulator.c Host/Src/cbor_reader.c \
+			 Core/Src/ESP8266.c Core/Src/http.c Core/Src/cbor.c Core/Src/mqtt.c \
+			 Core/Src/office_environment_monitor.c Core/Src/ssd1306.c Core/Src/fonts.c Core/Src/display_field.c \
+			 Core/Src/display_graph.c Core/Src/CCS811_BME280.c Core/Src/unity.c -lpthread -lm -o oem_host_test
+		 ./oem_host_test			runs the tests
+		 ./oem_host_test bench		prints the time of init and of a request for each transport,
+		 							and the display bytes of a show_measurements cycle
+		 ./oem_host_test golden		runs the tests, but writes the images of the screens to
+		 							Host/Golden instead of comparing the display with them
+
+		 What ssd1306.c sends on hi2c2 is decoded by the SSD1306 emulator in
+		 ssd1306_emulator.c. A screen that differs from its golden image is
+		 written to <name>.actual.pbm, to look at with any image viewer.
+
+		 The upload transport of office_environment_monitor.c can be picked
+		 with e.g. -DUPLOAD_TRANSPORT=1, the tests of esp8266_web_upload then
+		 run on that transport. -DDISPLAY_HORIZONTAL_ADDRESSING=0 builds the
+		 display driver with page addressing, -DDISPLAY_DMA=0 without DMA.
+
+@file host_test.c
+@version 1.0
+*******************************************************************************/
+#define _GNU_SOURCE
+#include "unity.h"
+#include "ESP8266.h"
+#include "office_environment_monitor.h"
+#include "esp8266_emulator.h"
+#include "test_server.h"
+#include "ssd1306.h"
+#include "display_field.h"
+#include "display_graph.h"
+#include "ssd1306_emulator.h"
+#include "cbor_reader.h"
+
+#define BENCH_REQUESTS		20		// requests per transport in the benchmark
+#define BENCH_LATENCY		5		// ms from the ESP8266 getting a command to it answering
+#define BENCH_FRAGMENT		64		// bytes per fragment of the answers
+#define BENCH_SAMPLES		20		// samples per batch in the benchmark
+#define BENCH_ROW_SIZE		48		// max length of one csv row of the batch
+#define GOLDEN_DIR			"Host/Golden/"	// images of the screens, relative to the OEM directory
+#define BENCH_REFRESHES		60		// show_measurements cycles in the benchmark
+#define BENCH_REFRESH_LOOPS	20000	// show_measurements cycles timed in the benchmark
+#define BENCH_FRAMES		10		// whole frames timed in the benchmark
+#define BENCH_GLYPHS		200000	// chars drawn in the benchmark of display_write_char
+#define FULL_FRAME_BYTES	(PAGES * (3 * 2 + 1 + W))	// what display_update sent before the dirty tracking
+
+static uint16_t server_port;
+static ESP8266_EMULATOR_CONFIG config;
+
+/* Power cycles the emulator with the given config, the firmware is left as it is */
+static void
+emulator_restart(void){
+	esp8266_emulator_start(&config, hal_shim_uart4_deliver);
+}
+
+void setUp(void){
+	esp8266_emulator_default_config(&config);
+	config.port = server_port;
+	test_server_respond(200, "", false);
+	test_server_chunked(0);
+	test_server_delay(0);
+	test_server_mqtt_drop_acks(0);
+	test_server_reset();
+}
+
+void tearDown(void){
+}
+
+/* Module that is still joined from before, nothing but the configuration and the rate change */
+void test_emulator_init(void){
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_MAX_BAUD_RATE, esp8266_baud_rate());
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_MAX_BAUD_RATE, esp8266_emulator_baud_rate());
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_emulator_stats()->restarts);
+}
+
+/* Only the L476 restarts, the module is still at the fast rate and has to be found there */
+void test_emulator_init_fast_rate(void){
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_MAX_BAUD_RATE, esp8266_baud_rate());
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_emulator_stats()->restarts);
+}
+
+/* Not joined, the module is restarted and the boot messages at 74880 baud are not understood */
+void test_emulator_init_restart(void){
+	config.joined	 = false;
+	config.boot_time = 200;
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_emulator_stats()->restarts);
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_MAX_BAUD_RATE, esp8266_baud_rate());
+}
+
+void test_emulator_wifi_join(void){
+	config.joined	 = false;
+	config.join_time = 100;
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init());
+	TEST_ASSERT_EQUAL_STRING(config.bssid, esp8266_wifi_bssid());
+}
+
+/* The learnt BSSID is tried first, then a normal join, both fail */
+void test_emulator_wifi_wrong_password(void){
+	config.joined	= false;
+	config.password = "not the password";
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WRONG_PWD, esp8266_wifi_init());
+	TEST_ASSERT_EQUAL_STRING("", esp8266_wifi_bssid());
+}
+
+void test_emulator_web_request(void){
+	TEST_SERVER_STATS server;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_request(400, 20, 20.05f, 40.1f));
+
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(1, server.requests);
+	TEST_ASSERT_EQUAL_UINT32(1, server.closes);
+#if UPLOAD_ENCODING == UPLOAD_ENCODING_CBOR
+	TEST_ASSERT_NOT_NULL(strstr(server.request, "POST /api/sensor HTTP/1.1\r\n"));
+	TEST_ASSERT_NOT_NULL(strstr(server.request, "Content-Type: application/cbor\r\n"));
+	TEST_ASSERT_GREATER_THAN_UINT16(server.body_offset, server.request_len);
+#else
+	/* Rounded, 40.1f * 100 is 4009.99 */
+	TEST_ASSERT_NOT_NULL(strstr(server.request, "POST /api/sensor?carbon=400&volatile=20&temperature=20.05&humidity=40.10 HTTP/1.1\r\n"));
+#endif
+	TEST_ASSERT_NOT_NULL(strstr(server.request, "Connection: close\r\n"));
+}
+
+/* The answer arrives in small +IPD messages, a few bytes at a time and chunked, the parser has to put it together */
+void test_emulator_fragmented_response(void){
+	ESP8266_REQUEST request;
+	HTTP_RESPONSE response;
+	int32_t value;
+
+	config.ipd_size		 = 16;
+	config.fragment_size = 3;
+	config.fragment_gap	 = 1;
+	emulator_restart();
+	test_server_respond(200, "interval=45&batch=12", false);
+	test_server_chunked(5);
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+
+	esp8266_request_init(&request);
+	esp8266_request_add_string(&request, "GET /api/settings");
+	esp8266_request_http_headers(&request, "localhost", true, NULL, 0);
+	esp8266_response_start(&response);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send_request(&request));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_wait_response());
+	esp8266_response_stop();
+
+	TEST_ASSERT_EQUAL_UINT(HTTP_PARSE_DONE, response.state);
+	TEST_ASSERT_EQUAL_UINT16(200, response.status);
+	TEST_ASSERT_TRUE(response.chunked);
+	TEST_ASSERT_TRUE(http_form_value(response.body, "interval", &value));
+	TEST_ASSERT_EQUAL_INT32(45, value);
+	TEST_ASSERT_TRUE(http_form_value(response.body, "batch", &value));
+	TEST_ASSERT_EQUAL_INT32(12, value);
+	TEST_ASSERT_GREATER_THAN_UINT32(5, esp8266_emulator_stats()->ipd_messages);
+}
+
+void test_emulator_latency(void){
+	config.latency = 50;
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+
+	uint32_t start = HAL_GetTick();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(ESP8266_AT));
+	TEST_ASSERT_UINT32_WITHIN(20, 60, HAL_GetTick() - start);
+}
+
+/* Uploads on the transport office_environment_monitor.c is built with */
+void test_emulator_upload(void){
+	TEST_SERVER_STATS server;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP || UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP_PASSTHROUGH
+	/* The udp socket and the broker connection are opened by the upload, a tcp connection would be taken for them */
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+#endif
+	for(uint16_t i = 0; i < 5; i++)
+		store_sample(400 + i, 20 + i, 20.05f, 40.1f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_UDP
+	/* Nothing comes back, give the datagram time to arrive */
+	HAL_Delay(50);
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(1, server.datagrams);
+	TEST_ASSERT_EQUAL_UINT16(9 + 5 * 12, server.datagram_len);
+	/* The first sample starts after the 9 byte header, its temperature and humidity after the age, co2 and tvoc.
+	 * Rounded, 40.1f * 100 is 4009.99 */
+	TEST_ASSERT_EQUAL_UINT16(2005, (server.datagram[17] << 8) | server.datagram[18]);
+	TEST_ASSERT_EQUAL_UINT16(4010, (server.datagram[19] << 8) | server.datagram[20]);
+#elif UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+	/* The latest values on a topic each with qos 0, then the batch with qos 1 */
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(1, server.mqtt_connects);
+	TEST_ASSERT_EQUAL_UINT32(5, server.publishes);
+	TEST_ASSERT_EQUAL_HEX8(MQTT_PUBLISH | 0x02, (uint8_t) server.request[0]);
+	TEST_ASSERT_NOT_NULL(memmem(server.request, server.body_offset, "oem/samples", 11));
+	TEST_ASSERT_GREATER_THAN_UINT16(server.body_offset, server.request_len);
+#if UPLOAD_ENCODING == UPLOAD_ENCODING_TEXT
+	TEST_ASSERT_EQUAL_STRING_LEN("timestamp,", &server.request[server.body_offset], 10);
+#endif
+#else
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(1, server.requests);
+	TEST_ASSERT_NOT_NULL(strstr(server.request, "Content-Type: " UPLOAD_CONTENT_TYPE "\r\n"));
+#endif
+}
+
+/* Uploads the way the main loop does, the esp8266 sleeps after each one and is woken up for the next.
+ * Nothing but the requests may reach the server, in passthrough mode AT+SLEEP would be sent to it */
+void test_emulator_upload_sleep(void){
+	TEST_SERVER_STATS server;
+	uint32_t sleep_cycles = get_power_stats()->sleep_cycles;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP || UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP_PASSTHROUGH
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+#endif
+	for(uint16_t i = 0; i < 3; i++){
+		store_sample(400 + i, 20 + i, 21.5f, 40.0f);
+		TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_upload_with_recovery());
+		TEST_ASSERT_EQUAL_UINT32(sleep_cycles + i + 1, get_power_stats()->sleep_cycles);
+		TEST_ASSERT_NOT_EQUAL(ESP8266_SLEEP_NONE, esp8266_sleep_mode());
+	}
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_UDP
+	HAL_Delay(50);
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(3, server.datagrams);
+#elif UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+	/* Modem sleep keeps the broker connection, one session for all uploads */
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(1, server.mqtt_connects);
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(3, server.publishes);
+	TEST_ASSERT_EQUAL_HEX8(MQTT_PUBLISH | 0x02, (uint8_t) server.request[0]);
+	TEST_ASSERT_NULL(memmem(server.request, server.request_len, "AT+", 3));
+#else
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(3, server.requests);
+	TEST_ASSERT_EQUAL_STRING_LEN("POST ", server.request, 5);
+	TEST_ASSERT_NULL(strstr(server.request, "AT+"));
+#endif
+}
+
+/* A slower drive mode from the server, the CCS811 samples on until everything has been uploaded and only then
+ * idles for CCS811_IDLE_TIME. A faster mode is used at once, and the next slower one has to wait for the rate limit */
+void test_ccs811_drive_mode_sequencing(void){
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP || UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP_PASSTHROUGH
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+#endif
+	store_sample(400, 20, 21.5f, 40.0f);
+
+	TEST_ASSERT_TRUE(apply_server_settings("drive_mode=2"));
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(1, ccs811_drive_mode());
+	TEST_ASSERT_EQUAL_UINT32(1000, ccs811_sample_period());
+
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(0, ccs811_drive_mode());
+	TEST_ASSERT_EQUAL_UINT32(10000, ccs811_sample_period());
+	hal_shim_skip_time(CCS811_IDLE_TIME - 1000);
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(0, ccs811_drive_mode());
+	hal_shim_skip_time(1000);
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(2, ccs811_drive_mode());
+
+	TEST_ASSERT_TRUE(apply_server_settings("drive_mode=1"));
+	TEST_ASSERT_EQUAL_UINT8(1, ccs811_drive_mode());
+
+	/* Too soon after the last idle period, sampling goes on in mode 1 */
+	TEST_ASSERT_TRUE(apply_server_settings("drive_mode=3"));
+	TEST_ASSERT_FALSE(apply_server_settings("drive_mode=3"));
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(1, ccs811_drive_mode());
+	hal_shim_skip_time(CCS811_SLOWDOWN_INTERVAL - CCS811_IDLE_TIME);
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(0, ccs811_drive_mode());
+
+	/* Back to mode 1 while idle, the rest of the idle period is not needed for it */
+	TEST_ASSERT_TRUE(apply_server_settings("drive_mode=1"));
+	TEST_ASSERT_EQUAL_UINT8(1, ccs811_drive_mode());
+	ccs811_drive_mode_update();
+	TEST_ASSERT_EQUAL_UINT8(1, ccs811_drive_mode());
+	TEST_ASSERT_EQUAL_UINT32(1000, ccs811_sample_period());
+}
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+/* A broker that stops answering, the session is dropped when a PINGRESP or a PUBACK does not come
+ * and the next upload connects again */
+void test_emulator_mqtt_ack_timeout(void){
+	TEST_SERVER_STATS server;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	store_sample(400, 20, 21.5f, 40.0f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+	TEST_ASSERT_TRUE(mqtt_connected());
+
+	test_server_mqtt_drop_acks(1);
+	TEST_ASSERT_EQUAL_UINT(MQTT_NO_ACK, mqtt_ping());
+	TEST_ASSERT_FALSE(mqtt_connected());
+
+	store_sample(410, 21, 21.6f, 40.1f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+	TEST_ASSERT_TRUE(mqtt_connected());
+
+	test_server_mqtt_drop_acks(1);
+	TEST_ASSERT_EQUAL_UINT(MQTT_NO_ACK, mqtt_publish("oem/test", "1", 1, 1));
+	TEST_ASSERT_FALSE(mqtt_connected());
+
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(2, server.mqtt_connects);
+	TEST_ASSERT_EQUAL_UINT32(1, server.pings);
+}
+#endif
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP
+/* A failed AT+CIPSEND makes send_batch connect again while the old connection is still open */
+void test_emulator_upload_cipsend_error(void){
+	TEST_SERVER_STATS server;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	store_sample(400, 20, 21.5f, 40.0f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+
+	store_sample(410, 21, 21.6f, 40.1f);
+	esp8266_emulator_inject_fault(ESP8266_AT_SEND, 1, EMULATOR_FAULT_ERROR);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_emulator_stats()->faults);
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(2, server.requests);
+	TEST_ASSERT_EQUAL_UINT32(1, server.connections);
+}
+
+/* The server closes the connection after answering, the next upload opens a new one */
+void test_emulator_upload_server_close(void){
+	TEST_SERVER_STATS server;
+	uint32_t closes = get_upload_stats()->server_closes;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	test_server_respond(200, "", true);
+	store_sample(400, 20, 21.5f, 40.0f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+	store_sample(410, 21, 21.6f, 40.1f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(2, server.requests);
+	TEST_ASSERT_EQUAL_UINT32(2, server.connections);
+	TEST_ASSERT_EQUAL_UINT32(closes + 2, get_upload_stats()->server_closes);
+}
+
+/* The server drops the idle connection between uploads, the ESP8266 reports CLOSED while nobody is listening */
+void test_emulator_upload_idle_drop(void){
+	TEST_SERVER_STATS server;
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	store_sample(400, 20, 21.5f, 40.0f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+
+	test_server_drop_connection();
+	HAL_Delay(50);
+	store_sample(410, 21, 21.6f, 40.1f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_web_upload());
+
+	test_server_stats(&server);
+	TEST_ASSERT_EQUAL_UINT32(2, server.requests);
+	TEST_ASSERT_EQUAL_UINT32(2, server.connections);
+}
+
+
+/* Waits out the backoff after the given number of failures in a row, it is at least half of the full time */
+static void
+skip_backoff(uint8_t failures){
+	uint32_t backoff = UPLOAD_RETRY_BASE << (failures - 1);
+	hal_shim_skip_time(backoff / 2 - 100);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_UPLOAD_BACKOFF, esp8266_upload_with_recovery());
+	hal_shim_skip_time(backoff / 2 + 100);
+}
+
+/* The AP goes away and is joined again after UPLOAD_REJOIN_AFTER failures, then every connection is
+ * refused until the module has been restarted after UPLOAD_RESET_AFTER failures */
+void test_emulator_upload_recovery(void){
+	UPLOAD_STATS before = *get_upload_stats();
+
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	store_sample(400, 20, 21.5f, 40.0f);
+	esp8266_emulator_set_joined(false);
+	for(uint8_t failures = 0; failures < UPLOAD_REJOIN_AFTER; failures++){
+		if(failures > 0)
+			skip_backoff(failures);
+		TEST_ASSERT_NOT_EQUAL(ESP8266_WEB_REQUEST_SUCCESS, esp8266_upload_with_recovery());
+	}
+	TEST_ASSERT_EQUAL_UINT32(before.wifi_rejoins, get_upload_stats()->wifi_rejoins);
+	skip_backoff(UPLOAD_REJOIN_AFTER);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_upload_with_recovery());
+	TEST_ASSERT_EQUAL_UINT32(before.wifi_rejoins + 1, get_upload_stats()->wifi_rejoins);
+	TEST_ASSERT_EQUAL_UINT32(before.failed_uploads + UPLOAD_REJOIN_AFTER, get_upload_stats()->failed_uploads);
+
+	/* Both AT+CIPSTART of each attempt fail, still joined so there is nothing to rejoin */
+	test_server_drop_connection();
+	HAL_Delay(50);
+	store_sample(410, 21, 21.6f, 40.1f);
+	esp8266_emulator_inject_fault(ESP8266_AT_START, 2 * UPLOAD_RESET_AFTER, EMULATOR_FAULT_ERROR);
+	for(uint8_t failures = 0; failures < UPLOAD_RESET_AFTER; failures++){
+		if(failures > 0)
+			skip_backoff(failures);
+		TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_DISCONNECTED, esp8266_upload_with_recovery());
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_emulator_stats()->restarts);
+	skip_backoff(UPLOAD_RESET_AFTER);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_upload_with_recovery());
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_emulator_stats()->restarts);
+	TEST_ASSERT_EQUAL_UINT32(2 * UPLOAD_RESET_AFTER, esp8266_emulator_stats()->faults);
+	TEST_ASSERT_EQUAL_UINT32(before.module_resets + 1, get_upload_stats()->module_resets);
+	TEST_ASSERT_EQUAL_UINT32(before.wifi_rejoins + 1, get_upload_stats()->wifi_rejoins);
+
+	/* Back to normal, the next upload is not held back */
+	store_sample(420, 22, 21.7f, 40.2f);
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_REQUEST_SUCCESS, esp8266_upload_with_recovery());
+}
+
+#endif
+
+void test_emulator_passthrough(void){
+	ESP8266_REQUEST request;
+	HTTP_RESPONSE response;
+
+	emulator_restart();
+	test_server_respond(204, "", false);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_UINT(ESP8266_WEB_CONNECTED, esp8266_web_connection());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_start());
+
+	esp8266_request_init(&request);
+	esp8266_request_add_string(&request, "GET /api/settings");
+	esp8266_request_http_headers(&request, "localhost", true, NULL, 0);
+	esp8266_response_start(&response);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_send_request(&request));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_wait_response());
+	esp8266_response_stop();
+	TEST_ASSERT_EQUAL_UINT16(204, response.status);
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_passthrough_stop());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_connection_status());
+}
+
+void test_emulator_deep_sleep(void){
+	config.boot_time = 100;
+	config.join_time = 100;
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_sleep(ESP8266_SLEEP_DEEP, 0));
+
+	esp8266_wake_start();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_wake_finish());
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_emulator_stats()->restarts);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_send_command(ESP8266_AT_CWJAP_TEST));
+}
+
+void test_emulator_light_sleep(void){
+	emulator_restart();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_sleep(ESP8266_SLEEP_LIGHT, 0));
+
+	/* Deaf until the wake pin is pulled */
+	esp8266_clear();
+	HAL_UART_Transmit(&huart4, (uint8_t*) ESP8266_AT, strlen(ESP8266_AT), 100);
+	TEST_ASSERT_FALSE(esp8266_wait_for(ESP8266_AT_OK_TERMINATOR, 100));
+	esp8266_wake_start();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_wake_finish());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(ESP8266_AT));
+}
+
+/* One more ppm of CO2 changes a digit or two, only their columns are sent */
+void test_display_partial_update(void){
+	display_init();
+	reset_screen_canvas();
+	show_measurements(21.5f, 40.0f, 612, 20);
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	uint32_t flushed = display_get_flushed_bytes();
+	show_measurements(21.5f, 40.0f, 613, 20);
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	TEST_ASSERT_LESS_THAN_UINT32(FULL_FRAME_BYTES / 20, display_get_flushed_bytes() - flushed);
+
+	/* Nothing changed, nothing sent */
+	flushed = display_get_flushed_bytes();
+	show_measurements(21.5f, 40.0f, 613, 20);
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	TEST_ASSERT_EQUAL_UINT32(0, display_get_flushed_bytes() - flushed);
+}
+
+/* Clearing and writing lines only touch the buffer, the next update sends all of it at once */
+void test_display_no_delay(void){
+	display_init();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	display_string_on_line("WIFI CON ERROR:", WHITE, 1);
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	hal_shim_i2c_timing(true);
+
+	uint32_t flushed = display_get_flushed_bytes();
+	uint32_t start = HAL_GetTick();
+	reset_screen_canvas();
+	display_string_on_line_no_update("WEB REQUEST FAIL", WHITE, 1);
+	display_string_on_line_no_update("Check connections", WHITE, 2);
+	TEST_ASSERT_LESS_THAN_UINT32(2, HAL_GetTick() - start);
+	TEST_ASSERT_EQUAL_UINT32(flushed, display_get_flushed_bytes());
+	TEST_ASSERT_EQUAL_UINT16(2 * ROW_SIZE, display_get_y());
+
+	display_update();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+	TEST_ASSERT_LESS_THAN_UINT32(FULL_FRAME_BYTES / 2, display_get_flushed_bytes() - flushed);
+	hal_shim_i2c_timing(false);
+}
+
+/* A field draws the cells that changed, and all of them again after the screen was cleared */
+void test_display_field(void){
+	DISPLAY_FIELD field;
+
+	display_init();
+	reset_screen_canvas();
+	display_field_init(&field, 29, 16, FONT_LARGE, 5);
+	TEST_ASSERT_EQUAL_UINT8(5, display_field_set(&field, "  612"));
+	TEST_ASSERT_EQUAL_STRING("  612", field.text);
+	display_update();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+
+	display_set_position(3, 50);
+	TEST_ASSERT_EQUAL_UINT8(1, display_field_set(&field, "  613"));
+	TEST_ASSERT_EQUAL_UINT16(3, display_get_x());
+	TEST_ASSERT_EQUAL_UINT16(50, display_get_y());
+	TEST_ASSERT_EQUAL_UINT8(0, display_field_set(&field, "  613"));
+
+	/* Shorter texts are padded with spaces */
+	TEST_ASSERT_EQUAL_UINT8(2, display_field_set(&field, "  6"));
+	TEST_ASSERT_EQUAL_STRING("  6  ", field.text);
+
+	reset_screen_canvas();
+	TEST_ASSERT_EQUAL_UINT8(5, display_field_set(&field, "  6"));
+	display_field_invalidate(&field);
+	TEST_ASSERT_EQUAL_UINT8(5, display_field_set(&field, "  6"));
+}
+
+/* A new point moves the plot and draws one column, which ends up as if the whole plot was drawn */
+void test_display_graph(void){
+	static uint8_t scrolled[BUFFERSIZE];
+	static DISPLAY_GRAPH graph;
+
+	display_init();
+	reset_screen_canvas();
+	display_graph_init(&graph, 32, 0, 96, 32, DISPLAY_GRAPH_LINE, 100, 1);
+	TEST_ASSERT_EQUAL_UINT8(0, display_graph_draw(&graph));
+	display_graph_add(&graph, 612);
+	TEST_ASSERT_EQUAL_UINT8(96, display_graph_draw(&graph));
+	TEST_ASSERT_EQUAL_STRING(" 700", graph.max_label.text);
+	TEST_ASSERT_EQUAL_STRING(" 600", graph.min_label.text);
+
+	for(uint16_t i = 0; i < 200; i++){
+		display_graph_add(&graph, 610 + (i * 7) % 80);
+		TEST_ASSERT_EQUAL_UINT8(1, display_graph_draw(&graph));
+	}
+	memcpy(scrolled, display_get_buffer(), BUFFERSIZE);
+	reset_screen_canvas();
+	TEST_ASSERT_EQUAL_UINT8(96, display_graph_draw(&graph));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(scrolled, display_get_buffer(), BUFFERSIZE);
+
+	/* The scale follows the values */
+	display_graph_add(&graph, 1234);
+	TEST_ASSERT_EQUAL_UINT8(96, display_graph_draw(&graph));
+	TEST_ASSERT_EQUAL_STRING("1300", graph.max_label.text);
+
+	/* Bars of tenths below zero, the scale is rounded down to whole units */
+	display_graph_init(&graph, 32, 32, 96, 32, DISPLAY_GRAPH_BARS, 10, 10);
+	display_graph_add(&graph, -15);
+	display_graph_add(&graph, 5);
+	TEST_ASSERT_EQUAL_UINT8(96, display_graph_draw(&graph));
+	TEST_ASSERT_EQUAL_STRING("  -2", graph.min_label.text);
+	TEST_ASSERT_EQUAL_STRING("   1", graph.max_label.text);
+	TEST_ASSERT_EQUAL_HEX8(0xFC, display_get_buffer()[7 * W + 126]);
+	TEST_ASSERT_EQUAL_HEX8(0xFF, display_get_buffer()[7 * W + 127]);
+}
+
+/* What the display shows after every flush is what the driver has in its buffer */
+void test_display_emulator(void){
+	static DISPLAY_GRAPH graph;
+
+	display_init();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(display_get_buffer(), ssd1306_emulator_ram(), BUFFERSIZE);
+
+	for(uint16_t i = 0; i < 20; i++){
+		show_measurements(21.5f + i * 0.3f, 40.0f - i * 0.7f, 612 + i * 37, 20 + i);
+		TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(display_get_buffer(), ssd1306_emulator_ram(), BUFFERSIZE);
+	}
+
+	reset_screen_canvas();
+	display_graph_init(&graph, 32, 8, 96, 48, DISPLAY_GRAPH_LINE, 100, 1);
+	for(uint16_t i = 0; i < 150; i++){
+		display_graph_add(&graph, 600 + (i * 13) % 300);
+		display_graph_draw(&graph);
+		display_update();
+		TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(display_get_buffer(), ssd1306_emulator_ram(), BUFFERSIZE);
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, ssd1306_emulator_stats()->unknown);
+}
+
+/* Compares the display with its golden image, or writes the image with ./oem_host_test golden */
+static bool golden_update = false;
+
+static void
+check_golden(const char* name){
+	char path[64];
+
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	snprintf(path, sizeof(path), GOLDEN_DIR "%s.pbm", name);
+	if(golden_update){
+		TEST_ASSERT_TRUE_MESSAGE(ssd1306_emulator_write_pbm(path), path);
+		return;
+	}
+
+	int32_t differ = ssd1306_emulator_compare_pbm(path);
+	if(differ != 0){
+		snprintf(path, sizeof(path), "%s.actual.pbm", name);
+		ssd1306_emulator_write_pbm(path);
+	}
+	TEST_ASSERT_EQUAL_INT32_MESSAGE(0, differ, name);
+}
+
+/* The screens, pixel by pixel as the display shows them */
+void test_display_golden(void){
+	display_init();
+	reset_screen_canvas();
+	display_startscreen();
+	check_golden("startscreen");
+
+	reset_screen_canvas();
+	show_measurements(21.5f, 40.0f, 612, 20);
+	check_golden("measurements");
+
+	reset_screen_canvas();
+	store_history(21.5f, 612);
+	show_history();
+	check_golden("history");
+
+	show_error(ESP8266_WAKE_ERROR);
+	check_golden("error");
+}
+
+#if DISPLAY_DMA
+static uint32_t flush_callbacks;
+
+static void
+count_flush(HAL_StatusTypeDef status){
+	if(status == HAL_OK)
+		flush_callbacks++;
+}
+
+/* display_update returns before the frame is sent, updates in the meantime are sent after it as one */
+void test_display_dma_flush(void){
+	display_init();
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(100));
+	flush_callbacks = 0;
+	display_set_flush_callback(count_flush);
+	hal_shim_i2c_timing(true);
+
+	uint32_t start = HAL_GetTick();
+	display_invalidate();
+	display_update();
+	TEST_ASSERT_LESS_THAN_UINT32(5, HAL_GetTick() - start);
+	TEST_ASSERT_TRUE(display_flush_in_progress());
+
+	show_measurements(21.5f, 40.0f, 612, 20);
+	show_measurements(21.5f, 40.0f, 613, 20);
+
+	/* The interrupt only ends the first flush, the second one is started from the loop */
+	while(flush_callbacks == 0 && HAL_GetTick() - start < 500)
+		;
+	TEST_ASSERT_EQUAL_UINT32(1, flush_callbacks);
+	TEST_ASSERT_NOT_EQUAL(0, display_get_dirty_pages());
+	TEST_ASSERT_TRUE(display_flush_in_progress());
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+	TEST_ASSERT_EQUAL_UINT(HAL_OK, display_wait_flush(500));
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(90, HAL_GetTick() - start);
+	TEST_ASSERT_EQUAL_UINT32(2, flush_callbacks);
+	TEST_ASSERT_EQUAL_HEX8(0, display_get_dirty_pages());
+
+	hal_shim_i2c_timing(false);
+	display_set_flush_callback(NULL);
+}
+#endif
+
+/* How display_write_char drew before the columns, a pixel at a time from the rows of the font */
+static void
+write_char_pixels(char c, FontDef font, Display_ColourDef colour, uint16_t x, uint16_t y){
+	for(uint16_t i = 0; i < font.FontHeight; i++){
+		uint16_t row = font.data[(c - font.FirstChar) * font.FontHeight + i];
+		for(uint16_t j = 0; j < font.FontWidth; j++)
+			draw_pixel(x + j, y + i, ((row << j) & 0x8000) ? colour : (Display_ColourDef) !colour);
+	}
+}
+
+/* Every char at every row offset in a page, in both colours, over another char, as it was drawn a pixel at a time */
+void test_display_glyphs(void){
+	static uint8_t expected[BUFFERSIZE];
+
+	display_init();
+	for(Display_ColourDef colour = BLACK; colour <= WHITE; colour++){
+		for(uint16_t y = 8; y < 16; y++){
+			for(char c = ' '; c <= '~'; c++){
+				write_char_pixels('#', Font_7x10, !colour, 10, y);
+				write_char_pixels(c, Font_7x10, colour, 10, y);
+				memcpy(expected, display_get_buffer(), BUFFERSIZE);
+
+				write_char_pixels('#', Font_7x10, !colour, 10, y);
+				display_set_position(10, y);
+				display_write_char(c, Font_7x10, colour);
+				TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, display_get_buffer(), BUFFERSIZE);
+				TEST_ASSERT_EQUAL_UINT16(17, display_get_x());
+			}
+		}
+	}
+}
+
+/* The large font is the default one at twice the size, every pixel drawn as a square of four */
+void test_display_large_font(void){
+	static uint8_t expected[BUFFERSIZE];
+
+	display_init();
+	TEST_ASSERT_EQUAL_PTR(&Font_7x10, display_get_font());
+	for(char c = Font_14x20.FirstChar; c <= Font_14x20.LastChar; c++){
+		for(uint16_t y = 16; y < 24; y++){
+			for(uint16_t i = 0; i < Font_7x10.FontHeight; i++){
+				uint16_t row = Font_7x10.data[(c - Font_7x10.FirstChar) * Font_7x10.FontHeight + i];
+				for(uint16_t j = 0; j < 2 * Font_7x10.FontWidth; j++){
+					Display_ColourDef colour = ((row << (j / 2)) & 0x8000) ? WHITE : BLACK;
+					draw_pixel(10 + j, y + 2 * i, colour);
+					draw_pixel(10 + j, y + 2 * i + 1, colour);
+				}
+			}
+			memcpy(expected, display_get_buffer(), BUFFERSIZE);
+
+			write_char_pixels('#', Font_7x10, WHITE, 10, y);
+			display_set_position(10, y);
+			display_write_char(c, Font_14x20, WHITE);
+			TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, display_get_buffer(), BUFFERSIZE);
+		}
+	}
+
+	/* Lines follow the size of the font, chars it does not have are drawn as spaces */
+	display_set_font(FONT_LARGE);
+	TEST_ASSERT_EQUAL_PTR(&Font_14x20, display_get_font());
+	display_set_position(1, 1);
+	display_write_string_no_update("1234567890", WHITE);
+	TEST_ASSERT_EQUAL_UINT16(1 + Font_14x20.RowSize, display_get_y());
+	TEST_ASSERT_EQUAL_UINT16(1 + Font_14x20.FontWidth, display_get_x());
+	display_set_position(1, 40);
+	display_write_char('A', Font_14x20, WHITE);
+	memcpy(expected, display_get_buffer(), BUFFERSIZE);
+	display_set_position(1, 40);
+	display_write_char(' ', Font_14x20, WHITE);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, display_get_buffer(), BUFFERSIZE);
+	display_set_font(FONT_SMALL);
+}
+
+/* Decodes the values that cbor.c encodes in 1, 2, 3 and 5 bytes */
+void test_cbor_reader(void){
+	uint8_t buffer[32] = {0};
+	CBOR_WRITER writer;
+	CBOR_READER reader;
+	int32_t value;
+	uint32_t tick;
+
+	cbor_writer_init(&writer, buffer, sizeof(buffer));
+	cbor_put_int(&writer, 23);
+	cbor_put_int(&writer, 24);
+	cbor_put_int(&writer, -1);
+	cbor_put_int(&writer, cbor_fixed(-5.25f));
+	cbor_put_uint(&writer, 70000);
+	TEST_ASSERT_FALSE(writer.overflow);
+
+	cbor_reader_init(&reader, buffer, writer.len);
+	TEST_ASSERT_TRUE(cbor_get_int(&reader, &value));
+	TEST_ASSERT_EQUAL_INT(23, value);
+	TEST_ASSERT_TRUE(cbor_get_int(&reader, &value));
+	TEST_ASSERT_EQUAL_INT(24, value);
+	TEST_ASSERT_TRUE(cbor_get_int(&reader, &value));
+	TEST_ASSERT_EQUAL_INT(-1, value);
+	TEST_ASSERT_TRUE(cbor_get_int(&reader, &value));
+	TEST_ASSERT_EQUAL_INT(-525, value);
+	TEST_ASSERT_TRUE(cbor_get_uint(&reader, &tick));
+	TEST_ASSERT_EQUAL_UINT32(70000, tick);
+
+	/* Nothing left, and a negative value is not an unsigned integer */
+	TEST_ASSERT_FALSE(cbor_get_uint(&reader, &tick));
+	cbor_reader_init(&reader, &buffer[3], 1);
+	TEST_ASSERT_FALSE(cbor_get_uint(&reader, &tick));
+	TEST_ASSERT_TRUE(reader.error);
+}
+
+/* A batch decodes to the samples it was built from */
+void test_cbor_batch_round_trip(void){
+	static uint8_t buffer[256];
+	CBOR_WRITER writer;
+	CBOR_READER reader;
+	uint16_t count, size;
+	uint32_t now, first, delta, co2, tvoc;
+	int32_t temperature, humidity;
+	const uint32_t timestamps[] = {100000, 101000, 102500, 102500, 170000};
+
+	cbor_writer_init(&writer, buffer, sizeof(buffer));
+	cbor_put_batch(&writer, 180000, timestamps[0], 5);
+	for(uint8_t i = 0; i < 5; i++)
+		cbor_put_sample(&writer, timestamps[i] - ((i == 0) ? timestamps[0] : timestamps[i - 1]),
+						400 + i, i, -10.0f + i * 7.5f, 40.0f + i * 0.01f);
+	TEST_ASSERT_FALSE(writer.overflow);
+
+	cbor_reader_init(&reader, buffer, writer.len);
+	TEST_ASSERT_TRUE(cbor_get_array(&reader, &size));
+	TEST_ASSERT_EQUAL_UINT(CBOR_BATCH_SIZE, size);
+	TEST_ASSERT_TRUE(cbor_get_uint(&reader, &now));
+	TEST_ASSERT_EQUAL_UINT32(180000, now);
+	TEST_ASSERT_TRUE(cbor_get_uint(&reader, &first));
+	TEST_ASSERT_TRUE(cbor_get_array(&reader, &count));
+	TEST_ASSERT_EQUAL_UINT(5, count);
+
+	/* The timestamps are rebuilt by adding up the deltas */
+	for(uint8_t i = 0; i < count; i++){
+		TEST_ASSERT_TRUE(cbor_get_array(&reader, &size));
+		TEST_ASSERT_EQUAL_UINT(CBOR_SAMPLE_SIZE, size);
+		TEST_ASSERT_TRUE(cbor_get_uint(&reader, &delta));
+		first += delta;
+		TEST_ASSERT_EQUAL_UINT32(timestamps[i], first);
+		TEST_ASSERT_TRUE(cbor_get_uint(&reader, &co2));
+		TEST_ASSERT_EQUAL_UINT32(400 + i, co2);
+		TEST_ASSERT_TRUE(cbor_get_uint(&reader, &tvoc));
+		TEST_ASSERT_EQUAL_UINT32(i, tvoc);
+		TEST_ASSERT_TRUE(cbor_get_int(&reader, &temperature));
+		TEST_ASSERT_EQUAL_INT32(-1000 + i * 750, temperature);
+		TEST_ASSERT_TRUE(cbor_get_int(&reader, &humidity));
+		TEST_ASSERT_EQUAL_INT32(4000 + i, humidity);
+	}
+	TEST_ASSERT_FALSE(reader.error);
+	TEST_ASSERT_EQUAL_UINT(writer.len, reader.pos);
+}
+
+/* Times one request, sent with a new connection each time, on a kept open connection or in passthrough mode */
+typedef enum { BENCH_CLOSE = 0, BENCH_KEEP_ALIVE, BENCH_PASSTHROUGH } BENCH_TRANSPORT;
+
+static uint32_t
+bench_requests(BENCH_TRANSPORT transport, const char* body, uint16_t body_len){
+	ESP8266_REQUEST request;
+	HTTP_RESPONSE response;
+
+	if(transport != BENCH_CLOSE && esp8266_web_connection() != ESP8266_WEB_CONNECTED)
+		return 0;
+	if(transport == BENCH_PASSTHROUGH && strcmp(esp8266_passthrough_start(), ESP8266_AT_OK) != 0)
+		return 0;
+
+	uint32_t start = HAL_GetTick();
+	for(uint16_t i = 0; i < BENCH_REQUESTS; i++){
+		if(transport == BENCH_CLOSE && esp8266_web_connection() != ESP8266_WEB_CONNECTED)
+			return 0;
+
+		esp8266_request_init(&request);
+		esp8266_request_add_string(&request, "POST /api/sensor/batch");
+		esp8266_request_http_headers(&request, "localhost", transport != BENCH_CLOSE, "text/csv", body_len);
+		esp8266_request_add(&request, body, body_len);
+
+		esp8266_response_start(&response);
+		const char* sent = (transport == BENCH_PASSTHROUGH) ? esp8266_passthrough_send_request(&request) : esp8266_send_request(&request);
+		const char* answered = esp8266_wait_response();
+		esp8266_response_stop();
+		if((strcmp(sent, ESP8266_AT_SEND_OK) != 0 && strcmp(sent, ESP8266_AT_OK) != 0) || strcmp(answered, ESP8266_AT_ERROR) == 0)
+			return 0;
+	}
+	uint32_t time = HAL_GetTick() - start;
+
+	if(transport == BENCH_PASSTHROUGH)
+		esp8266_passthrough_stop();
+	return time;
+}
+
+static void
+bench(void){
+	static const char* names[] = { "new connection", "keep-alive", "passthrough" };
+	char body[BENCH_SAMPLES * BENCH_ROW_SIZE];
+	uint16_t body_len = 0;
+
+	for(uint16_t i = 0; i < BENCH_SAMPLES; i++)
+		body_len += sprintf(&body[body_len], "%u,%u,%u,%.2f,%.2f\n", i * 1000, 400 + i, 20 + i, 21.5, 40.25);
+
+	esp8266_emulator_default_config(&config);
+	config.port			 = server_port;
+	config.uart_timing	 = true;
+	config.latency		 = BENCH_LATENCY;
+	config.fragment_size = BENCH_FRAGMENT;
+	config.fragment_gap	 = 1;
+	config.joined		 = false;
+	config.boot_time	 = 300;
+	config.join_time	 = 1500;
+	test_server_respond(200, "", false);
+
+	printf("latency %u ms, fragments of %u bytes, uart timing on, %u byte body\n", BENCH_LATENCY, BENCH_FRAGMENT, body_len);
+
+	emulator_restart();
+	uint32_t start = HAL_GetTick();
+	const char* init = esp8266_init();
+	uint32_t init_time = HAL_GetTick() - start;
+	start = HAL_GetTick();
+	const char* join = esp8266_wifi_init();
+	printf("%-16s %6lu ms  %s, %lu baud\n", "esp8266_init", (unsigned long) init_time, init, (unsigned long) esp8266_baud_rate());
+	printf("%-16s %6lu ms  %s\n", "esp8266_wifi_init", (unsigned long) (HAL_GetTick() - start), join);
+
+	for(BENCH_TRANSPORT transport = BENCH_CLOSE; transport <= BENCH_PASSTHROUGH; transport++){
+		const ESP8266_EMULATOR_STATS* stats = esp8266_emulator_stats();
+		uint32_t to_module = stats->bytes_from_host, to_host = stats->bytes_to_host;
+		uint32_t time = bench_requests(transport, body, body_len);
+		if(time == 0){
+			printf("%-16s failed\n", names[transport]);
+			continue;
+		}
+		printf("%-16s %6.1f ms/request, %5lu uart bytes/request\n", names[transport], (double) time / BENCH_REQUESTS,
+			   (unsigned long) ((stats->bytes_from_host - to_module + stats->bytes_to_host - to_host) / BENCH_REQUESTS));
+	}
+
+	/* Readings as they change from one second to the next */
+	display_init();
+	reset_screen_canvas();
+	show_measurements(21.50f, 40.00f, 612, 20);
+	display_wait_flush(100);
+	uint32_t flushed = display_get_flushed_bytes();
+	uint32_t bus_bytes = ssd1306_emulator_stats()->bus_bytes;
+	uint32_t transfers = ssd1306_emulator_stats()->transfers;
+	for(uint16_t i = 1; i <= BENCH_REFRESHES; i++){
+		show_measurements(21.50f + (i % 3) * 0.01f, 40.00f + (i % 5) * 0.02f, 612 + i % 4, 20 + i % 2);
+		display_wait_flush(100);
+	}
+	printf("%-16s %6lu display bytes/refresh, %u for the whole frame\n", "show_measurements",
+		   (unsigned long) ((display_get_flushed_bytes() - flushed) / BENCH_REFRESHES), FULL_FRAME_BYTES);
+	printf("%-16s %6lu bus bytes/refresh, %lu i2c transfers, as the ssd1306 emulator saw them\n", "show_measurements",
+		   (unsigned long) ((ssd1306_emulator_stats()->bus_bytes - bus_bytes) / BENCH_REFRESHES),
+		   (unsigned long) ((ssd1306_emulator_stats()->transfers - transfers) / BENCH_REFRESHES));
+
+	/* Time of drawing and flushing a refresh, the i2c takes no time here */
+	start = HAL_GetTick();
+	for(uint32_t i = 1; i <= BENCH_REFRESH_LOOPS; i++){
+		show_measurements(21.50f + (i % 3) * 0.01f, 40.00f + (i % 5) * 0.02f, 612 + i % 4, 20 + i % 2);
+		display_wait_flush(100);
+	}
+	printf("%-16s %6.2f us/refresh\n", "show_measurements", (HAL_GetTick() - start) * 1000.0 / BENCH_REFRESH_LOOPS);
+
+	/* A point a minute on the history screen, steady values and values that keep changing the scale */
+	static DISPLAY_GRAPH graph;
+	reset_screen_canvas();
+	display_wait_flush(100);
+	display_graph_init(&graph, 32, 0, 96, 32, DISPLAY_GRAPH_LINE, 100, 1);
+	for(uint16_t i = 0; i < 2 * 96; i++){
+		display_graph_add(&graph, 600 + (i * 7) % 80);
+		display_graph_draw(&graph);
+	}
+	display_update();
+	display_wait_flush(100);
+	flushed = display_get_flushed_bytes();
+	start = HAL_GetTick();
+	for(uint32_t i = 0; i < BENCH_REFRESH_LOOPS; i++){
+		display_graph_add(&graph, 600 + (i * 7) % 80);
+		display_graph_draw(&graph);
+		if(i < BENCH_REFRESHES){
+			display_update();
+			display_wait_flush(100);
+		}
+	}
+	printf("%-16s %6.2f us/point, %lu display bytes/point\n", "display_graph", (HAL_GetTick() - start) * 1000.0 / BENCH_REFRESH_LOOPS,
+		   (unsigned long) ((display_get_flushed_bytes() - flushed) / BENCH_REFRESHES));
+
+	/* Whole frames with the i2c at the speed of the board */
+	hal_shim_i2c_timing(true);
+	flushed = display_get_flushed_bytes();
+	uint32_t blocked = 0;
+	start = HAL_GetTick();
+	for(uint16_t i = 0; i < BENCH_FRAMES; i++){
+		uint32_t call = HAL_GetTick();
+		display_invalidate();
+		display_update();
+		blocked += HAL_GetTick() - call;
+		display_wait_flush(500);
+	}
+	uint32_t frame_time = HAL_GetTick() - start;
+	hal_shim_i2c_timing(false);
+	printf("%-16s %6.1f ms/frame, %lu display bytes/frame, %s addressing%s\n", "display_update", (double) frame_time / BENCH_FRAMES,
+		   (unsigned long) ((display_get_flushed_bytes() - flushed) / BENCH_FRAMES), DISPLAY_HORIZONTAL_ADDRESSING ? "horizontal" : "page",
+		   DISPLAY_DMA ? " with dma" : "");
+	printf("%-16s %6.1f ms/frame blocked\n", "display_update", (double) blocked / BENCH_FRAMES);
+
+	/* Chars at a row that is not on a page boundary, so both pages of the cell are written */
+	start = HAL_GetTick();
+	for(uint32_t i = 0; i < BENCH_GLYPHS; i++)
+		write_char_pixels(' ' + i % 95, Font_7x10, WHITE, 1 + (i % 16) * 7, 13);
+	uint32_t pixel_time = HAL_GetTick() - start;
+	start = HAL_GetTick();
+	for(uint32_t i = 0; i < BENCH_GLYPHS; i++){
+		display_set_position(1 + (i % 16) * 7, 13);
+		display_write_char(' ' + i % 95, Font_7x10, WHITE);
+	}
+	uint32_t column_time = HAL_GetTick() - start;
+	printf("%-16s %8.0f glyphs/s a pixel at a time, %8.0f glyphs/s from the columns\n", "display_write_char",
+		   BENCH_GLYPHS * 1000.0 / (pixel_time ? pixel_time : 1), BENCH_GLYPHS * 1000.0 / (column_time ? column_time : 1));
+
+	/* Large digits where show_measurements draws them, on a page boundary */
+	start = HAL_GetTick();
+	for(uint32_t i = 0; i < BENCH_GLYPHS; i++){
+		display_set_position(1 + (i % 8) * 14, 16);
+		display_write_char('0' + i % 10, Font_14x20, WHITE);
+	}
+	column_time = HAL_GetTick() - start;
+	printf("%-16s %8.0f large glyphs/s\n", "display_write_char", BENCH_GLYPHS * 1000.0 / (column_time ? column_time : 1));
+}
+
+int main(int argc, char** argv){
+	ssd1306_emulator_reset();
+	server_port = test_server_start();
+	if(server_port == 0){
+		fprintf(stderr, "could not start the test server\n");
+		return 1;
+	}
+
+	if(argc > 1 && strcmp(argv[1], "bench") == 0){
+		bench();
+		test_server_stop();
+		return 0;
+	}
+	golden_update = (argc > 1 && strcmp(argv[1], "golden") == 0);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_emulator_init);
+	RUN_TEST(test_emulator_init_fast_rate);
+	RUN_TEST(test_emulator_init_restart);
+	RUN_TEST(test_emulator_wifi_join);
+	RUN_TEST(test_emulator_wifi_wrong_password);
+	RUN_TEST(test_emulator_web_request);
+	RUN_TEST(test_emulator_fragmented_response);
+	RUN_TEST(test_emulator_latency);
+	RUN_TEST(test_emulator_upload);
+	RUN_TEST(test_emulator_upload_sleep);
+	RUN_TEST(test_ccs811_drive_mode_sequencing);
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_MQTT
+	RUN_TEST(test_emulator_mqtt_ack_timeout);
+#endif
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTP
+	RUN_TEST(test_emulator_upload_cipsend_error);
+	RUN_TEST(test_emulator_upload_server_close);
+	RUN_TEST(test_emulator_upload_idle_drop);
+	RUN_TEST(test_emulator_upload_recovery);
+#endif
+	RUN_TEST(test_emulator_passthrough);
+	RUN_TEST(test_emulator_deep_sleep);
+	RUN_TEST(test_emulator_light_sleep);
+	RUN_TEST(test_display_partial_update);
+	RUN_TEST(test_display_glyphs);
+	RUN_TEST(test_display_large_font);
+	RUN_TEST(test_display_no_delay);
+	RUN_TEST(test_display_field);
+	RUN_TEST(test_display_graph);
+	RUN_TEST(test_display_emulator);
+	RUN_TEST(test_display_golden);
+#if DISPLAY_DMA
+	RUN_TEST(test_display_dma_flush);
+#endif
+	RUN_TEST(test_cbor_reader);
+	RUN_TEST(test_cbor_batch_round_trip);
+	int failures = UNITY_END();
+
+	esp8266_emulator_stop();
+	test_server_stop();
+	return failures;
+}
@@ -0,0 +1,259 @@
+/**
+******************************************************************************
+@brief functions for the host SSD1306 emulator
+@details Commands can be split over several transfers, ssd1306.c sends the
+		 init sequence one byte at a time, so the command being decoded and
+		 the arguments it still needs are kept between writes.
+
+		 Data bytes go to the column and page of the RAM pointer. With
+		 horizontal addressing the pointer moves along the column window and
+		 on to the next page of the page window at its end, wrapping to the
+		 start of both. With page addressing it moves along the page and
+		 wraps to column 0 of the same page, vertical addressing moves down
+		 the pages first. This is how the datasheet describes the pointer.
+
+@file ssd1306_emulator.c
+@version 1.0
+*******************************************************************************/
+#include "ssd1306_emulator.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define CONTROL_DATA		0x40	// Co = 0, D/C# = 1
+#define ARGUMENTS_MAX		6
+
+typedef enum { MODE_HORIZONTAL = 0, MODE_VERTICAL = 1, MODE_PAGE = 2 } ADDRESSING;
+
+static uint8_t	 ram[SSD1306_EMULATOR_PAGES * SSD1306_EMULATOR_WIDTH];
+static SSD1306_EMULATOR_STATS stats;
+
+static ADDRESSING mode;
+static uint8_t	 column, page;						// RAM pointer
+static uint8_t	 column_start, column_end;			// windows of horizontal and vertical addressing
+static uint8_t	 page_start, page_end;
+
+static uint8_t	 pending;							// command waiting for arguments, 0 if none
+static uint8_t	 needed;							// arguments it still needs
+static uint8_t	 arguments[ARGUMENTS_MAX];
+static uint8_t	 received;
+
+/* Arguments that follow a command byte */
+static uint8_t
+argument_count(uint8_t command){
+	switch(command){
+		case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+		case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+			return 1;
+		case 0x21: case 0x22: case 0xA3:
+			return 2;
+		case 0x29: case 0x2A:
+			return 5;
+		case 0x26: case 0x27:
+			return 6;
+		default:
+			return 0;
+	}
+}
+
+static bool
+known(uint8_t command){
+	return command <= 0x22 || (command >= 0x26 && command <= 0x2F && command != 0x28) || (command >= 0x40 && command <= 0x81) ||
+		   command == 0x8D || (command >= 0xA0 && command <= 0xA8) || command == 0xAE || command == 0xAF ||
+		   (command >= 0xB0 && command <= 0xB7) || command == 0xC0 || command == 0xC8 || command == 0xD3 ||
+		   command == 0xD5 || command == 0xD9 || command == 0xDA || command == 0xDB || command == 0xE3;
+}
+
+/* A whole command, with its arguments */
+static void
+run(uint8_t command, const uint8_t* args){
+	if(command <= 0x0F)
+		column = (column & 0xF0) | command;
+	else if(command <= 0x1F)
+		column = ((command & 0x07) << 4) | (column & 0x0F);
+	else if(command == 0x20)
+		mode = (args[0] & 0x03) <= MODE_PAGE ? (ADDRESSING) (args[0] & 0x03) : MODE_PAGE;
+	else if(command == 0x21){
+		column_start = args[0] & 0x7F;
+		column_end	 = args[1] & 0x7F;
+		column		 = column_start;
+	}
+	else if(command == 0x22){
+		page_start = args[0] & 0x07;
+		page_end   = args[1] & 0x07;
+		page	   = page_start;
+	}
+	else if(command >= 0xB0 && command <= 0xB7)
+		page = command & 0x07;
+}
+
+static void
+command_byte(uint8_t byte){
+	if(pending != 0){
+		arguments[received++] = byte;
+		if(--needed == 0){
+			run(pending, arguments);
+			pending = 0;
+		}
+		return;
+	}
+
+	if(!known(byte))
+		stats.unknown++;
+	needed = argument_count(byte);
+	if(needed == 0){
+		run(byte, NULL);
+		return;
+	}
+	pending	 = byte;
+	received = 0;
+}
+
+static void
+data_byte(uint8_t byte){
+	ram[page * SSD1306_EMULATOR_WIDTH + column] = byte;
+	stats.data_bytes++;
+
+	if(mode == MODE_PAGE){
+		column = (column + 1) % SSD1306_EMULATOR_WIDTH;
+		return;
+	}
+	if(mode == MODE_HORIZONTAL){
+		if(column++ < column_end)
+			return;
+		column = column_start;
+		page   = (page < page_end) ? page + 1 : page_start;
+		return;
+	}
+	if(page++ < page_end)
+		return;
+	page   = page_start;
+	column = (column < column_end) ? column + 1 : column_start;
+}
+
+void
+ssd1306_emulator_reset(void){
+	memset(ram, 0, sizeof(ram));
+	memset(&stats, 0, sizeof(stats));
+	mode		 = MODE_PAGE;
+	column		 = 0;
+	page		 = 0;
+	column_start = 0;
+	column_end	 = SSD1306_EMULATOR_WIDTH - 1;
+	page_start	 = 0;
+	page_end	 = SSD1306_EMULATOR_PAGES - 1;
+	pending		 = 0;
+}
+
+void
+ssd1306_emulator_write(uint8_t control, const uint8_t* data, uint16_t len){
+	stats.transfers++;
+	stats.bus_bytes += 2 + len;
+
+	for(uint16_t i = 0; i < len; i++){
+		if(control & CONTROL_DATA)
+			data_byte(data[i]);
+		else {
+			command_byte(data[i]);
+			stats.commands++;
+		}
+	}
+}
+
+bool
+ssd1306_emulator_pixel(uint8_t x, uint8_t y){
+	if(x >= SSD1306_EMULATOR_WIDTH || y >= SSD1306_EMULATOR_HEIGHT)
+		return false;
+	return (ram[(y / 8) * SSD1306_EMULATOR_WIDTH + x] >> (y % 8)) & 1;
+}
+
+const uint8_t*
+ssd1306_emulator_ram(void){
+	return ram;
+}
+
+const SSD1306_EMULATOR_STATS*
+ssd1306_emulator_stats(void){
+	return &stats;
+}
+
+bool
+ssd1306_emulator_write_pbm(const char* path){
+	FILE* file = fopen(path, "w");
+	if(file == NULL)
+		return false;
+
+	/* Plain PBM keeps lines under 70 chars, so a row is written as two lines */
+	fprintf(file, "P1\n%d %d\n", SSD1306_EMULATOR_WIDTH, SSD1306_EMULATOR_HEIGHT);
+	for(uint8_t y = 0; y < SSD1306_EMULATOR_HEIGHT; y++){
+		for(uint8_t x = 0; x < SSD1306_EMULATOR_WIDTH; x++){
+			fputc(ssd1306_emulator_pixel(x, y) ? '1' : '0', file);
+			if(x % (SSD1306_EMULATOR_WIDTH / 2) == SSD1306_EMULATOR_WIDTH / 2 - 1)
+				fputc('\n', file);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+/* Next number of the header, comments skipped, -1 at the end of the file */
+static int32_t
+header_number(FILE* file){
+	int c = fgetc(file);
+	while(c != EOF && (isspace(c) || c == '#')){
+		if(c == '#')
+			while(c != EOF && c != '\n')
+				c = fgetc(file);
+		c = fgetc(file);
+	}
+	if(c == EOF || !isdigit(c))
+		return -1;
+
+	int32_t value = 0;
+	while(c != EOF && isdigit(c)){
+		value = value * 10 + (c - '0');
+		c = fgetc(file);
+	}
+	return value;
+}
+
+int32_t
+ssd1306_emulator_compare_pbm(const char* path){
+	FILE* file = fopen(path, "rb");
+	char magic[2];
+	int byte = 0;
+	int32_t differ = 0;
+
+	if(file == NULL)
+		return -1;
+	if(fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4') ||
+	   header_number(file) != SSD1306_EMULATOR_WIDTH || header_number(file) != SSD1306_EMULATOR_HEIGHT){
+		fclose(file);
+		return -1;
+	}
+
+	for(uint8_t y = 0; y < SSD1306_EMULATOR_HEIGHT; y++){
+		for(uint8_t x = 0; x < SSD1306_EMULATOR_WIDTH; x++){
+			int bit;
+			if(magic[1] == '1'){
+				int c;
+				do
+					c = fgetc(file);
+				while(c != EOF && c != '0' && c != '1');
+				bit = c - '0';
+			}
+			else {
+				if(x % 8 == 0)
+					byte = fgetc(file);
+				bit = (byte == EOF) ? -1 : (byte >> (7 - x % 8)) & 1;
+			}
+			if(bit < 0){
+				fclose(file);
+				return -1;
+			}
+			if(bit != ssd1306_emulator_pixel(x, y))
+				differ++;
+		}
+	}
+	fclose(file);
+	return differ;
+}
@@ -0,0 +1,397 @@
+/**
+******************************************************************************
+@brief functions for the local test server of the host build
+@details The server thread waits on the listening socket, the udp socket and
+		 the open connection with poll. Received bytes are collected until a
+		 whole request is in, the headers and Content-Length bytes of body,
+		 and the request is then answered. A new connection replaces the open
+		 one, as the ESP8266 only has one connection at a time.
+		 On an mqtt connection the bytes are collected until a whole packet
+		 is in, by the remaining length of its fixed header.
+
+@file test_server.c
+@version 1.0
+*******************************************************************************/
+#define _GNU_SOURCE
+#include "test_server.h"
+#include "mqtt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define POLL_INTERVAL	10		// ms between checks of the stop flag
+
+static pthread_t		thread;
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool	running = false;
+static int				listen_fd = -1;
+static int				udp_fd	  = -1;
+static int				client_fd = -1;
+static volatile bool	drop_requested = false;
+static bool				mqtt_client = false;	// the open connection started with an mqtt CONNECT
+
+/* Answer, set by the tests */
+static uint16_t			status = 200;
+static char				body[TEST_SERVER_BODY_SIZE + 1];
+static bool				close_after = false;
+static uint16_t			chunk_size = 0;
+static uint32_t			delay = 0;
+static uint16_t			drop_acks = 0;
+
+static TEST_SERVER_STATS stats;
+
+/* Request being received */
+static char				request[TEST_SERVER_REQUEST_SIZE + 1];
+static uint16_t			request_len = 0;
+
+static const char*
+reason(uint16_t code){
+	switch(code){
+		case 200: return "OK";
+		case 204: return "No Content";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 408: return "Request Timeout";
+		case 429: return "Too Many Requests";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		default:  return "Unknown";
+	}
+}
+
+static void
+close_client(void){
+	if(client_fd >= 0)
+		close(client_fd);
+	client_fd	= -1;
+	request_len = 0;
+	mqtt_client = false;
+}
+
+/* Returns the length of the whole request if it has been received, 0 if not */
+static uint16_t
+request_complete(uint16_t* body_offset){
+	request[request_len] = '\0';
+	char* end = strstr(request, "\r\n\r\n");
+	if(end == NULL)
+		return 0;
+	*body_offset = end + 4 - request;
+
+	long content_length = 0;
+	for(char* line = request; line < end; line = strstr(line, "\r\n") + 2){
+		if(strncasecmp(line, "Content-Length:", 15) == 0)
+			content_length = strtol(line + 15, NULL, 10);
+	}
+	if(*body_offset + content_length > request_len)
+		return 0;
+	return *body_offset + content_length;
+}
+
+static void
+answer(uint16_t len, uint16_t body_offset){
+	char response[3 * TEST_SERVER_BODY_SIZE + 512];
+	char text[TEST_SERVER_BODY_SIZE + 1];
+	uint16_t code, chunk;
+	bool close;
+	int n;
+
+	pthread_mutex_lock(&lock);
+	memcpy(stats.request, request, len);
+	stats.request[len] = '\0';
+	stats.request_len  = len;
+	stats.body_offset  = body_offset;
+	stats.requests++;
+	code  = status;
+	chunk = chunk_size;
+	strcpy(text, body);
+	close = close_after || strcasestr(request, "Connection: close") != NULL;
+	uint32_t wait = delay;
+	pthread_mutex_unlock(&lock);
+
+	if(wait > 0)
+		usleep(wait * 1000);
+
+	n = sprintf(response, "HTTP/1.1 %u %s\r\nServer: oem-host\r\nConnection: %s\r\n",
+				code, reason(code), close ? "close" : "keep-alive");
+	if(chunk == 0)
+		n += sprintf(&response[n], "Content-Length: %u\r\n\r\n%s", (unsigned) strlen(text), text);
+	else {
+		n += sprintf(&response[n], "Transfer-Encoding: chunked\r\n\r\n");
+		for(uint16_t i = 0; i < strlen(text); i += chunk){
+			uint16_t part = (strlen(text) - i < chunk) ? strlen(text) - i : chunk;
+			n += sprintf(&response[n], "%x\r\n%.*s\r\n", part, part, &text[i]);
+		}
+		n += sprintf(&response[n], "0\r\n\r\n");
+	}
+	send(client_fd, response, n, MSG_NOSIGNAL);
+
+	/* Keep what came after the request, the next one may already be on its way */
+	memmove(request, &request[len], request_len - len);
+	request_len -= len;
+
+	if(close){
+		pthread_mutex_lock(&lock);
+		stats.closes++;
+		pthread_mutex_unlock(&lock);
+		close_client();
+	}
+}
+
+/* Returns the length of the whole mqtt packet if it has been received, 0 if not */
+static uint16_t
+mqtt_packet_complete(uint16_t* header_len){
+	uint32_t remaining = 0;
+
+	/* The remaining length is a variable byte integer of up to 4 bytes after the first */
+	for(uint16_t i = 1; i < 5 && i < request_len; i++){
+		remaining |= (uint32_t) ((uint8_t) request[i] & 0x7F) << (7 * (i - 1));
+		if(((uint8_t) request[i] & 0x80) == 0){
+			*header_len = i + 1;
+			return (*header_len + remaining <= request_len) ? *header_len + remaining : 0;
+		}
+	}
+	return 0;
+}
+
+static void
+mqtt_answer(uint16_t len, uint16_t header_len){
+	uint8_t type = (uint8_t) request[0] & 0xF0;
+	uint8_t ack[4];
+	uint16_t ack_len = 0;
+
+	pthread_mutex_lock(&lock);
+	switch(type){
+		case MQTT_CONNECT:
+			stats.mqtt_connects++;
+			ack[0]	= MQTT_CONNACK;
+			ack[1]	= 0x02;
+			ack[2]	= 0x00;		// no session present
+			ack[3]	= 0x00;		// accepted
+			ack_len = 4;
+			break;
+
+		case MQTT_PUBLISH: {
+			/* Topic, then the packet identifier for qos 1, then the payload */
+			uint16_t payload = header_len + 2 + (((uint8_t) request[header_len] << 8) | (uint8_t) request[header_len + 1]);
+			if((request[0] & 0x06) != 0){
+				ack[0]	= MQTT_PUBACK;
+				ack[1]	= 0x02;
+				ack[2]	= request[payload];
+				ack[3]	= request[payload + 1];
+				ack_len = 4;
+				payload += 2;
+			}
+			memcpy(stats.request, request, len);
+			stats.request[len] = '\0';
+			stats.request_len  = len;
+			stats.body_offset  = payload;
+			stats.publishes++;
+			break;
+		}
+
+		case MQTT_PINGREQ:
+			stats.pings++;
+			ack[0]	= MQTT_PINGRESP;
+			ack[1]	= 0x00;
+			ack_len = 2;
+			break;
+
+		default:
+			break;
+	}
+	if(type != MQTT_CONNECT && ack_len > 0 && drop_acks > 0){
+		drop_acks--;
+		ack_len = 0;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if(ack_len > 0)
+		send(client_fd, ack, ack_len, MSG_NOSIGNAL);
+
+	memmove(request, &request[len], request_len - len);
+	request_len -= len;
+
+	if(type == MQTT_DISCONNECT)
+		close_client();
+}
+
+static void*
+serve(void* arg){
+	(void) arg;
+	uint8_t datagram[TEST_SERVER_DATAGRAM_SIZE];
+	uint16_t body_offset, header_len;
+
+	while(running){
+		struct pollfd fds[3] = {
+			{ .fd = listen_fd, .events = POLLIN },
+			{ .fd = udp_fd,	   .events = POLLIN },
+			{ .fd = client_fd, .events = POLLIN }
+		};
+		if(poll(fds, (client_fd >= 0) ? 3 : 2, POLL_INTERVAL) < 0)
+			continue;
+
+		if(drop_requested){
+			drop_requested = false;
+			close_client();
+			continue;
+		}
+
+		if(fds[0].revents & POLLIN){
+			int fd = accept(listen_fd, NULL, NULL);
+			if(fd >= 0){
+				close_client();
+				client_fd = fd;
+				pthread_mutex_lock(&lock);
+				stats.connections++;
+				pthread_mutex_unlock(&lock);
+			}
+		}
+
+		if(fds[1].revents & POLLIN){
+			ssize_t len = recv(udp_fd, datagram, sizeof(datagram), 0);
+			if(len > 0){
+				pthread_mutex_lock(&lock);
+				stats.datagrams++;
+				stats.datagram_bytes += len;
+				memcpy(stats.datagram, datagram, len);
+				stats.datagram_len = len;
+				pthread_mutex_unlock(&lock);
+			}
+		}
+
+		if(client_fd >= 0 && (fds[2].revents & (POLLIN | POLLHUP))){
+			ssize_t len = recv(client_fd, &request[request_len], TEST_SERVER_REQUEST_SIZE - request_len, 0);
+			if(len <= 0){
+				close_client();
+				continue;
+			}
+			/* An mqtt client starts with CONNECT, an http request with the method */
+			if(request_len == 0 && ((uint8_t) request[0] & 0xF0) == MQTT_CONNECT)
+				mqtt_client = true;
+			request_len += len;
+
+			uint16_t complete;
+			if(mqtt_client){
+				while(client_fd >= 0 && (complete = mqtt_packet_complete(&header_len)) > 0)
+					mqtt_answer(complete, header_len);
+			}
+			else {
+				while(client_fd >= 0 && (complete = request_complete(&body_offset)) > 0)
+					answer(complete, body_offset);
+			}
+			if(request_len == TEST_SERVER_REQUEST_SIZE)
+				close_client();
+		}
+	}
+	return NULL;
+}
+
+uint16_t
+test_server_start(void){
+	struct sockaddr_in address;
+	socklen_t address_len = sizeof(address);
+	int one = 1;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port		= 0;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listen_fd, 4) != 0)
+		return 0;
+	getsockname(listen_fd, (struct sockaddr*) &address, &address_len);
+
+	/* The udp collector uses the same port number */
+	udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(udp_fd < 0 || bind(udp_fd, (struct sockaddr*) &address, sizeof(address)) != 0)
+		return 0;
+
+	test_server_respond(200, "", false);
+	test_server_chunked(0);
+	test_server_delay(0);
+	test_server_mqtt_drop_acks(0);
+	test_server_reset();
+
+	running = true;
+	if(pthread_create(&thread, NULL, serve, NULL) != 0){
+		running = false;
+		return 0;
+	}
+	return ntohs(address.sin_port);
+}
+
+void
+test_server_stop(void){
+	if(running){
+		running = false;
+		pthread_join(thread, NULL);
+	}
+	close_client();
+	if(listen_fd >= 0)
+		close(listen_fd);
+	if(udp_fd >= 0)
+		close(udp_fd);
+	listen_fd = -1;
+	udp_fd	  = -1;
+}
+
+void
+test_server_respond(uint16_t code, const char* text, bool close){
+	pthread_mutex_lock(&lock);
+	status = code;
+	strncpy(body, text, TEST_SERVER_BODY_SIZE);
+	body[TEST_SERVER_BODY_SIZE] = '\0';
+	close_after = close;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+test_server_chunked(uint16_t size){
+	pthread_mutex_lock(&lock);
+	chunk_size = size;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+test_server_delay(uint32_t ms){
+	pthread_mutex_lock(&lock);
+	delay = ms;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+test_server_drop_connection(void){
+	drop_requested = true;
+	while(running && drop_requested)
+		usleep(1000);
+}
+
+void
+test_server_mqtt_drop_acks(uint16_t count){
+	pthread_mutex_lock(&lock);
+	drop_acks = count;
+	pthread_mutex_unlock(&lock);
+}
+
+void
+test_server_reset(void){
+	pthread_mutex_lock(&lock);
+	memset(&stats, 0, sizeof(stats));
+	pthread_mutex_unlock(&lock);
+}
+
+void
+test_server_stats(TEST_SERVER_STATS* copy){
+	pthread_mutex_lock(&lock);
+	*copy = stats;
+	pthread_mutex_unlock(&lock);
+}